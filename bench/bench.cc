@@ -0,0 +1,365 @@
+/**
+ * @file bench.cc
+ * @brief Benchmarks of the pipeline on the target, run at boot
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include <stm32l4xx_hal.h>
+
+#include <models/model_tflite.h>
+#include <tensorflow/lite/micro/system_setup.h>
+
+#include "classifier.h"
+#include "frontend.h"
+#include "op_profiler.h"
+
+extern "C" {
+#include <checksum.h>
+#include "bench.h"
+#include "clock.h"
+#include "cycles.h"
+#include "debug_io.h"
+#include "model_store.h"
+#include "serial.h"
+}
+
+// Same as kTensorArenaSize in src/main.cc
+const int kTensorArenaSize = 66800;
+alignas(16) static uint8_t tensor_arena[kTensorArenaSize];
+
+// Also the SRAM2 source of the memory benchmarks
+__attribute__((section(".sram2_bss")))
+static int16_t waveform[speech::frontend::num_samples];
+
+// Bytes moved by the memory benchmarks, from each region
+static constexpr size_t mem_bytes = 4096;
+static_assert(2 * mem_bytes <= kTensorArenaSize, "Arena too small");
+static_assert(mem_bytes <= sizeof(waveform), "Waveform too small");
+
+static constexpr uint16_t max_iterations = 64;
+// Both cache states, the fixed suite and every operator of the model
+static constexpr size_t max_entries =
+	2 * (16 + speech::op_profiler::max_events);
+
+static struct {
+	struct bench_header header;
+	struct bench_entry entries[max_entries];
+} record;
+static_assert(sizeof(record.header) % 4 == 0, "Padding in bench record");
+
+static uint32_t samples[max_iterations];
+static uint32_t op_samples[speech::op_profiler::max_events][max_iterations];
+
+/**
+ * @brief Append an entry with the median and 99th percentile of cycles
+ * @param cycles one value per iteration, sorted in place
+ */
+static void add_entry(const char *name, uint32_t bytes, uint16_t iterations,
+		      uint8_t flags, uint32_t *cycles)
+{
+	assert(record.header.num_entries < max_entries);
+	struct bench_entry *entry =
+		&record.entries[record.header.num_entries++];
+	memset(entry, 0, sizeof(*entry));
+	strncpy(entry->name, name, BENCH_NAME_LEN);
+	entry->bytes = bytes;
+	entry->iterations = iterations;
+	entry->flags = flags;
+
+	std::sort(cycles, cycles + iterations);
+	entry->median_cycles = cycles[iterations / 2];
+	entry->p99_cycles = cycles[std::min<uint32_t>(iterations - 1,
+						      iterations * 99 / 100)];
+}
+
+/**
+ * @param setup run before every iteration, not timed
+ */
+template <typename setup_fn, typename run_fn>
+static void measure(const char *name, uint32_t bytes, uint16_t iterations,
+		    uint8_t flags, setup_fn setup, run_fn run)
+{
+	assert(iterations <= max_iterations);
+
+	// Once untimed, so the first iteration is not an outlier
+	setup();
+	run();
+	for (uint16_t i = 0; i < iterations; i++) {
+		setup();
+		uint32_t start = cycles_now();
+		run();
+		samples[i] = cycles_now() - start;
+	}
+	add_entry(name, bytes, iterations, flags, samples);
+}
+
+static void nothing()
+{
+}
+
+/**
+ * @brief Switch the ART instruction cache, data cache and prefetch
+ *
+ * Both caches are flushed either way, so every suite starts cold.
+ */
+static void set_caches(bool enable)
+{
+	__HAL_FLASH_PREFETCH_BUFFER_DISABLE();
+	__HAL_FLASH_INSTRUCTION_CACHE_DISABLE();
+	__HAL_FLASH_DATA_CACHE_DISABLE();
+	__HAL_FLASH_INSTRUCTION_CACHE_RESET();
+	__HAL_FLASH_DATA_CACHE_RESET();
+	if (enable) {
+		__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+		__HAL_FLASH_DATA_CACHE_ENABLE();
+		__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+	}
+}
+
+/**
+ * @brief Repeatable input: a tone with noise from a fixed seed, as in
+ * host/bench.cc
+ */
+static void make_waveform(int16_t *waveform, size_t len)
+{
+	uint32_t state = 12345;
+	for (size_t i = 0; i < len; i++) {
+		state = state * 1664525 + 1013904223;
+		int32_t noise = (int32_t)(state >> 20) - 2048;
+		waveform[i] = (int16_t)(8000 * ((i / 20) % 2 ? 1 : -1) + noise);
+	}
+}
+
+static void read_words(const void *src, size_t len)
+{
+	const uint32_t *p = (const uint32_t *)src;
+	uint32_t sum = 0;
+	for (size_t i = 0; i < len / sizeof(uint32_t); i++) {
+		sum += p[i];
+	}
+	asm volatile("" : : "r"(sum));
+}
+
+/**
+ * @brief Bandwidth of flash, SRAM1 and SRAM2, copies go to SRAM1
+ *
+ * Uses the start of the tensor arena, so runs before a model is loaded.
+ */
+static void bench_memory(uint8_t flags)
+{
+	const uint8_t *flash = model_tflite;
+	uint8_t *sram1 = tensor_arena;
+	const uint8_t *sram2 = (const uint8_t *)waveform;
+	uint8_t *dst = tensor_arena + mem_bytes;
+
+	measure("read flash", mem_bytes, 32, flags, nothing,
+		[&]() { read_words(flash, mem_bytes); });
+	measure("read sram1", mem_bytes, 32, flags, nothing,
+		[&]() { read_words(sram1, mem_bytes); });
+	measure("read sram2", mem_bytes, 32, flags, nothing,
+		[&]() { read_words(sram2, mem_bytes); });
+	measure("memcpy flash", mem_bytes, 32, flags, nothing,
+		[&]() { memcpy(dst, flash, mem_bytes); });
+	measure("memcpy sram1", mem_bytes, 32, flags, nothing,
+		[&]() { memcpy(dst, sram1, mem_bytes); });
+	measure("memcpy sram2", mem_bytes, 32, flags, nothing,
+		[&]() { memcpy(dst, sram2, mem_bytes); });
+}
+
+/**
+ * @brief CRC32 of a block and writing one to the debug UART
+ *
+ * Also uses the tensor arena as scratch memory.
+ */
+static void bench_io(uint8_t flags)
+{
+	uint8_t *block = tensor_arena;
+	for (size_t i = 0; i < SERIAL_BLOCK_SIZE; i++) {
+		block[i] = (uint8_t)(i * 31);
+	}
+	measure("crc_32", SERIAL_BLOCK_SIZE, 64, flags, nothing, [&]() {
+		uint32_t crc = crc_32(block, SERIAL_BLOCK_SIZE);
+		asm volatile("" : : "r"(crc));
+	});
+
+	// Blanks, so the host can tell them from the record
+	memset(block, ' ', SERIAL_BLOCK_SIZE);
+	measure("uart write", SERIAL_BLOCK_SIZE, 8, flags, nothing,
+		[&]() { uart_debug_write_raw(block, SERIAL_BLOCK_SIZE); });
+}
+
+static void bench_frontend(speech::frontend &frontend, uint8_t flags)
+{
+	static float conditioned[speech::frontend::window_size];
+	static float frame[speech::frontend::window_size];
+	static float spectrum[speech::frontend::window_size];
+	static float mag[speech::frontend::num_bins];
+	static arm_rfft_fast_instance_f32 fft;
+	arm_rfft_fast_init_256_f32(&fft);
+	const uint32_t window = speech::frontend::window_size;
+
+	float min, max;
+	measure("minmax", sizeof(waveform), 16, flags, nothing, [&]() {
+		speech::frontend::minmax(waveform,
+					 speech::frontend::num_samples, &min,
+					 &max);
+	});
+	measure("condition_frame", window * sizeof(int16_t), 64, flags,
+		nothing, [&]() {
+			frontend.condition_frame(waveform, min, max,
+						 conditioned);
+		});
+	// The RFFT overwrites its input, every iteration gets a fresh frame
+	measure("arm_rfft_fast_f32", window * sizeof(float), 64, flags,
+		[&]() { memcpy(frame, conditioned, sizeof(frame)); },
+		[&]() { arm_rfft_fast_f32(&fft, frame, spectrum, 0); });
+	const uint32_t num_complex = speech::frontend::window_size / 2 - 1;
+	measure("arm_cmplx_mag_f32", num_complex * 2 * sizeof(float), 64,
+		flags, nothing, [&]() {
+			arm_cmplx_mag_f32(spectrum + 2, mag + 1, num_complex);
+		});
+	measure("unpack_magnitude", window * sizeof(float), 64, flags,
+		nothing,
+		[&]() { speech::frontend::unpack_magnitude(spectrum, mag); });
+}
+
+/**
+ * @brief Whole front end into the input tensor, then Invoke() with the
+ * cycles of every operator
+ */
+static void bench_model(speech::frontend &frontend,
+			speech::classifier &classifier,
+			speech::op_profiler &profiler, uint8_t flags)
+{
+	TfLiteTensor *input = classifier.input();
+	measure("frontend", sizeof(waveform), 8, flags, nothing, [&]() {
+#ifdef INT8_IO
+		frontend.compute(waveform, speech::frontend::num_samples,
+				 input->data.int8, input->params.scale,
+				 input->params.zero_point);
+#else
+		frontend.compute(waveform, speech::frontend::num_samples,
+				 input->data.uint8);
+#endif
+	});
+
+	const uint16_t iterations = 16;
+	classifier.invoke();
+	size_t events = 0;
+	for (uint16_t i = 0; i < iterations; i++) {
+		profiler.clear();
+		uint32_t start = cycles_now();
+		classifier.invoke();
+		samples[i] = cycles_now() - start;
+
+		events = profiler.events();
+		for (size_t e = 0; e < events; e++) {
+			op_samples[e][i] = profiler.ticks(e);
+		}
+	}
+	add_entry("invoke", speech::frontend::features_size, iterations, flags,
+		  samples);
+
+	for (size_t e = 0; e < events; e++) {
+		char name[BENCH_NAME_LEN + 1];
+		snprintf(name, sizeof(name), "%u %s", e, profiler.tag(e));
+		add_entry(name, 0, iterations, flags | BENCH_FLAG_OP,
+			  op_samples[e]);
+	}
+}
+
+static void send_record()
+{
+	const uint32_t len = sizeof(record.header) +
+			     record.header.num_entries * sizeof(bench_entry);
+	const uint32_t crc = crc_32((const uint8_t *)&record, len);
+	uart_debug_write_raw(BENCH_MAGIC, strlen(BENCH_MAGIC));
+	uart_debug_write_raw(&len, sizeof(len));
+	uart_debug_write_raw(&record, len);
+	uart_debug_write_raw(&crc, sizeof(crc));
+}
+
+int main(int argc, char *argv[])
+{
+	tflite::InitializeTarget();
+	clock_set_profile(CLOCK_PROFILE_BOOST);
+	make_waveform(waveform, speech::frontend::num_samples);
+
+	static speech::frontend frontend;
+	speech::op_profiler profiler;
+	speech::classifier classifier(tensor_arena, kTensorArenaSize,
+				      &profiler);
+
+	// The uploaded model, as demo.elf would run it
+	size_t stored_len = 0;
+	const uint8_t *model = model_store_get(&stored_len);
+	if ((model == nullptr) ||
+	    !speech::classifier::validate(model, stored_len)) {
+		model = model_tflite;
+	}
+
+	record.header.core_clock = SystemCoreClock;
+	record.header.flash_acr = FLASH->ACR;
+	record.header.entry_size = sizeof(struct bench_entry);
+
+	printf("[i] Running benchmarks at %lu Hz...\n", SystemCoreClock);
+	for (int cached = 0; cached <= 1; cached++) {
+		const uint8_t flags = cached ? BENCH_FLAG_CACHE : 0;
+		set_caches(cached);
+		bench_memory(flags);
+		bench_io(flags);
+		bench_frontend(frontend, flags);
+		if (!classifier.load(model)) {
+			assert(!"AllocateTensors() failed\n");
+		}
+		bench_model(frontend, classifier, profiler, flags);
+		classifier.unload();
+	}
+	printf("[i] %u results, send anything to get them again.\n",
+	       record.header.num_entries);
+	send_record();
+
+	while (1) {
+		while (uart_debug_available() == 0) {
+			__WFI();
+		}
+		char c;
+		while (uart_debug_available() > 0) {
+			if (read(STDIN_FILENO, &c, 1) != 1) {
+				break;
+			}
+		}
+		send_record();
+	}
+}
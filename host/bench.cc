@@ -0,0 +1,458 @@
+/**
+ * @file bench.cc
+ * @brief Microbenchmarks of every pipeline stage on the host
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "classifier.h"
+#include "feature_store.h"
+#include "frontend.h"
+
+extern "C" {
+#include <checksum.h>
+#include "serial.h"
+}
+
+// Same as kTensorArenaSize in src/main.cc
+static constexpr size_t arena_size = 66800;
+
+struct alignas(16) arena {
+	uint8_t data[arena_size];
+};
+
+/**
+ * @brief Statistics of one benchmark, each iteration timed on its own
+ */
+struct result {
+	std::string name;
+	size_t bytes; /**< Processed per iteration */
+	size_t iterations;
+	double median_ns;
+	double p99_ns;
+	uint64_t median_cycles;
+	uint64_t p99_cycles;
+};
+
+/**
+ * @brief Time stamp counter, or nanoseconds where there is none
+ */
+static inline uint64_t cycles_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+#endif
+}
+
+template <typename T> static T percentile(std::vector<T> &v, double p)
+{
+	size_t i = std::min(v.size() - 1, (size_t)(p * v.size()));
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+/**
+ * @param setup run before every iteration, not timed
+ */
+template <typename setup_fn, typename run_fn>
+static result measure(const char *name, size_t bytes, size_t iterations,
+		      setup_fn setup, run_fn run)
+{
+	// Warm up caches and branch predictors
+	for (size_t i = 0; i < iterations / 10 + 1; i++) {
+		setup();
+		run();
+	}
+
+	std::vector<double> ns(iterations);
+	std::vector<uint64_t> cycles(iterations);
+	for (size_t i = 0; i < iterations; i++) {
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		uint64_t c = cycles_now();
+		run();
+		cycles[i] = cycles_now() - c;
+		std::chrono::duration<double, std::nano> elapsed =
+			std::chrono::steady_clock::now() - start;
+		ns[i] = elapsed.count();
+	}
+
+	result r;
+	r.name = name;
+	r.bytes = bytes;
+	r.iterations = iterations;
+	r.median_ns = percentile(ns, 0.5);
+	r.p99_ns = percentile(ns, 0.99);
+	r.median_cycles = percentile(cycles, 0.5);
+	r.p99_cycles = percentile(cycles, 0.99);
+	return r;
+}
+
+static void nothing()
+{
+}
+
+/**
+ * @brief Repeatable input: a tone with noise from a fixed seed
+ */
+static void make_waveform(int16_t *waveform, size_t len)
+{
+	uint32_t state = 12345;
+	for (size_t i = 0; i < len; i++) {
+		state = state * 1664525 + 1013904223;
+		int32_t noise = (int32_t)(state >> 20) - 2048;
+		waveform[i] = (int16_t)(8000 * ((i / 20) % 2 ? 1 : -1) + noise);
+	}
+}
+
+/**
+ * @brief A START transaction of len bytes as the host sends it
+ */
+static std::vector<uint8_t> make_transaction(size_t len)
+{
+	std::vector<uint8_t> tx;
+	auto append = [&tx](const void *buf, size_t n) {
+		tx.insert(tx.end(), (const uint8_t *)buf,
+			  (const uint8_t *)buf + n);
+	};
+	char header[16];
+	snprintf(header, sizeof(header), "%s%08zu",
+		 SERIAL_CMD_START_TRANSACTION, len);
+	append(header, strlen(header));
+
+	std::vector<uint8_t> block(SERIAL_BLOCK_SIZE);
+	for (size_t offset = 0; offset < len; offset += SERIAL_BLOCK_SIZE) {
+		for (size_t i = 0; i < block.size(); i++) {
+			block[i] = (uint8_t)(offset + 7 * i);
+		}
+		char crc[9];
+		snprintf(crc, sizeof(crc), "%08x",
+			 (unsigned)crc_32(block.data(), block.size()));
+		append(crc, 8);
+		append(block.data(), block.size());
+	}
+	return tx;
+}
+
+/**
+ * @brief Compare the front end kernels built in with CMSIS-DSP
+ *
+ * Every frame of the waveform goes through magnitude() and through
+ * arm_rfft_fast_f32() and arm_cmplx_mag_f32(). With the CMSIS kernels
+ * themselves this finds nothing, the vectorized ones round differently.
+ * @return false if the magnitudes or features differ by more than that
+ */
+static bool check_backend(speech::frontend &fe, const int16_t *waveform)
+{
+	using speech::frontend;
+	arm_rfft_fast_instance_f32 fft;
+	arm_rfft_fast_init_256_f32(&fft);
+
+	float min, max;
+	frontend::minmax(waveform, frontend::num_samples, &min, &max);
+	auto range = std::minmax_element(waveform,
+					 waveform + frontend::num_samples);
+	if ((min != (float)*range.first) || (max != (float)*range.second)) {
+		fprintf(stderr, "%s: minmax() is %.0f..%.0f instead of %d..%d\n",
+			frontend::backend(), min, max, *range.first,
+			*range.second);
+		return false;
+	}
+
+	double max_error = 0.0;
+	size_t differ = 0;
+	bool ok = true;
+	for (uint32_t i = 0; i < frontend::num_frames; i++) {
+		float frame[frontend::window_size];
+		float ref_frame[frontend::window_size];
+		float spectrum[frontend::window_size];
+		float mag[frontend::num_bins];
+		float ref_mag[frontend::num_bins];
+		fe.condition_frame(waveform + i * frontend::frame_step, min,
+				   max, frame);
+		memcpy(ref_frame, frame, sizeof(frame));
+
+		fe.magnitude(frame, mag);
+		arm_rfft_fast_f32(&fft, ref_frame, spectrum, 0);
+		ref_mag[0] = fabsf(spectrum[0]);
+		ref_mag[frontend::num_bins - 1] = fabsf(spectrum[1]);
+		arm_cmplx_mag_f32(spectrum + 2, ref_mag + 1,
+				  frontend::num_bins - 2);
+
+		uint8_t features[frontend::num_bins];
+		uint8_t ref_features[frontend::num_bins];
+		frontend::quantize(mag, features);
+		frontend::quantize(ref_mag, ref_features);
+		for (uint32_t k = 0; k < frontend::num_bins; k++) {
+			// Relative to the magnitude, plus one for the bins
+			// close to zero
+			double error = fabs((double)mag[k] - ref_mag[k]) /
+				       (1.0 + fabs((double)ref_mag[k]));
+			max_error = std::max(max_error, error);
+			int delta = abs(features[k] - ref_features[k]);
+			differ += (delta != 0);
+			ok &= (delta <= 1);
+		}
+	}
+	ok &= (max_error < 1e-4);
+	fprintf(stderr,
+		"%s: max. relative error %.2g against CMSIS-DSP, "
+		"%zu of %zu features differ%s\n",
+		frontend::backend(), max_error, differ,
+		frontend::features_size, ok ? "" : ", FAILED");
+	return ok;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-n iterations] [-m model.tflite] [-f features.spfs] "
+		"[-o out.json]\n"
+		"\n"
+		"Invoke() is only measured with a model. Its inputs are the\n"
+		"records of a feature store from speech_featurize, if given.\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t iterations = 1000;
+	const char *model_path = nullptr;
+	const char *store_path = nullptr;
+	const char *out_path = nullptr;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:m:f:o:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = std::max(1, atoi(optarg));
+			break;
+		case 'm':
+			model_path = optarg;
+			break;
+		case 'f':
+			store_path = optarg;
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// serial.c talks on stdin and stdout, the results go elsewhere
+	FILE *out = out_path ? fopen(out_path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+	if (out == nullptr) {
+		perror(out_path);
+		return 1;
+	}
+
+	using speech::frontend;
+	static frontend fe;
+	std::vector<result> results;
+
+	auto waveform = std::make_unique<int16_t[]>(frontend::num_samples);
+	make_waveform(waveform.get(), frontend::num_samples);
+	float min, max;
+	frontend::minmax(waveform.get(), frontend::num_samples, &min, &max);
+
+	results.push_back(measure(
+		"minmax", frontend::num_samples * sizeof(int16_t), iterations,
+		nothing, [&]() {
+			float lo, hi;
+			frontend::minmax(waveform.get(), frontend::num_samples,
+					 &lo, &hi);
+			asm volatile("" : : "g"(lo), "g"(hi));
+		}));
+
+	if (!check_backend(fe, waveform.get())) {
+		return 1;
+	}
+
+	float frame[frontend::window_size];
+	results.push_back(measure("condition_frame",
+				  frontend::window_size * sizeof(int16_t),
+				  iterations, nothing, [&]() {
+					  fe.condition_frame(waveform.get(), min,
+							     max, frame);
+				  }));
+
+	// The RFFT overwrites its input, every iteration gets a fresh frame
+	arm_rfft_fast_instance_f32 fft;
+	arm_rfft_fast_init_256_f32(&fft);
+	float conditioned[frontend::window_size];
+	float spectrum[frontend::window_size];
+	fe.condition_frame(waveform.get(), min, max, conditioned);
+	results.push_back(measure(
+		"arm_rfft_fast_f32", frontend::window_size * sizeof(float),
+		iterations,
+		[&]() { memcpy(frame, conditioned, sizeof(frame)); },
+		[&]() { arm_rfft_fast_f32(&fft, frame, spectrum, 0); }));
+
+	float mag[frontend::num_bins];
+	const uint32_t num_complex = frontend::window_size / 2 - 1;
+	results.push_back(measure(
+		"arm_cmplx_mag_f32", num_complex * 2 * sizeof(float),
+		iterations, nothing,
+		[&]() { arm_cmplx_mag_f32(spectrum + 2, mag + 1, num_complex); }));
+
+	results.push_back(measure(
+		"unpack_magnitude", frontend::window_size * sizeof(float),
+		iterations, nothing,
+		[&]() { frontend::unpack_magnitude(spectrum, mag); }));
+
+	// The kernels of the front end, which may not be the CMSIS ones
+	results.push_back(measure(
+		"magnitude", frontend::window_size * sizeof(float), iterations,
+		[&]() { memcpy(frame, conditioned, sizeof(frame)); },
+		[&]() { fe.magnitude(frame, mag); }));
+
+	std::vector<uint8_t> block(SERIAL_BLOCK_SIZE);
+	for (size_t i = 0; i < block.size(); i++) {
+		block[i] = (uint8_t)(i * 31);
+	}
+	results.push_back(measure("crc_32", block.size(), iterations, nothing,
+				  [&]() {
+					  uint32_t crc = crc_32(block.data(),
+								block.size());
+					  asm volatile("" : : "g"(crc));
+				  }));
+
+	// A whole START transaction read from a file standing in for the UART,
+	// so this includes one read() per byte as in serial.c
+	const size_t tx_len = 16 * SERIAL_BLOCK_SIZE;
+	std::vector<uint8_t> tx = make_transaction(tx_len);
+	FILE *tx_file = tmpfile();
+	int devnull = open("/dev/null", O_WRONLY);
+	if ((tx_file == nullptr) || (devnull < 0) ||
+	    (fwrite(tx.data(), 1, tx.size(), tx_file) != tx.size())) {
+		perror("serial_recv");
+		return 1;
+	}
+	fflush(tx_file);
+	dup2(fileno(tx_file), STDIN_FILENO);
+	dup2(devnull, STDOUT_FILENO);
+	std::vector<char> rx(tx_len);
+	results.push_back(measure(
+		"serial_recv", tx_len, std::max<size_t>(iterations / 100, 10),
+		[&]() { lseek(STDIN_FILENO, 0, SEEK_SET); },
+		[&]() {
+			if (serial_recv(rx.data(), rx.size()) != (int)tx_len) {
+				fprintf(stderr, "serial_recv failed\n");
+				exit(1);
+			}
+		}));
+
+	if (model_path != nullptr) {
+		std::ifstream f(model_path, std::ios::binary);
+		std::vector<uint8_t> model((std::istreambuf_iterator<char>(f)),
+					   std::istreambuf_iterator<char>());
+		auto mem = std::make_unique<arena>();
+		speech::classifier classifier(mem->data, arena_size);
+		if (!speech::classifier::validate(model.data(), model.size()) ||
+		    !classifier.load(model.data())) {
+			fprintf(stderr, "Cannot run %s\n", model_path);
+			return 1;
+		}
+		TfLiteTensor *input = classifier.input();
+#ifdef INT8_IO
+		fe.compute(waveform.get(), frontend::num_samples,
+			   input->data.int8, input->params.scale,
+			   input->params.zero_point);
+#else
+		fe.compute(waveform.get(), frontend::num_samples,
+			   input->data.uint8);
+#endif
+		// Real clips instead of the tone, one after the other
+		speech::feature_store store;
+		size_t next = 0;
+		auto next_record = [&]() {
+			if (store.size() > 0) {
+				memcpy(input->data.raw, store.record(next),
+				       frontend::features_size);
+				next = (next + 1) % store.size();
+			}
+		};
+		if ((store_path != nullptr) && !store.open(store_path)) {
+			return 1;
+		}
+		if ((store_path != nullptr) &&
+		    !store.matches(input->params.scale,
+				   input->params.zero_point)) {
+			return 1;
+		}
+		results.push_back(measure(
+			"invoke", frontend::features_size,
+			std::max<size_t>(iterations / 10, 10), next_record, [&]() {
+				if (!classifier.invoke()) {
+					fprintf(stderr, "Invoke() failed\n");
+					exit(1);
+				}
+			}));
+	}
+
+	// One benchmark per line, so results of two commits diff cleanly
+	fprintf(out, "{\n\t\"backend\": \"%s\",\n", frontend::backend());
+	fprintf(out, "\t\"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const result &r = results[i];
+		fprintf(out,
+			"\t\t{\"name\": \"%s\", \"bytes\": %zu, "
+			"\"iterations\": %zu, \"median_ns\": %.1f, "
+			"\"p99_ns\": %.1f, \"median_cycles\": %llu, "
+			"\"p99_cycles\": %llu, \"cycles_per_byte\": %.3f}%s\n",
+			r.name.c_str(), r.bytes, r.iterations, r.median_ns,
+			r.p99_ns, (unsigned long long)r.median_cycles,
+			(unsigned long long)r.p99_cycles,
+			(double)r.median_cycles / r.bytes,
+			(i + 1 < results.size()) ? "," : "");
+	}
+	fprintf(out, "\t]\n}\n");
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file debug_io.cc
+ * @brief Host implementation of debug_io.h on the standard streams
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <unistd.h>
+
+extern "C" {
+#include "debug_io.h"
+}
+
+int uart_debug_init()
+{
+	return 0;
+}
+
+int uart_debug_write_raw(const void *buf, size_t len)
+{
+	return write(STDOUT_FILENO, buf, len);
+}
+
+size_t uart_debug_available(void)
+{
+	return 0;
+}
+
+int uart_debug_set_baudrate(uint32_t baudrate)
+{
+	return 0;
+}
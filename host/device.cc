@@ -0,0 +1,435 @@
+/**
+ * @file device.cc
+ * @brief Virtual device: the firmware transfer loop behind a pseudo-terminal
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "classifier.h"
+#include "frontend.h"
+#include "pipeline.h"
+#include "uart_source.h"
+
+extern "C" {
+#include "serial.h"
+#include "trace.h"
+}
+
+// Same as kTensorArenaSize in src/main.cc
+static constexpr size_t arena_size = 66800;
+// Same as the MODEL region of the linker script
+static constexpr size_t model_capacity = 128 * 1024;
+
+alignas(16) static uint8_t tensor_arena[arena_size];
+static int16_t waveform[speech::frontend::num_samples];
+
+/**
+ * @brief Properties of the simulated serial line
+ */
+struct line {
+	unsigned baudrate; /**< 0 for no throttling */
+	double error_rate; /**< Probability of corrupting a byte to the device */
+	double drop_rate; /**< Probability of losing a byte to the device */
+	std::mt19937 rng;
+	std::atomic<unsigned long> errors{ 0 };
+	std::atomic<unsigned long> drops{ 0 };
+};
+
+/**
+ * @brief Hold back until len bytes would have gone over the line
+ */
+static void throttle(const struct line &line,
+		     std::chrono::steady_clock::time_point &next, size_t len)
+{
+	if (line.baudrate == 0) {
+		return;
+	}
+	// Start bit, 8 data bits and stop bit
+	auto duration = std::chrono::duration<double>(10.0 * len /
+						      line.baudrate);
+	next = std::max(next, std::chrono::steady_clock::now()) +
+	       std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+	std::this_thread::sleep_until(next);
+}
+
+static bool write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n <= 0) {
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+ * @brief Host to device: from the PTY master into the stdin of the firmware
+ *
+ * Reading the master fails while no one has the slave open, so it is
+ * polled until a tool connects.
+ */
+static void relay_rx(int master, int device, struct line *line)
+{
+	auto next = std::chrono::steady_clock::now();
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	std::uniform_int_distribution<int> flip(1, 255);
+	uint8_t buf[64];
+	while (1) {
+		ssize_t n = read(master, buf, sizeof(buf));
+		if (n <= 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			continue;
+		}
+		ssize_t kept = 0;
+		for (ssize_t i = 0; i < n; i++) {
+			if (chance(line->rng) < line->drop_rate) {
+				line->drops++;
+				continue;
+			}
+			buf[kept] = buf[i];
+			if (chance(line->rng) < line->error_rate) {
+				buf[kept] ^= flip(line->rng);
+				line->errors++;
+			}
+			kept++;
+		}
+		throttle(*line, next, n);
+		if (!write_all(device, buf, kept)) {
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Device to host: from the stdout of the firmware to the PTY master
+ */
+static void relay_tx(int device, int master, const struct line *line)
+{
+	auto next = std::chrono::steady_clock::now();
+	uint8_t buf[64];
+	while (1) {
+		ssize_t n = read(device, buf, sizeof(buf));
+		if (n <= 0) {
+			return;
+		}
+		throttle(*line, next, n);
+		// Dropped if no one listens, like the UART of the board
+		write_all(master, buf, n);
+	}
+}
+
+/**
+ * @brief Same record as struct clip_result in src/main.cc
+ */
+struct clip_result {
+	uint32_t index;
+	uint8_t status;
+	uint8_t label;
+	uint8_t num_scores;
+	uint8_t reserved;
+	uint32_t frontend_us;
+	uint32_t inference_us;
+	uint8_t scores[speech::classifier::num_labels];
+};
+
+typedef speech::argmax_decision<speech::classifier::num_labels> decision;
+
+/**
+ * @brief Same stages as in src/main.cc
+ */
+typedef speech::pipeline<speech::uart_source, speech::frontend_features,
+			 speech::classifier, decision>
+	clip_pipeline;
+
+static uint32_t us_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		       std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+static void run_clip(clip_pipeline &clips, struct clip_result *result)
+{
+	result->num_scores = speech::classifier::num_labels;
+
+	auto start = std::chrono::steady_clock::now();
+	clips.acquire();
+	clips.extract();
+	result->frontend_us = us_since(start);
+
+	start = std::chrono::steady_clock::now();
+	if (!clips.infer()) {
+		result->status = 1;
+		return;
+	}
+	result->inference_us = us_since(start);
+
+	clips.decide();
+	result->label = clips.result().label;
+	memcpy(result->scores, clips.result().scores, sizeof(result->scores));
+}
+
+static void batch_clip_done(void *ctx, uint32_t index, int len)
+{
+	clip_pipeline *clips = (clip_pipeline *)ctx;
+	struct clip_result result = {};
+	result.index = index;
+	if (len < 0) {
+		result.status = 1;
+	} else {
+		run_clip(*clips, &result);
+	}
+	serial_send_result(&result, sizeof(result));
+}
+
+static int model_begin(void *ctx, size_t filesize)
+{
+	auto *model = (std::vector<uint8_t> *)ctx;
+	model->assign(filesize, 0);
+	return 0;
+}
+
+static int model_block(void *ctx, const uint8_t *block, size_t offset,
+		       size_t len)
+{
+	auto *model = (std::vector<uint8_t> *)ctx;
+	// The last block is padded
+	len = std::min(len, model->size() - offset);
+	memcpy(model->data() + offset, block, len);
+	return 0;
+}
+
+/**
+ * @brief Receive a model and switch over to it, keep the current one if
+ * it is invalid
+ */
+static void receive_model(speech::classifier &classifier,
+			  std::vector<uint8_t> &model)
+{
+	std::vector<uint8_t> upload;
+	const struct serial_sink sink = { model_begin, model_block, &upload };
+	int len = serial_transfer(SERIAL_CMD_MODEL, model_capacity, &sink);
+	if ((len > 0) &&
+	    speech::classifier::validate(upload.data(), upload.size())) {
+		classifier.unload();
+		if (classifier.load(upload.data())) {
+			model.swap(upload);
+			printf("\e[0;32m[*] Model loaded (%zu bytes).\n\e[0m",
+			       model.size());
+			return;
+		}
+	}
+	printf("[!] Invalid model, keeping the current one.\n");
+	if (!classifier.loaded()) {
+		classifier.load(model.data());
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-b baudrate] [-e error_rate] [-d drop_rate] "
+		"[-s seed] [-l link] model.tflite\n"
+		"\n"
+		"Prints the pseudo-terminal to connect to, use it as "
+		"SERIAL_PORT for the tools.\n"
+		"-e corrupts that fraction of the bytes sent to the device.\n"
+		"-d loses that fraction of the bytes sent to the device.\n"
+		"-l also makes the pseudo-terminal available under link.\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct line line = {};
+	unsigned seed = 1;
+	const char *link_path = nullptr;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:e:d:s:l:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			line.baudrate = atoi(optarg);
+			break;
+		case 'e':
+			line.error_rate = atof(optarg);
+			break;
+		case 'd':
+			line.drop_rate = atof(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'l':
+			link_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	line.rng.seed(seed);
+
+	std::ifstream f(argv[optind], std::ios::binary);
+	std::vector<uint8_t> model((std::istreambuf_iterator<char>(f)),
+				   std::istreambuf_iterator<char>());
+	if (!speech::classifier::validate(model.data(), model.size())) {
+		fprintf(stderr, "%s is not a valid model\n", argv[optind]);
+		return 1;
+	}
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || (grantpt(master) != 0) ||
+	    (unlockpt(master) != 0)) {
+		perror("posix_openpt");
+		return 1;
+	}
+	// Binary protocol, no echo or line editing
+	struct termios tio;
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+	const char *slave = ptsname(master);
+	if (link_path != nullptr) {
+		unlink(link_path);
+		if (symlink(slave, link_path) != 0) {
+			perror(link_path);
+			return 1;
+		}
+	}
+	printf("%s\n", slave);
+	fflush(stdout);
+
+	// serial.c talks on stdin and stdout, as on the board. stdin is a
+	// second pseudo-terminal so that a read gives up after 500 ms without
+	// a byte, like _read() in src/debug_io.cc.
+	int rx = posix_openpt(O_RDWR | O_NOCTTY);
+	int tx[2];
+	if ((rx < 0) || (grantpt(rx) != 0) || (unlockpt(rx) != 0)) {
+		perror("posix_openpt");
+		return 1;
+	}
+	int rx_slave = open(ptsname(rx), O_RDWR | O_NOCTTY);
+	if ((rx_slave < 0) || (pipe(tx) != 0)) {
+		perror("pipe");
+		return 1;
+	}
+	tcgetattr(rx_slave, &tio);
+	cfmakeraw(&tio);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 5;
+	tcsetattr(rx_slave, TCSANOW, &tio);
+	dup2(rx_slave, STDIN_FILENO);
+	dup2(tx[1], STDOUT_FILENO);
+	setvbuf(stdout, NULL, _IONBF, 0);
+	std::thread(relay_rx, master, rx, &line).detach();
+	std::thread(relay_tx, tx[0], master, &line).detach();
+
+	static speech::frontend frontend;
+	speech::classifier classifier(tensor_arena, arena_size);
+	if (!classifier.load(model.data())) {
+		fprintf(stderr, "AllocateTensors() failed\n");
+		return 1;
+	}
+	speech::frontend_features features(frontend);
+	speech::uart_source uart(waveform);
+	decision outcome;
+	clip_pipeline clips(uart, features, classifier, outcome);
+
+	const char *const *labels = speech::classifier::labels;
+	while (1) {
+		enum serial_cmd cmd = serial_wait_cmd();
+		fprintf(stderr,
+			"[i] Command %d, %lu bytes corrupted and %lu lost so "
+			"far\n",
+			cmd, line.errors.load(), line.drops.load());
+		if (cmd == SERIAL_CMD_MODEL) {
+			receive_model(classifier, model);
+			continue;
+		}
+		if (cmd == SERIAL_CMD_TRACE) {
+			// Answers that there is no trace, see trace.h
+			trace_dump();
+			continue;
+		}
+		if ((cmd != SERIAL_CMD_TRANSFER) && (cmd != SERIAL_CMD_BATCH)) {
+			printf("[!] Not available on the virtual device.\n");
+			continue;
+		}
+
+		const struct serial_payload_sink *sink =
+			uart.sink(classifier.input()->data.uint8);
+		const size_t max_len = sizeof(waveform) + SERIAL_BLOCK_SIZE;
+
+		if (cmd == SERIAL_CMD_BATCH) {
+			const struct serial_batch_sink batch = {
+				sink, batch_clip_done, &clips
+			};
+			serial_batch(max_len, &batch);
+			continue;
+		}
+
+		int payload_len = serial_recv_payload(cmd, max_len, sink);
+		if (payload_len <= 0) {
+			printf("[!] Invalid payload.\n");
+			continue;
+		}
+
+		struct clip_result result = {};
+		run_clip(clips, &result);
+		if (uart.features() == nullptr) {
+			printf("[i] Front end: %u us\n", result.frontend_us);
+		}
+		printf("[i] Time: #%08u\n", result.inference_us / 1000);
+		for (uint32_t i = 0; i < result.num_scores; i++) {
+			printf("\e[0;32m[*] Prediction %s: %u\n\e[0m",
+			       labels[i], result.scores[i]);
+		}
+		printf("\e[0;32m[*] @%s\n\e[0m", labels[result.label]);
+	}
+}
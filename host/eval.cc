@@ -0,0 +1,304 @@
+/**
+ * @file eval.cc
+ * @brief Evaluate the firmware pipeline on a test set using all cores
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "classifier.h"
+#include "feature_store.h"
+#include "frontend.h"
+#include "pipeline.h"
+#include "testset.h"
+#include "wav_source.h"
+
+namespace fs = std::filesystem;
+
+// Same as kTensorArenaSize in src/main.cc, so a model that does not fit
+// the device fails here as well
+static constexpr size_t arena_size = 66800;
+
+struct alignas(16) arena {
+	uint8_t data[arena_size];
+};
+
+/**
+ * @brief A WAV file of the test set and the outcome of classifying it
+ */
+struct sample {
+	fs::path path;
+	size_t expected; /**< Index into speech::classifier::labels */
+	/** Record of a feature store, the WAV file is not read */
+	const uint8_t *features = nullptr;
+	int predicted = -1; /**< -1 if the file could not be read */
+	double inference_ms = 0;
+	std::string timestamp;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-j threads] [-o log.csv] model.tflite testset\n"
+		"\n"
+		"testset holds one directory per keyword, e.g. "
+		"ml/data/mini_speech_commands/test,\n"
+		"or is a feature store written by speech_featurize.\n",
+		name);
+}
+
+typedef speech::argmax_decision<speech::classifier::num_labels> decision;
+
+/**
+ * @brief Same stages as on the device, with files instead of the UART
+ */
+typedef speech::pipeline<speech::wav_source, speech::frontend_features,
+			 speech::classifier, decision>
+	eval_pipeline;
+
+/**
+ * @brief Classify one file the way run_clip() in src/main.cc does
+ */
+static void classify(eval_pipeline &clips, struct sample &s)
+{
+	if (s.features != nullptr) {
+		clips.input_source().open(s.features);
+	} else {
+		clips.input_source().open(s.path);
+	}
+	if (!clips.acquire()) {
+		return;
+	}
+	clips.extract();
+
+	auto start = std::chrono::steady_clock::now();
+	if (!clips.infer()) {
+		return;
+	}
+	std::chrono::duration<double, std::milli> elapsed =
+		std::chrono::steady_clock::now() - start;
+	s.inference_ms = elapsed.count();
+
+	clips.decide();
+	s.predicted = clips.result().label;
+
+	// Same format as datetime.isoformat()
+	auto now = std::chrono::system_clock::now();
+	time_t t = std::chrono::system_clock::to_time_t(now);
+	long us = std::chrono::duration_cast<std::chrono::microseconds>(
+			  now.time_since_epoch())
+			  .count() %
+		  1000000;
+	struct tm tm;
+	localtime_r(&t, &tm);
+	char buf[40];
+	size_t n = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buf + n, sizeof(buf) - n, ".%06ld", us);
+	s.timestamp = buf;
+}
+
+/**
+ * @brief Classify samples until there are none left, with an interpreter
+ * and arena of its own
+ */
+static void worker(const uint8_t *model, std::vector<sample> &samples,
+		   std::atomic<size_t> &next)
+{
+	auto mem = std::make_unique<arena>();
+	auto source = std::make_unique<speech::wav_source>();
+	speech::frontend frontend;
+	speech::frontend_features features(frontend);
+	speech::classifier classifier(mem->data, arena_size);
+	if (!classifier.load(model)) {
+		fprintf(stderr, "AllocateTensors() failed\n");
+		return;
+	}
+	decision outcome;
+	eval_pipeline clips(*source, features, classifier, outcome);
+
+	size_t i;
+	while ((i = next.fetch_add(1)) < samples.size()) {
+		classify(clips, samples[i]);
+	}
+}
+
+static void print_confusion(const std::vector<sample> &samples)
+{
+	const size_t n = speech::classifier::num_labels;
+	const char *const *labels = speech::classifier::labels;
+	std::vector<size_t> matrix(n * (n + 1), 0);
+	size_t correct = 0;
+	for (const sample &s : samples) {
+		// The last column counts unreadable files
+		size_t col = (s.predicted < 0) ? n : s.predicted;
+		matrix[s.expected * (n + 1) + col]++;
+		correct += (s.predicted == (int)s.expected) ? 1 : 0;
+	}
+
+	printf("%8s", "");
+	for (size_t col = 0; col < n; col++) {
+		printf(" %6s", labels[col]);
+	}
+	printf(" %6s\n", "?");
+	for (size_t row = 0; row < n; row++) {
+		printf("%8s", labels[row]);
+		for (size_t col = 0; col <= n; col++) {
+			printf(" %6zu", matrix[row * (n + 1) + col]);
+		}
+		printf("\n");
+	}
+	printf("Accuracy: %.2f %% (%zu of %zu)\n",
+	       samples.empty() ? 0.0 : 100.0 * correct / samples.size(),
+	       correct, samples.size());
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	const char *csv = "log.csv";
+	int opt;
+	while ((opt = getopt(argc, argv, "j:o:h")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = std::max(1, atoi(optarg));
+			break;
+		case 'o':
+			csv = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<uint8_t> model;
+	if (!speech::read_file(argv[optind], model) ||
+	    !speech::classifier::validate(model.data(), model.size())) {
+		fprintf(stderr, "%s is not a model the firmware can run\n",
+			argv[optind]);
+		return 1;
+	}
+
+	// A feature store saves decoding and the front end on every run
+	const char *testset = argv[optind + 1];
+	speech::feature_store store;
+	const bool from_store = fs::is_regular_file(testset);
+	std::vector<sample> samples;
+	if (from_store) {
+		if (!store.open(testset)) {
+			return 1;
+		}
+		for (size_t i = 0; i < store.size(); i++) {
+			sample s;
+			s.path = store.name(i);
+			s.expected = store.label(i);
+			s.features = store.record(i);
+			samples.push_back(s);
+		}
+	} else {
+		for (const auto &clip : speech::find_clips(testset)) {
+			sample s;
+			s.path = clip.path;
+			s.expected = clip.label;
+			samples.push_back(s);
+		}
+	}
+	if (samples.empty()) {
+		fprintf(stderr, "No WAV files in %s\n", testset);
+		return 1;
+	}
+
+	// Otherwise every worker would fail the same way on every sample
+	{
+		auto mem = std::make_unique<arena>();
+		speech::classifier classifier(mem->data, arena_size);
+		if (!classifier.load(model.data())) {
+			fprintf(stderr, "AllocateTensors() failed\n");
+			return 1;
+		}
+		const TfLiteTensor *input = classifier.input();
+		if (from_store && !store.matches(input->params.scale,
+						 input->params.zero_point)) {
+			return 1;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	threads = std::min<size_t>(threads, samples.size());
+	for (unsigned i = 0; i < threads; i++) {
+		workers.emplace_back(worker, model.data(), std::ref(samples),
+				     std::ref(next));
+	}
+	for (std::thread &t : workers) {
+		t.join();
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	FILE *f = fopen(csv, "w");
+	if (f == nullptr) {
+		perror(csv);
+		return 1;
+	}
+	for (const sample &s : samples) {
+		if (s.predicted < 0) {
+			fprintf(stderr, "Failed to classify %s\n",
+				s.path.c_str());
+			continue;
+		}
+		std::string keyword = s.path.parent_path().filename().string();
+		fprintf(f, "%s,%s,%.3f,%c,%s\n", s.timestamp.c_str(),
+			s.path.filename().c_str(),
+			s.inference_ms,
+			speech::classifier::labels[s.predicted][0],
+			keyword.c_str());
+	}
+	fclose(f);
+
+	print_confusion(samples);
+	printf("%zu files in %.2f s on %u threads\n", samples.size(),
+	       elapsed.count(), threads);
+	return 0;
+}
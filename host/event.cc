@@ -0,0 +1,69 @@
+/**
+ * @file event.cc
+ * @brief Host implementation of event.h
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "event.h"
+
+static std::mutex event_lock;
+static std::condition_variable event_cond;
+static uint32_t event_pending;
+
+void event_init(void)
+{
+}
+
+void event_signal(uint32_t events)
+{
+	{
+		std::lock_guard<std::mutex> lock(event_lock);
+		event_pending |= events;
+	}
+	event_cond.notify_all();
+}
+
+uint32_t event_wait(uint32_t mask, uint32_t timeout)
+{
+	std::unique_lock<std::mutex> lock(event_lock);
+	auto ready = [mask] { return (event_pending & mask) != 0; };
+	if (timeout == EVENT_WAIT_FOREVER) {
+		event_cond.wait(lock, ready);
+	} else if (!event_cond.wait_for(lock,
+					std::chrono::milliseconds(timeout),
+					ready)) {
+		return 0;
+	}
+	uint32_t events = event_pending & mask;
+	event_pending &= ~events;
+	return events;
+}
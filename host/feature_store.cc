@@ -0,0 +1,321 @@
+/**
+ * @file feature_store.cc
+ * @brief Precomputed features of a test set, memory-mapped
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "classifier.h"
+#include "feature_store.h"
+#include "frontend.h"
+
+static_assert(sizeof(struct feature_store_header) == 72,
+	      "Layout of the feature store header changed");
+
+// Bump when the front end computes different features for the same input
+#define FEATURE_STORE_FRONTEND_VERSION 1
+
+speech::feature_store::~feature_store()
+{
+	if (this->base != nullptr) {
+		munmap((void *)this->base, this->len);
+	}
+}
+
+uint32_t speech::feature_store::config_hash(enum feature_store_type type,
+					    float scale, int32_t zero_point)
+{
+	// Written out the same way by ml/feature_store.py
+	char config[256];
+	snprintf(config, sizeof(config),
+		 "frontend-%d window=%u step=%u frames=%u bins=%u samples=%zu "
+		 "type=%s scale=%.9g zero_point=%d",
+		 FEATURE_STORE_FRONTEND_VERSION, frontend::window_size,
+		 frontend::frame_step, frontend::num_frames,
+		 frontend::num_bins, frontend::num_samples,
+		 (type == FEATURE_STORE_INT8) ? "int8" : "uint8", scale,
+		 zero_point);
+
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (const char *c = config; *c != '\0'; c++) {
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	}
+	return hash;
+}
+
+bool speech::feature_store::open(const char *path)
+{
+	int fd = ::open(path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) != 0)) {
+		perror(path);
+		if (fd >= 0) {
+			::close(fd);
+		}
+		return false;
+	}
+	void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	// The mapping stays valid without the descriptor
+	::close(fd);
+	if ((p == MAP_FAILED) ||
+	    ((size_t)st.st_size < sizeof(struct feature_store_header))) {
+		fprintf(stderr, "%s: not a feature store\n", path);
+		if (p != MAP_FAILED) {
+			munmap(p, st.st_size);
+		}
+		return false;
+	}
+	this->base = (const uint8_t *)p;
+	this->len = st.st_size;
+
+	const struct feature_store_header &h = this->header();
+	const char *error = nullptr;
+	if ((memcmp(h.magic, FEATURE_STORE_MAGIC, 4) != 0) ||
+	    (h.version != FEATURE_STORE_VERSION)) {
+		error = "not a feature store of this version";
+	} else if ((h.record_size != frontend::features_size) ||
+		   (h.config_hash !=
+		    config_hash((enum feature_store_type)h.type, h.scale,
+				h.zero_point))) {
+		error = "computed by a different front end";
+	} else if ((h.index_offset + h.num_records *
+					     sizeof(struct feature_store_entry) >
+		    this->len) ||
+		   (h.data_offset + (uint64_t)h.num_records * h.record_size >
+		    this->len)) {
+		error = "truncated";
+	} else if (!this->check_labels() || !this->check_index()) {
+		error = "labels or index do not match this classifier";
+	}
+	if (error != nullptr) {
+		fprintf(stderr, "%s: %s\n", path, error);
+		munmap(p, this->len);
+		this->base = nullptr;
+		return false;
+	}
+	// Records are read in order
+	madvise(p, this->len, MADV_SEQUENTIAL);
+	return true;
+}
+
+bool speech::feature_store::matches(float scale, int32_t zero_point) const
+{
+	const struct feature_store_header &h = this->header();
+#ifdef INT8_IO
+	if ((h.type == FEATURE_STORE_INT8) && (h.scale == scale) &&
+	    (h.zero_point == zero_point)) {
+		return true;
+	}
+#else
+	(void)scale;
+	(void)zero_point;
+	if (h.type == FEATURE_STORE_UINT8) {
+		return true;
+	}
+#endif
+	fprintf(stderr, "The features do not match the model input, "
+			"run speech_featurize with -m model.tflite\n");
+	return false;
+}
+
+const struct feature_store_header &speech::feature_store::header() const
+{
+	return *(const struct feature_store_header *)this->base;
+}
+
+size_t speech::feature_store::size() const
+{
+	return (this->base != nullptr) ? this->header().num_records : 0;
+}
+
+const uint8_t *speech::feature_store::record(size_t i) const
+{
+	return this->base + this->header().data_offset +
+	       i * this->header().record_size;
+}
+
+static const struct feature_store_entry *entry(const uint8_t *base, size_t i)
+{
+	const struct feature_store_header *h =
+		(const struct feature_store_header *)base;
+	return (const struct feature_store_entry *)(base + h->index_offset) + i;
+}
+
+bool speech::feature_store::check_labels() const
+{
+	const struct feature_store_header &h = this->header();
+	if ((h.num_labels != classifier::num_labels) ||
+	    (h.labels_offset + h.num_labels * FEATURE_STORE_LABEL_LEN >
+	     this->len)) {
+		return false;
+	}
+	const char *names = (const char *)(this->base + h.labels_offset);
+	for (size_t i = 0; i < classifier::num_labels; i++) {
+		const char *name = names + i * FEATURE_STORE_LABEL_LEN;
+		// Written with strncpy(), so always terminated
+		if ((name[FEATURE_STORE_LABEL_LEN - 1] != '\0') ||
+		    (strcmp(name, classifier::labels[i]) != 0)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool speech::feature_store::check_index() const
+{
+	const struct feature_store_header &h = this->header();
+	// The names end with a NUL before the records start, either their
+	// own or the padding, so none runs into the records
+	if ((h.names_offset >= h.data_offset) ||
+	    (this->base[h.data_offset - 1] != '\0')) {
+		return false;
+	}
+	const uint64_t names_len = h.data_offset - h.names_offset;
+	for (size_t i = 0; i < h.num_records; i++) {
+		const struct feature_store_entry *e = entry(this->base, i);
+		if ((e->label >= classifier::num_labels) ||
+		    (e->name >= names_len)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t speech::feature_store::label(size_t i) const
+{
+	return entry(this->base, i)->label;
+}
+
+const char *speech::feature_store::name(size_t i) const
+{
+	return (const char *)(this->base + this->header().names_offset +
+			      entry(this->base, i)->name);
+}
+
+speech::feature_store_writer::~feature_store_writer()
+{
+	this->close();
+}
+
+static bool pwrite_all(int fd, const void *buf, size_t len, uint64_t offset)
+{
+	const uint8_t *p = (const uint8_t *)buf;
+	while (len > 0) {
+		ssize_t n = pwrite(fd, p, len, offset);
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+bool speech::feature_store_writer::create(
+	const char *path, enum feature_store_type type, float scale,
+	int32_t zero_point, const std::vector<std::string> &names,
+	const std::vector<size_t> &labels)
+{
+	struct feature_store_header h = {};
+	memcpy(h.magic, FEATURE_STORE_MAGIC, 4);
+	h.version = FEATURE_STORE_VERSION;
+	h.type = type;
+	h.num_labels = classifier::num_labels;
+	h.config_hash = feature_store::config_hash(type, scale, zero_point);
+	h.num_records = names.size();
+	h.record_size = frontend::features_size;
+	h.num_frames = frontend::num_frames;
+	h.num_bins = frontend::num_bins;
+	h.scale = scale;
+	h.zero_point = zero_point;
+
+	char label_names[classifier::num_labels][FEATURE_STORE_LABEL_LEN] = {};
+	for (size_t i = 0; i < classifier::num_labels; i++) {
+		strncpy(label_names[i], classifier::labels[i],
+			FEATURE_STORE_LABEL_LEN - 1);
+	}
+	std::vector<struct feature_store_entry> index(names.size());
+	std::string name_table;
+	for (size_t i = 0; i < names.size(); i++) {
+		index[i].label = labels[i];
+		index[i].name = name_table.size();
+		name_table += names[i];
+		name_table += '\0';
+	}
+
+	h.labels_offset = sizeof(h);
+	h.index_offset = h.labels_offset + sizeof(label_names);
+	h.names_offset =
+		h.index_offset + index.size() * sizeof(struct feature_store_entry);
+	h.data_offset = (h.names_offset + name_table.size() +
+			 FEATURE_STORE_ALIGN - 1) /
+			FEATURE_STORE_ALIGN * FEATURE_STORE_ALIGN;
+	this->data_offset = h.data_offset;
+
+	this->fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if ((this->fd < 0) ||
+	    (ftruncate(this->fd, h.data_offset + (uint64_t)h.num_records *
+							  h.record_size) !=
+	     0) ||
+	    !pwrite_all(this->fd, &h, sizeof(h), 0) ||
+	    !pwrite_all(this->fd, label_names, sizeof(label_names),
+			h.labels_offset) ||
+	    !pwrite_all(this->fd, index.data(),
+			index.size() * sizeof(struct feature_store_entry),
+			h.index_offset) ||
+	    !pwrite_all(this->fd, name_table.data(), name_table.size(),
+			h.names_offset)) {
+		perror(path);
+		return false;
+	}
+	return true;
+}
+
+bool speech::feature_store_writer::write(size_t i, const void *features)
+{
+	return pwrite_all(this->fd, features, frontend::features_size,
+			  this->data_offset + i * frontend::features_size);
+}
+
+bool speech::feature_store_writer::close()
+{
+	if (this->fd < 0) {
+		return true;
+	}
+	int ret = ::close(this->fd);
+	this->fd = -1;
+	return ret == 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file feature_store.h
+ * @brief Precomputed features of a test set, memory-mapped
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * A feature store holds the model inputs the firmware front end computes for
+ * every clip of a data set, so they are computed once and shared by all runs
+ * and processes. All fields are little endian:
+ *
+ *   feature_store_header
+ *   labels   num_labels names of FEATURE_STORE_LABEL_LEN bytes
+ *   index    num_records feature_store_entry
+ *   names    NUL-terminated file names of the clips
+ *   data     num_records records of record_size bytes, page aligned
+ *
+ * Readers check config_hash, see speech::feature_store::config_hash(), so a
+ * store written by another front end or for another input quantization is
+ * never used by mistake. ml/feature_store.py reads the same format.
+ */
+#define FEATURE_STORE_MAGIC "SPFS"
+#define FEATURE_STORE_VERSION 1
+#define FEATURE_STORE_LABEL_LEN 16
+#define FEATURE_STORE_ALIGN 4096
+
+enum feature_store_type {
+	FEATURE_STORE_UINT8 = 0, /**< frontend::quantize() for uint8 inputs */
+	FEATURE_STORE_INT8 = 1, /**< Quantized for an int8 input tensor */
+};
+
+struct feature_store_header {
+	char magic[4];
+	uint16_t version;
+	uint8_t type; /**< enum feature_store_type */
+	uint8_t num_labels;
+	uint32_t config_hash;
+	uint32_t num_records;
+	uint32_t record_size; /**< num_frames * num_bins */
+	uint16_t num_frames;
+	uint16_t num_bins;
+	float scale; /**< Magnitude = scale * (value - zero_point) */
+	int32_t zero_point;
+	uint32_t reserved[2];
+	uint64_t labels_offset;
+	uint64_t index_offset;
+	uint64_t names_offset;
+	uint64_t data_offset;
+};
+
+struct feature_store_entry {
+	uint32_t label; /**< Index into the labels */
+	uint32_t name; /**< Offset into the names */
+};
+
+namespace speech
+{
+/**
+ * @brief Read-only view of a feature store, the records are used in place
+ */
+class feature_store {
+    public:
+	feature_store() = default;
+	~feature_store();
+	feature_store(const feature_store &) = delete;
+	feature_store &operator=(const feature_store &) = delete;
+
+	/**
+	 * @brief Map a store and check it against the front end built in
+	 * @returns false with a message on stderr if it cannot be used
+	 */
+	bool open(const char *path);
+
+	/**
+	 * @brief Hash of everything that makes the records what they are:
+	 * front end parameters and quantization
+	 */
+	static uint32_t config_hash(enum feature_store_type type, float scale,
+				    int32_t zero_point);
+
+	/**
+	 * @brief Whether the records are what a model input of this
+	 * quantization expects, the type the firmware is built for included
+	 * @returns false with a message on stderr if not
+	 */
+	bool matches(float scale, int32_t zero_point) const;
+
+	const struct feature_store_header &header() const;
+	size_t size() const;
+	const uint8_t *record(size_t i) const;
+	size_t label(size_t i) const;
+	const char *name(size_t i) const;
+
+    private:
+	/**
+	 * @brief Same labels in the same order as speech::classifier
+	 */
+	bool check_labels() const;
+
+	/**
+	 * @brief Every entry has a label of the classifier and a name that
+	 * ends before the records
+	 */
+	bool check_index() const;
+
+	const uint8_t *base = nullptr;
+	size_t len = 0;
+};
+
+/**
+ * @brief Write a feature store, records may be added from several threads
+ */
+class feature_store_writer {
+    public:
+	~feature_store_writer();
+
+	/**
+	 * @brief Create the file with header, labels and index, the records
+	 * are filled in with write()
+	 * @param labels per clip, index into speech::classifier::labels
+	 */
+	bool create(const char *path, enum feature_store_type type, float scale,
+		    int32_t zero_point, const std::vector<std::string> &names,
+		    const std::vector<size_t> &labels);
+
+	/**
+	 * @param features record_size bytes
+	 */
+	bool write(size_t i, const void *features);
+
+	bool close();
+
+    private:
+	int fd = -1;
+	uint64_t data_offset = 0;
+};
+};
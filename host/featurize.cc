@@ -0,0 +1,192 @@
+/**
+ * @file featurize.cc
+ * @brief Compute the features of a test set once into a feature store
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <tensorflow/lite/schema/schema_generated.h>
+
+#include "feature_store.h"
+#include "frontend.h"
+#include "testset.h"
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [-j threads] [-m model.tflite] testset out.spfs\n"
+		"\n"
+		"Without a model, the features are uint8. With a model that "
+		"has an int8\ninput (train.py --int8-io), they are quantized "
+		"for that input.\n",
+		name);
+}
+
+/**
+ * @brief Quantization of the first input of a model, if it is int8
+ */
+static bool int8_input(const std::vector<uint8_t> &buf, float *scale,
+		       int32_t *zero_point)
+{
+	const tflite::Model *model = tflite::GetModel(buf.data());
+	const tflite::SubGraph *subgraph = model->subgraphs()->Get(0);
+	const tflite::Tensor *input =
+		subgraph->tensors()->Get(subgraph->inputs()->Get(0));
+	if ((input->type() != tflite::TensorType_INT8) ||
+	    (input->quantization() == nullptr) ||
+	    (input->quantization()->scale() == nullptr)) {
+		return false;
+	}
+	*scale = input->quantization()->scale()->Get(0);
+	*zero_point = input->quantization()->zero_point()->Get(0);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	const char *model_path = nullptr;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:m:h")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = std::max(1, atoi(optarg));
+			break;
+		case 'm':
+			model_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// frontend::quantize() for uint8 inputs
+	enum feature_store_type type = FEATURE_STORE_UINT8;
+	float scale = 1.0f / 8.0f;
+	int32_t zero_point = 0;
+	if (model_path != nullptr) {
+		std::vector<uint8_t> model;
+		if (!speech::read_file(model_path, model)) {
+			perror(model_path);
+			return 1;
+		}
+		if (int8_input(model, &scale, &zero_point)) {
+			type = FEATURE_STORE_INT8;
+		}
+	}
+
+	std::vector<speech::testset_clip> clips =
+		speech::find_clips(argv[optind]);
+	if (clips.empty()) {
+		fprintf(stderr, "No WAV files in %s\n", argv[optind]);
+		return 1;
+	}
+	std::vector<std::string> names;
+	std::vector<size_t> labels;
+	for (const auto &clip : clips) {
+		// Relative to the test set, e.g. yes/0a7c2a8d_nohash_0.wav
+		names.push_back(clip.path.parent_path().filename() /
+				clip.path.filename());
+		labels.push_back(clip.label);
+	}
+
+	const char *out = argv[optind + 1];
+	speech::feature_store_writer writer;
+	if (!writer.create(out, type, scale, zero_point, names, labels)) {
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	auto worker = [&]() {
+		using speech::frontend;
+		auto fe = std::make_unique<frontend>();
+		auto waveform = std::make_unique<int16_t[]>(frontend::num_samples);
+		auto features = std::make_unique<uint8_t[]>(frontend::features_size);
+		size_t i;
+		while ((i = next.fetch_add(1)) < clips.size()) {
+			size_t samples = speech::read_wav(clips[i].path,
+							  waveform.get(),
+							  frontend::num_samples);
+			if (samples == 0) {
+				fprintf(stderr, "Cannot read %s\n",
+					clips[i].path.c_str());
+				failed = true;
+				continue;
+			}
+			// Pad short clips with silence
+			std::fill(waveform.get() + samples,
+				  waveform.get() + frontend::num_samples, 0);
+			if (type == FEATURE_STORE_INT8) {
+				fe->compute(waveform.get(), samples,
+					    (int8_t *)features.get(), scale,
+					    zero_point);
+			} else {
+				fe->compute(waveform.get(), samples,
+					    features.get());
+			}
+			if (!writer.write(i, features.get())) {
+				failed = true;
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	threads = std::min<size_t>(threads, clips.size());
+	for (unsigned i = 0; i < threads; i++) {
+		workers.emplace_back(worker);
+	}
+	for (std::thread &t : workers) {
+		t.join();
+	}
+
+	if (!writer.close() || failed) {
+		fprintf(stderr, "Failed to write %s\n", out);
+		unlink(out);
+		return 1;
+	}
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - start;
+	printf("%zu clips (%s) in %.2f s\n", clips.size(),
+	       (type == FEATURE_STORE_INT8) ? "int8" : "uint8",
+	       elapsed.count());
+	return 0;
+}
@@ -0,0 +1,236 @@
+/**
+ * @file frontend_module.cc
+ * @brief Python binding of the firmware front end
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "frontend.h"
+
+using speech::frontend;
+
+/**
+ * @brief Spectrogram as float magnitudes, before the quantization to the
+ * model input, for training
+ */
+static void compute_clip(frontend &fe, const int16_t *waveform, size_t len,
+			 float *magnitudes)
+{
+	float min, max;
+	float frame[frontend::window_size];
+	frontend::minmax(waveform, len, &min, &max);
+	for (size_t idx = 0; idx < frontend::num_frames; idx++) {
+		fe.condition_frame(waveform + idx * frontend::frame_step, min,
+				   max, frame);
+		fe.magnitude(frame, magnitudes + idx * frontend::num_bins);
+	}
+}
+
+/**
+ * @brief Exactly the bytes the firmware feeds its uint8 model
+ */
+static void compute_clip(frontend &fe, const int16_t *waveform, size_t len,
+			 uint8_t *features)
+{
+	fe.compute(waveform, len, features);
+}
+
+/**
+ * @brief Spread the clips across threads, each with its own front end
+ * @param len samples per clip in the input, padded with silence to
+ * frontend::num_samples like the firmware does
+ */
+template <typename T>
+static void compute_batch(const int16_t *waveforms, size_t num_clips,
+			  size_t len, T *out, unsigned num_threads)
+{
+	std::atomic<size_t> next{ 0 };
+	auto worker = [&]() {
+		auto fe = std::make_unique<frontend>();
+		std::vector<int16_t> waveform(frontend::num_samples, 0);
+		size_t i;
+		while ((i = next++) < num_clips) {
+			std::copy_n(waveforms + i * len, len, waveform.begin());
+			compute_clip(*fe, waveform.data(), len,
+				     out + i * frontend::features_size);
+		}
+	};
+
+	num_threads = std::max(1u, std::min<unsigned>(num_threads, num_clips));
+	std::vector<std::thread> threads;
+	for (unsigned t = 1; t < num_threads; t++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto &t : threads) {
+		t.join();
+	}
+}
+
+static bool is_int16(const Py_buffer &view)
+{
+	if ((view.itemsize != 2) || (view.format == nullptr)) {
+		return false;
+	}
+	const char *format = view.format;
+	if ((*format == '<') || (*format == '=') || (*format == '@')) {
+		format++;
+	}
+	return strcmp(format, "h") == 0;
+}
+
+template <typename T>
+static PyObject *compute(PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = { "waveforms", "out", "threads",
+					  nullptr };
+	PyObject *waveforms_obj;
+	PyObject *out_obj = Py_None;
+	unsigned num_threads = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OI",
+					 const_cast<char **>(keywords),
+					 &waveforms_obj, &out_obj,
+					 &num_threads)) {
+		return nullptr;
+	}
+
+	Py_buffer in;
+	if (PyObject_GetBuffer(waveforms_obj, &in,
+			       PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+		return nullptr;
+	}
+	if (!is_int16(in) || (in.ndim < 1) || (in.ndim > 2) ||
+	    (in.shape[in.ndim - 1] == 0) ||
+	    ((size_t)in.shape[in.ndim - 1] > frontend::num_samples)) {
+		PyErr_Format(PyExc_ValueError,
+			     "waveforms must be int16 of shape "
+			     "(clips, samples) or (samples,), with at most "
+			     "%zu samples",
+			     frontend::num_samples);
+		PyBuffer_Release(&in);
+		return nullptr;
+	}
+	const size_t len = in.shape[in.ndim - 1];
+	const size_t num_clips = (in.ndim == 2) ? in.shape[0] : 1;
+	const size_t out_len = num_clips * frontend::features_size * sizeof(T);
+
+	if (out_obj == Py_None) {
+		out_obj = PyByteArray_FromStringAndSize(nullptr, out_len);
+	} else {
+		Py_INCREF(out_obj);
+	}
+	if (out_obj == nullptr) {
+		PyBuffer_Release(&in);
+		return nullptr;
+	}
+	Py_buffer out;
+	if (PyObject_GetBuffer(out_obj, &out,
+			       PyBUF_C_CONTIGUOUS | PyBUF_WRITABLE) != 0) {
+		PyBuffer_Release(&in);
+		Py_DECREF(out_obj);
+		return nullptr;
+	}
+	if ((size_t)out.len != out_len) {
+		PyErr_Format(PyExc_ValueError, "out must have %zu bytes",
+			     out_len);
+		PyBuffer_Release(&out);
+		PyBuffer_Release(&in);
+		Py_DECREF(out_obj);
+		return nullptr;
+	}
+
+	if (num_threads == 0) {
+		num_threads = std::thread::hardware_concurrency();
+	}
+	// The buffers stay valid while the views are held
+	Py_BEGIN_ALLOW_THREADS
+	compute_batch((const int16_t *)in.buf, num_clips, len, (T *)out.buf,
+		      num_threads);
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&out);
+	PyBuffer_Release(&in);
+	return out_obj;
+}
+
+static PyObject *spectrogram(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+	return compute<float>(args, kwargs);
+}
+
+static PyObject *features(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+	return compute<uint8_t>(args, kwargs);
+}
+
+static PyMethodDef methods[] = {
+	{ "spectrogram", (PyCFunction)(void (*)(void))spectrogram,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "spectrogram(waveforms, out=None, threads=0)\n\n"
+	  "Magnitudes of the firmware front end as float32, num_frames x "
+	  "num_bins\nper clip, before the quantization to the model input. "
+	  "waveforms is an\nint16 buffer of one clip or a batch of them, "
+	  "threads=0 uses all cores.\nReturns out, a new bytearray if not "
+	  "given." },
+	{ "features", (PyCFunction)(void (*)(void))features,
+	  METH_VARARGS | METH_KEYWORDS,
+	  "features(waveforms, out=None, threads=0)\n\n"
+	  "Like spectrogram(), but the uint8 bytes the firmware feeds the "
+	  "model." },
+	{ nullptr, nullptr, 0, nullptr },
+};
+
+static struct PyModuleDef module = {
+	PyModuleDef_HEAD_INIT,
+	"speech_frontend",
+	"Spectrogram front end of the firmware, see include/frontend.h",
+	-1,
+	methods,
+};
+
+PyMODINIT_FUNC PyInit_speech_frontend(void)
+{
+	PyObject *m = PyModule_Create(&module);
+	if (m == nullptr) {
+		return nullptr;
+	}
+	PyModule_AddIntConstant(m, "num_samples", frontend::num_samples);
+	PyModule_AddIntConstant(m, "num_frames", frontend::num_frames);
+	PyModule_AddIntConstant(m, "num_bins", frontend::num_bins);
+	PyModule_AddStringConstant(m, "backend", frontend::backend());
+	return m;
+}
@@ -0,0 +1,682 @@
+/**
+ * @file frontend_simd.cc
+ * @brief Front end kernels with AVX2, SSE2 or NEON for the host
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "frontend.h"
+
+// Replaces src/frontend_dsp.cc in host builds configured with -DSIMD_DSP=1.
+//
+// The real FFT of 256 samples is a complex FFT of 128 points, the even
+// samples as real and the odd ones as imaginary parts, followed by a split
+// step, as in CMSIS-DSP. The complex FFT is a radix-2 Stockham FFT on
+// separate arrays of real and imaginary parts. Every stage reads both
+// halves of its input contiguously and the results come out in natural
+// order, so all loads are full vectors. Only the first stages, whose
+// butterflies are closer together than a vector is wide, need to
+// interleave their results before storing them.
+//
+// The results match the CMSIS kernels to within float rounding. The order
+// of the additions differs, so an 8-bit feature can be off by one where a
+// magnitude lies right on a quantization step.
+
+namespace
+{
+using speech::frontend;
+
+constexpr uint32_t fft_len = frontend::window_size / 2;
+
+#if defined(__AVX2__)
+
+constexpr char backend_name[] = "avx2";
+constexpr uint32_t lanes = 8;
+typedef __m256 vf;
+
+inline vf load(const float *p)
+{
+	return _mm256_loadu_ps(p);
+}
+
+inline void store(float *p, vf v)
+{
+	_mm256_storeu_ps(p, v);
+}
+
+inline vf set1(float x)
+{
+	return _mm256_set1_ps(x);
+}
+
+inline vf add(vf a, vf b)
+{
+	return _mm256_add_ps(a, b);
+}
+
+inline vf sub(vf a, vf b)
+{
+	return _mm256_sub_ps(a, b);
+}
+
+inline vf mul(vf a, vf b)
+{
+	return _mm256_mul_ps(a, b);
+}
+
+inline vf vdiv(vf a, vf b)
+{
+	return _mm256_div_ps(a, b);
+}
+
+inline vf vsqrt(vf a)
+{
+	return _mm256_sqrt_ps(a);
+}
+
+inline vf load_int16(const int16_t *p)
+{
+	__m128i s = _mm_loadu_si128((const __m128i *)p);
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s));
+}
+
+/* Last element first */
+inline vf reverse(vf v)
+{
+	return _mm256_permutevar8x32_ps(v,
+					_mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+/* Split re, im, re, im, ... into two vectors */
+inline void load_complex(const float *p, vf &re, vf &im)
+{
+	vf lo = load(p);
+	vf hi = load(p + lanes);
+	// Within 128-bit lanes, leaves the pairs of the two 128-bit lanes
+	// swapped: 0 1 4 5 2 3 6 7
+	re = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+	im = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+	re = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(re),
+						    _MM_SHUFFLE(3, 1, 2, 0)));
+	im = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(im),
+						    _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+/* Store blocks of n values of a and b in turn, 2 * lanes values */
+template <uint32_t n> inline void interleave(float *p, vf a, vf b)
+{
+	vf lo, hi;
+	if constexpr (n == 1) {
+		lo = _mm256_unpacklo_ps(a, b);
+		hi = _mm256_unpackhi_ps(a, b);
+	} else if constexpr (n == 2) {
+		lo = _mm256_castpd_ps(_mm256_unpacklo_pd(_mm256_castps_pd(a),
+							 _mm256_castps_pd(b)));
+		hi = _mm256_castpd_ps(_mm256_unpackhi_pd(_mm256_castps_pd(a),
+							 _mm256_castps_pd(b)));
+	} else {
+		static_assert(n == 4, "blocks of 1, 2 or 4");
+		lo = a;
+		hi = b;
+	}
+	store(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+	store(p + lanes, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+inline void minmax_int16(const int16_t *p, size_t len, size_t *done,
+			 int16_t *lo, int16_t *hi)
+{
+	__m256i vmin = _mm256_set1_epi16(INT16_MAX);
+	__m256i vmax = _mm256_set1_epi16(INT16_MIN);
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		vmin = _mm256_min_epi16(vmin, v);
+		vmax = _mm256_max_epi16(vmax, v);
+	}
+	alignas(32) int16_t mins[16], maxs[16];
+	_mm256_store_si256((__m256i *)mins, vmin);
+	_mm256_store_si256((__m256i *)maxs, vmax);
+	for (uint32_t j = 0; j < 16; j++) {
+		*lo = (mins[j] < *lo) ? mins[j] : *lo;
+		*hi = (maxs[j] > *hi) ? maxs[j] : *hi;
+	}
+	*done = i;
+}
+
+#elif defined(__SSE2__)
+
+constexpr char backend_name[] = "sse2";
+constexpr uint32_t lanes = 4;
+typedef __m128 vf;
+
+inline vf load(const float *p)
+{
+	return _mm_loadu_ps(p);
+}
+
+inline void store(float *p, vf v)
+{
+	_mm_storeu_ps(p, v);
+}
+
+inline vf set1(float x)
+{
+	return _mm_set1_ps(x);
+}
+
+inline vf add(vf a, vf b)
+{
+	return _mm_add_ps(a, b);
+}
+
+inline vf sub(vf a, vf b)
+{
+	return _mm_sub_ps(a, b);
+}
+
+inline vf mul(vf a, vf b)
+{
+	return _mm_mul_ps(a, b);
+}
+
+inline vf vdiv(vf a, vf b)
+{
+	return _mm_div_ps(a, b);
+}
+
+inline vf vsqrt(vf a)
+{
+	return _mm_sqrt_ps(a);
+}
+
+inline vf load_int16(const int16_t *p)
+{
+	__m128i s = _mm_loadl_epi64((const __m128i *)p);
+	// Sign extend by shifting down from the upper half
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+}
+
+inline vf reverse(vf v)
+{
+	return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+inline void load_complex(const float *p, vf &re, vf &im)
+{
+	vf lo = load(p);
+	vf hi = load(p + lanes);
+	re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+	im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+template <uint32_t n> inline void interleave(float *p, vf a, vf b)
+{
+	if constexpr (n == 1) {
+		store(p, _mm_unpacklo_ps(a, b));
+		store(p + lanes, _mm_unpackhi_ps(a, b));
+	} else {
+		static_assert(n == 2, "blocks of 1 or 2");
+		store(p, _mm_movelh_ps(a, b));
+		store(p + lanes, _mm_movehl_ps(b, a));
+	}
+}
+
+inline void minmax_int16(const int16_t *p, size_t len, size_t *done,
+			 int16_t *lo, int16_t *hi)
+{
+	__m128i vmin = _mm_set1_epi16(INT16_MAX);
+	__m128i vmax = _mm_set1_epi16(INT16_MIN);
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		vmin = _mm_min_epi16(vmin, v);
+		vmax = _mm_max_epi16(vmax, v);
+	}
+	alignas(16) int16_t mins[8], maxs[8];
+	_mm_store_si128((__m128i *)mins, vmin);
+	_mm_store_si128((__m128i *)maxs, vmax);
+	for (uint32_t j = 0; j < 8; j++) {
+		*lo = (mins[j] < *lo) ? mins[j] : *lo;
+		*hi = (maxs[j] > *hi) ? maxs[j] : *hi;
+	}
+	*done = i;
+}
+
+#elif defined(__ARM_NEON)
+
+constexpr char backend_name[] = "neon";
+constexpr uint32_t lanes = 4;
+typedef float32x4_t vf;
+
+inline vf load(const float *p)
+{
+	return vld1q_f32(p);
+}
+
+inline void store(float *p, vf v)
+{
+	vst1q_f32(p, v);
+}
+
+inline vf set1(float x)
+{
+	return vdupq_n_f32(x);
+}
+
+inline vf add(vf a, vf b)
+{
+	return vaddq_f32(a, b);
+}
+
+inline vf sub(vf a, vf b)
+{
+	return vsubq_f32(a, b);
+}
+
+inline vf mul(vf a, vf b)
+{
+	return vmulq_f32(a, b);
+}
+
+#if defined(__aarch64__)
+inline vf vdiv(vf a, vf b)
+{
+	return vdivq_f32(a, b);
+}
+
+inline vf vsqrt(vf a)
+{
+	return vsqrtq_f32(a);
+}
+#else
+// 32-bit NEON has neither, fall back to the scalar instructions
+inline vf vdiv(vf a, vf b)
+{
+	float x[4], y[4];
+	vst1q_f32(x, a);
+	vst1q_f32(y, b);
+	for (uint32_t i = 0; i < 4; i++) {
+		x[i] /= y[i];
+	}
+	return vld1q_f32(x);
+}
+
+inline vf vsqrt(vf a)
+{
+	float x[4];
+	vst1q_f32(x, a);
+	for (uint32_t i = 0; i < 4; i++) {
+		x[i] = sqrtf(x[i]);
+	}
+	return vld1q_f32(x);
+}
+#endif
+
+inline vf load_int16(const int16_t *p)
+{
+	return vcvtq_f32_s32(vmovl_s16(vld1_s16(p)));
+}
+
+inline vf reverse(vf v)
+{
+	vf r = vrev64q_f32(v);
+	return vcombine_f32(vget_high_f32(r), vget_low_f32(r));
+}
+
+inline void load_complex(const float *p, vf &re, vf &im)
+{
+	float32x4x2_t v = vld2q_f32(p);
+	re = v.val[0];
+	im = v.val[1];
+}
+
+template <uint32_t n> inline void interleave(float *p, vf a, vf b)
+{
+	if constexpr (n == 1) {
+		float32x4x2_t v = { { a, b } };
+		vst2q_f32(p, v);
+	} else {
+		static_assert(n == 2, "blocks of 1 or 2");
+		store(p, vcombine_f32(vget_low_f32(a), vget_low_f32(b)));
+		store(p + lanes, vcombine_f32(vget_high_f32(a), vget_high_f32(b)));
+	}
+}
+
+inline void minmax_int16(const int16_t *p, size_t len, size_t *done,
+			 int16_t *lo, int16_t *hi)
+{
+	int16x8_t vmin = vdupq_n_s16(INT16_MAX);
+	int16x8_t vmax = vdupq_n_s16(INT16_MIN);
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		int16x8_t v = vld1q_s16(p + i);
+		vmin = vminq_s16(vmin, v);
+		vmax = vmaxq_s16(vmax, v);
+	}
+	int16_t mins[8], maxs[8];
+	vst1q_s16(mins, vmin);
+	vst1q_s16(maxs, vmax);
+	for (uint32_t j = 0; j < 8; j++) {
+		*lo = (mins[j] < *lo) ? mins[j] : *lo;
+		*hi = (maxs[j] > *hi) ? maxs[j] : *hi;
+	}
+	*done = i;
+}
+
+#else
+
+// No vector unit known, the same algorithm one value at a time
+constexpr char backend_name[] = "scalar";
+constexpr uint32_t lanes = 1;
+typedef float vf;
+
+inline vf load(const float *p)
+{
+	return *p;
+}
+
+inline void store(float *p, vf v)
+{
+	*p = v;
+}
+
+inline vf set1(float x)
+{
+	return x;
+}
+
+inline vf add(vf a, vf b)
+{
+	return a + b;
+}
+
+inline vf sub(vf a, vf b)
+{
+	return a - b;
+}
+
+inline vf mul(vf a, vf b)
+{
+	return a * b;
+}
+
+inline vf vdiv(vf a, vf b)
+{
+	return a / b;
+}
+
+inline vf vsqrt(vf a)
+{
+	return sqrtf(a);
+}
+
+inline vf load_int16(const int16_t *p)
+{
+	return (float)*p;
+}
+
+inline vf reverse(vf v)
+{
+	return v;
+}
+
+inline void load_complex(const float *p, vf &re, vf &im)
+{
+	re = p[0];
+	im = p[1];
+}
+
+template <uint32_t n> inline void interleave(float *p, vf a, vf b)
+{
+	static_assert(n == 0, "vectors of one value never interleave");
+}
+
+inline void minmax_int16(const int16_t *p, size_t len, size_t *done,
+			 int16_t *lo, int16_t *hi)
+{
+	*done = 0;
+}
+
+#endif
+
+static_assert(fft_len % (2 * lanes) == 0, "FFT shorter than a vector");
+
+/**
+ * @brief Sum of all lanes, in double like the reference
+ */
+inline double sum(vf v)
+{
+	float x[lanes];
+	store(x, v);
+	double s = 0;
+	for (uint32_t i = 0; i < lanes; i++) {
+		s += x[i];
+	}
+	return s;
+}
+
+/**
+ * @brief Twiddle factors, expanded so every butterfly finds its own
+ */
+struct tables {
+	// Stage with butterflies s apart: w[j] = exp(-2 pi i (j / s) s / N)
+	float stage_re[7][fft_len / 2];
+	float stage_im[7][fft_len / 2];
+	// Split step, halved: 0.5 cos(2 pi k / 2N) and 0.5 sin(2 pi k / 2N)
+	float split_cos[fft_len];
+	float split_sin[fft_len];
+
+	tables()
+	{
+		static_assert((1 << 7) == fft_len, "7 stages");
+		for (uint32_t t = 0; t < 7; t++) {
+			uint32_t s = 1 << t;
+			for (uint32_t j = 0; j < fft_len / 2; j++) {
+				double phi = -2.0 * M_PI * (double)((j / s) * s) /
+					     (double)fft_len;
+				stage_re[t][j] = (float)cos(phi);
+				stage_im[t][j] = (float)sin(phi);
+			}
+		}
+		for (uint32_t k = 0; k < fft_len; k++) {
+			double phi = 2.0 * M_PI * (double)k /
+				     (double)frontend::window_size;
+			split_cos[k] = (float)(0.5 * cos(phi));
+			split_sin[k] = (float)(0.5 * sin(phi));
+		}
+	}
+};
+
+const tables &get_tables()
+{
+	static const tables t;
+	return t;
+}
+
+/**
+ * @brief One radix-2 stage of the Stockham FFT
+ * @tparam t the butterflies of this stage are 1 << t apart
+ */
+template <uint32_t t>
+inline void fft_stage(const tables &tab, const float *xr, const float *xi,
+		      float *yr, float *yi)
+{
+	constexpr uint32_t s = 1 << t;
+	constexpr uint32_t half = fft_len / 2;
+	const float *wr = tab.stage_re[t];
+	const float *wi = tab.stage_im[t];
+	for (uint32_t j = 0; j < half; j += lanes) {
+		vf ar = load(xr + j), ai = load(xi + j);
+		vf br = load(xr + j + half), bi = load(xi + j + half);
+		vf sr = add(ar, br), si = add(ai, bi);
+		vf dr = sub(ar, br), di = sub(ai, bi);
+		vf cr = load(wr + j), ci = load(wi + j);
+		vf tr = sub(mul(dr, cr), mul(di, ci));
+		vf ti = add(mul(dr, ci), mul(di, cr));
+
+		// Sums go to j + s * (j / s), the differences s further
+		if constexpr (s >= lanes) {
+			uint32_t out = j + s * (j / s);
+			store(yr + out, sr);
+			store(yi + out, si);
+			store(yr + out + s, tr);
+			store(yi + out + s, ti);
+		} else {
+			interleave<s>(yr + 2 * j, sr, tr);
+			interleave<s>(yi + 2 * j, si, ti);
+		}
+	}
+}
+} // namespace
+
+const char *speech::frontend::backend()
+{
+	return backend_name;
+}
+
+void speech::frontend::minmax(const int16_t *waveform, size_t len, float *min,
+			      float *max)
+{
+	if (len == 0) {
+		*min = 999999.0f;
+		*max = -999999.0f;
+		return;
+	}
+	int16_t lo = INT16_MAX;
+	int16_t hi = INT16_MIN;
+	size_t i;
+	minmax_int16(waveform, len, &i, &lo, &hi);
+	for (; i < len; i++) {
+		lo = (waveform[i] < lo) ? waveform[i] : lo;
+		hi = (waveform[i] > hi) ? waveform[i] : hi;
+	}
+	*min = (float)lo;
+	*max = (float)hi;
+}
+
+void speech::frontend::condition_frame(const int16_t *samples, float min,
+				       float max, float *frame) const
+{
+	// Same operations as the reference, so every value rounds the same
+	const vf vmin = set1(min);
+	const vf range = set1(max - min);
+	const vf two = set1(2.0f);
+	const vf one = set1(1.0f);
+	vf acc = set1(0.0f);
+	for (uint32_t i = 0; i < window_size; i += lanes) {
+		vf x = sub(load_int16(samples + i), vmin);
+		x = sub(vdiv(mul(two, x), range), one);
+		acc = add(acc, x);
+		store(frame + i, x);
+	}
+
+	// The partial sums are in float, only their total in double
+	const vf mean = set1(this->remove_mean ?
+				     (float)(sum(acc) / (double)window_size) :
+				     0.0f);
+	for (uint32_t i = 0; i < window_size; i += lanes) {
+		vf x = sub(load(frame + i), mean);
+		store(frame + i, mul(x, load(this->hanning + i)));
+	}
+}
+
+void speech::frontend::magnitude(float *frame, float *mag)
+{
+	const tables &tab = get_tables();
+
+	// Ping-pong buffers, one extra slot to wrap around in the split step
+	float ar[fft_len + lanes], ai[fft_len + lanes];
+	float br[fft_len + lanes], bi[fft_len + lanes];
+
+	for (uint32_t i = 0; i < fft_len; i += lanes) {
+		vf re, im;
+		load_complex(frame + 2 * i, re, im);
+		store(ar + i, re);
+		store(ai + i, im);
+	}
+
+	fft_stage<0>(tab, ar, ai, br, bi);
+	fft_stage<1>(tab, br, bi, ar, ai);
+	fft_stage<2>(tab, ar, ai, br, bi);
+	fft_stage<3>(tab, br, bi, ar, ai);
+	fft_stage<4>(tab, ar, ai, br, bi);
+	fft_stage<5>(tab, br, bi, ar, ai);
+	fft_stage<6>(tab, ar, ai, br, bi);
+
+	// Z[N] = Z[0], so Z[N - k] can be read for k = 0 as well
+	br[fft_len] = br[0];
+	bi[fft_len] = bi[0];
+
+	// X[k] = (A + B) / 2 - i W^k (A - B) / 2 with A = Z[k],
+	// B = conj(Z[N - k]) and W = exp(-2 pi i / 2N). For k = 0 this is
+	// Re Z[0] + Im Z[0], the DC value.
+	for (uint32_t k = 0; k < fft_len; k += lanes) {
+		vf zr = load(br + k), zi = load(bi + k);
+		vf rr = reverse(load(br + fft_len - k - lanes + 1));
+		vf ri = reverse(load(bi + fft_len - k - lanes + 1));
+		vf er = add(zr, rr), ei = sub(zi, ri);
+		vf dr = sub(zr, rr), di = add(zi, ri);
+		vf c = load(tab.split_cos + k), s = load(tab.split_sin + k);
+		vf half = set1(0.5f);
+		vf xr = add(mul(half, er), sub(mul(c, di), mul(s, dr)));
+		vf xi = sub(mul(half, ei), add(mul(c, dr), mul(s, di)));
+		store(mag + k, vsqrt(add(mul(xr, xr), mul(xi, xi))));
+	}
+
+	// Nyquist: Re Z[0] - Im Z[0]
+	mag[num_bins - 1] = fabsf(br[0] - bi[0]);
+}
+
+void speech::frontend::unpack_magnitude(const float *spectrum, float *mag)
+{
+	// Packed as by arm_rfft_fast_f32(): the real DC and Nyquist values
+	// first, then the complex values in between
+	uint32_t k = 1;
+	for (; k + lanes <= num_bins - 1; k += lanes) {
+		vf re, im;
+		load_complex(spectrum + 2 * k, re, im);
+		store(mag + k, vsqrt(add(mul(re, re), mul(im, im))));
+	}
+	for (; k < num_bins - 1; k++) {
+		float re = spectrum[2 * k], im = spectrum[2 * k + 1];
+		mag[k] = sqrtf(re * re + im * im);
+	}
+	mag[0] = fabsf(spectrum[0]);
+	mag[num_bins - 1] = fabsf(spectrum[1]);
+}
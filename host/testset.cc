@@ -0,0 +1,137 @@
+/**
+ * @file testset.cc
+ * @brief Reading the WAV files of a test set
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <strings.h>
+
+#include "classifier.h"
+#include "testset.h"
+
+namespace fs = std::filesystem;
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/**
+ * @returns the label of a keyword directory or -1 if there is none
+ */
+static int label_of(const std::string &keyword)
+{
+	for (size_t i = 0; i < speech::classifier::num_labels; i++) {
+		if (strcasecmp(keyword.c_str(), speech::classifier::labels[i]) ==
+		    0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool speech::read_file(const fs::path &path, std::vector<uint8_t> &buf)
+{
+	std::ifstream f(path, std::ios::binary);
+	if (!f) {
+		return false;
+	}
+	buf.assign(std::istreambuf_iterator<char>(f),
+		   std::istreambuf_iterator<char>());
+	return true;
+}
+
+size_t speech::read_wav(const fs::path &path, int16_t *waveform, size_t len)
+{
+	std::vector<uint8_t> buf;
+	if (!read_file(path, buf) || (buf.size() < 12) ||
+	    (memcmp(buf.data(), "RIFF", 4) != 0) ||
+	    (memcmp(buf.data() + 8, "WAVE", 4) != 0)) {
+		return 0;
+	}
+
+	uint16_t channels = 0;
+	size_t pos = 12;
+	while (pos + 8 <= buf.size()) {
+		const uint8_t *chunk = buf.data() + pos;
+		size_t size = le32(chunk + 4);
+		size_t avail = std::min(size, buf.size() - pos - 8);
+		if ((memcmp(chunk, "fmt ", 4) == 0) && (avail >= 16)) {
+			// PCM, 16 bits
+			if ((le16(chunk + 8) != 1) || (le16(chunk + 22) != 16)) {
+				return 0;
+			}
+			channels = le16(chunk + 10);
+		} else if ((memcmp(chunk, "data", 4) == 0) && (channels > 0)) {
+			size_t frames = std::min(avail / (2 * channels), len);
+			for (size_t i = 0; i < frames; i++) {
+				int32_t sum = 0;
+				for (size_t c = 0; c < channels; c++) {
+					sum += (int16_t)le16(chunk + 8 +
+							     2 * (i * channels +
+								  c));
+				}
+				waveform[i] = (int16_t)(sum / channels);
+			}
+			return frames;
+		}
+		// Chunks are padded to an even size
+		pos += 8 + size + (size & 1);
+	}
+	return 0;
+}
+
+std::vector<speech::testset_clip> speech::find_clips(const fs::path &dir)
+{
+	std::vector<testset_clip> clips;
+	std::error_code err;
+	for (const auto &keyword : fs::directory_iterator(dir, err)) {
+		int label = label_of(keyword.path().filename().string());
+		if (!keyword.is_directory() || (label < 0)) {
+			continue;
+		}
+		for (const auto &file : fs::directory_iterator(keyword.path())) {
+			if (file.path().extension() == ".wav") {
+				clips.push_back({ file.path(), (size_t)label });
+			}
+		}
+	}
+	std::sort(clips.begin(), clips.end(),
+		  [](const testset_clip &a, const testset_clip &b) {
+			  return a.path < b.path;
+		  });
+	return clips;
+}
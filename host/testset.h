@@ -0,0 +1,67 @@
+/**
+ * @file testset.h
+ * @brief Reading the WAV files of a test set
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace speech
+{
+/**
+ * @brief A WAV file of a test set and the keyword it holds
+ */
+struct testset_clip {
+	std::filesystem::path path;
+	size_t label; /**< Index into speech::classifier::labels */
+};
+
+bool read_file(const std::filesystem::path &path, std::vector<uint8_t> &buf);
+
+/**
+ * @brief Read up to len samples of a 16-bit PCM WAV file, stereo is mixed
+ * down like tools/eval_testset.py does
+ * @returns number of samples read, 0 on error
+ */
+size_t read_wav(const std::filesystem::path &path, int16_t *waveform,
+		size_t len);
+
+/**
+ * @brief The WAV files in the keyword directories of a test set, e.g.
+ * ml/data/mini_speech_commands/test, sorted by path like
+ * tools/eval_testset.py does
+ *
+ * Directories that are not named after a label are skipped.
+ */
+std::vector<testset_clip> find_clips(const std::filesystem::path &dir);
+};
@@ -0,0 +1,103 @@
+/**
+ * @file wav_source.h
+ * @brief Pipeline source reading WAV files on the host
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include "frontend.h"
+#include "testset.h"
+
+namespace speech
+{
+/**
+ * @brief Clips from WAV files, or precomputed features, see speech::pipeline
+ */
+class wav_source {
+    public:
+	static constexpr size_t capacity = frontend::num_samples;
+
+	/**
+	 * @brief Read a WAV file on the next acquire()
+	 */
+	void open(const std::filesystem::path &path)
+	{
+		this->path = path;
+		this->record = nullptr;
+	}
+
+	/**
+	 * @brief Take features instead, e.g. a record of a feature_store
+	 */
+	void open(const uint8_t *features)
+	{
+		this->path.clear();
+		this->record = features;
+	}
+
+	/**
+	 * @returns false if the file cannot be read
+	 */
+	bool acquire()
+	{
+		if (this->record != nullptr) {
+			this->num_samples = 0;
+			return true;
+		}
+		this->num_samples =
+			read_wav(this->path, this->waveform, capacity);
+		return this->num_samples > 0;
+	}
+
+	int16_t *samples()
+	{
+		return this->waveform;
+	}
+
+	size_t length() const
+	{
+		return this->num_samples;
+	}
+
+	const uint8_t *features() const
+	{
+		return this->record;
+	}
+
+    private:
+	std::filesystem::path path;
+	const uint8_t *record = nullptr;
+	size_t num_samples = 0;
+	alignas(16) int16_t waveform[capacity];
+};
+};
@@ -0,0 +1,62 @@
+/**
+ * @file adpcm.h
+ * @brief IMA-ADPCM decoder for compressed audio transfers
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Decoder state, carried over from one chunk to the next
+ *
+ * A stream starts with the initial predictor (int16, little endian) and
+ * step index (uint8) followed by a reserved byte. Every following byte
+ * holds two samples, the lower nibble first.
+ */
+struct adpcm_state {
+	int32_t predictor;
+	int32_t index;
+};
+
+#define ADPCM_PREAMBLE_LEN 4
+
+/**
+ * @brief Set up the decoder from the preamble of a stream
+ */
+void adpcm_init(struct adpcm_state *state,
+		const uint8_t preamble[ADPCM_PREAMBLE_LEN]);
+
+/**
+ * @brief Decode a chunk of the stream
+ * @param out 2 * len samples
+ */
+void adpcm_decode(struct adpcm_state *state, const uint8_t *in, size_t len,
+		  int16_t *out);
@@ -0,0 +1,70 @@
+/**
+ * @file bench.h
+ * @brief Result record of the on-target benchmark firmware
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * bench.elf sends its results once after boot: BENCH_MAGIC, the length of
+ * the record as uint32_t, the record (a bench_header followed by
+ * num_entries bench_entry) and the CRC32 of the record. All fields are
+ * little endian, see tools/bench_board.py.
+ */
+#define BENCH_MAGIC "BENCH"
+
+#define BENCH_NAME_LEN 20
+
+/* The ART instruction cache, data cache and prefetch were enabled */
+#define BENCH_FLAG_CACHE (1 << 0)
+/* One operator of the model, timed by the op_profiler */
+#define BENCH_FLAG_OP (1 << 1)
+
+struct bench_header {
+	uint32_t core_clock; /**< SystemCoreClock while measuring, in Hz */
+	uint32_t flash_acr; /**< FLASH->ACR with caches enabled */
+	uint16_t num_entries;
+	uint16_t entry_size; /**< sizeof(struct bench_entry) */
+};
+
+/**
+ * @brief Cycles of one benchmark, each iteration timed on its own
+ */
+struct bench_entry {
+	char name[BENCH_NAME_LEN]; /**< Zero-padded, not terminated if full */
+	uint32_t bytes; /**< Processed per iteration, 0 if not meaningful */
+	uint16_t iterations;
+	uint8_t flags; /**< BENCH_FLAG_* */
+	uint8_t reserved;
+	uint32_t median_cycles;
+	uint32_t p99_cycles;
+};
@@ -0,0 +1,83 @@
+/**
+ * @file capture.h
+ * @brief Capture profiles turning DFSDM output into 16 kHz int16 audio
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief How the microphone signal is brought to 16 kHz
+ */
+enum capture_profile {
+	/** Sinc3, FOSR 50, IOSR 4: 3.2 MHz / 200, no further processing */
+	CAPTURE_PROFILE_FILTER_16K = 0,
+	/** Sinc2, FOSR 25, IOSR 4 at 32 kHz, then a FIR decimator */
+	CAPTURE_PROFILE_DECIMATE_16K,
+};
+
+#ifndef CAPTURE_PROFILE
+#define CAPTURE_PROFILE CAPTURE_PROFILE_FILTER_16K
+#endif
+
+/**
+ * @brief DFSDM filter settings and conditioning of a profile
+ */
+struct capture_config {
+	uint32_t sinc_order; /**< DFSDM_FILTER_SINCx_ORDER */
+	uint32_t oversampling;
+	uint32_t int_oversampling;
+	uint32_t decimation; /**< Software decimation after the DFSDM */
+	uint32_t sample_rate; /**< Output rate in Hz */
+	uint8_t input_shift; /**< Left shift of the 24 bit result to Q31 */
+	int8_t gain_shift; /**< Digital gain applied before the conversion */
+};
+
+/**
+ * @brief Select a profile and reset the filter states
+ * @return the settings to configure the DFSDM with
+ */
+const struct capture_config *capture_init(enum capture_profile profile);
+
+/**
+ * @brief Output sample rate of the selected profile
+ */
+uint32_t capture_sample_rate(void);
+
+/**
+ * @brief Condition raw DFSDM results
+ *
+ * Decimates if the profile asks for it, removes the DC offset with a
+ * first-order high-pass biquad and scales the result to int16.
+ * @param out room for len / decimation samples
+ * @return number of samples written to out
+ */
+size_t capture_process(const int32_t *in, size_t len, int16_t *out);
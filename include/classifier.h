@@ -0,0 +1,128 @@
+/**
+ * @file classifier.h
+ * @brief Keyword classifier running a TFLite model
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tensorflow/lite/micro/micro_interpreter.h>
+#include <tensorflow/lite/micro/micro_mutable_op_resolver.h>
+#include <tensorflow/lite/micro/micro_profiler_interface.h>
+#include <tensorflow/lite/schema/schema_generated.h>
+
+namespace speech
+{
+/**
+ * @brief Elements of a tensor in a model flatbuffer, a dynamic batch
+ * dimension counts as one
+ */
+size_t num_elements(const tflite::Tensor *tensor);
+
+/**
+ * @brief Check the identifier, structure and schema version of a model
+ * flatbuffer, the part of validate() all models share
+ *
+ * Also checks that the fields the interpreter relies on are present and
+ * that every tensor, buffer and operator code index is in range, so the
+ * inputs and outputs of the subgraph can be looked up without checks.
+ * @returns the subgraph to run, NULL if the buffer is not a usable model
+ */
+const tflite::SubGraph *model_subgraph(const uint8_t *buf, size_t len);
+
+class classifier {
+    public:
+	static constexpr size_t input_frames = 124;
+	static constexpr size_t input_bins = 129;
+	static constexpr size_t num_labels = 6;
+	static const char *const labels[num_labels];
+
+	/**
+	 * @param arena tensor arena shared by all models loaded
+	 * @param profiler attached to every interpreter created, may be NULL
+	 */
+	classifier(uint8_t *arena, size_t arena_size,
+		   tflite::MicroProfilerInterface *profiler = nullptr);
+	~classifier();
+
+	/**
+	 * @brief Check whether a buffer holds a model this classifier can run
+	 */
+	static bool validate(const uint8_t *buf, size_t len);
+
+	/**
+	 * @brief Rebuild the interpreter in place for another model
+	 *
+	 * The previous interpreter is destroyed first, so its tensors are
+	 * invalid afterwards even if loading fails.
+	 *
+	 * @param buf model flatbuffer, must outlive the classifier
+	 * @returns true if the tensors could be allocated
+	 */
+	bool load(const uint8_t *buf);
+
+	/**
+	 * @brief Destroy the interpreter so another one can use the arena
+	 */
+	void unload();
+
+	bool loaded() const;
+	const tflite::Model *model() const;
+
+	/**
+	 * @brief Bytes of the arena taken by the current model, 0 if none
+	 */
+	size_t arena_used() const;
+	size_t arena_capacity() const;
+
+	tflite::MicroInterpreter &interpreter();
+
+	TfLiteTensor *input();
+	TfLiteTensor *output();
+	bool invoke();
+
+	/**
+	 * @brief Score of a label as 8-bit unsigned value, whether the model
+	 * has uint8 or int8 I/O
+	 */
+	uint8_t score(size_t label);
+
+    private:
+	uint8_t *arena;
+	size_t arena_size;
+	tflite::MicroProfilerInterface *profiler;
+	tflite::MicroMutableOpResolver<8> resolver;
+	const tflite::Model *current = nullptr;
+	tflite::MicroInterpreter *interp = nullptr;
+	alignas(tflite::MicroInterpreter) uint8_t
+		storage[sizeof(tflite::MicroInterpreter)];
+};
+};
@@ -29,7 +29,34 @@
  *
  */
 
+#pragma once
+
+/**
+ * @brief Core clock and voltage range, switched at runtime
+ *
+ * The debug UART (USART1, from HSI16) and the microphone's bit clock (the
+ * DFSDM output clock, from PLLSAI1) do not depend on SYSCLK. The DFSDM
+ * kernel clock is PCLK2, though, and has to stay at 4 x 3.2 MHz or more:
+ * every profile runs at 16 MHz or above and a switch parks SYSCLK on HSI16.
+ */
+enum clock_profile {
+	/** 16 MHz, voltage range 2: waiting for the host and capturing */
+	CLOCK_PROFILE_LOW = 0,
+	/** 80 MHz, voltage range 1: feature extraction and inference */
+	CLOCK_PROFILE_BOOST,
+};
+
 /**
- * @brief Initialize system clocks
+ * @brief Initialize system clocks, starting in CLOCK_PROFILE_BOOST
  */
 void SystemClock_Config(void);
+
+/**
+ * @brief Switch SYSCLK, flash latency and voltage range
+ *
+ * Takes the time the PLL needs to lock, nothing if the profile is already
+ * active. SystemCoreClock and SysTick follow.
+ */
+void clock_set_profile(enum clock_profile profile);
+
+enum clock_profile clock_get_profile(void);
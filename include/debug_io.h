@@ -28,8 +28,31 @@
  *
  */
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* Receive FIFO, power of two */
+#define UART_RX_FIFO_SIZE 2048
+
 /**
  * @brief Initialize UART and attach to printf
  * @return 0 on success
  */
 int uart_debug_init();
+
+/**
+ * @brief Send binary data without newline translation
+ * @return number of bytes sent or -1 on error
+ */
+int uart_debug_write_raw(const void *buf, size_t len);
+
+/**
+ * @brief Number of received bytes waiting to be read, without blocking
+ */
+size_t uart_debug_available(void);
+
+/**
+ * @brief Change the baud rate once pending output was sent
+ * @return 0 on success
+ */
+int uart_debug_set_baudrate(uint32_t baudrate);
@@ -29,12 +29,33 @@
  *
  */
 
+#include <stddef.h>
+#include <stdint.h>
+
+struct capture_config;
+
 extern DFSDM_Filter_HandleTypeDef hdfsdm1_filter0;
 extern DFSDM_Channel_HandleTypeDef hdfsdm1_channel2;
 
-extern int dfsdm_conversion_done;
-
 /**
  * \brief Initialize the DFSDM for use with the PDM microphone
+ * \param config filter settings of the capture profile, see capture.h
+ */
+void dfsdm_init(const struct capture_config *config);
+
+/**
+ * @brief Stop conversions and release the DFSDM
+ */
+void dfsdm_deinit(void);
+
+/**
+ * @brief Called from the DMA interrupt with the half of the buffer that was
+ * just filled
+ */
+typedef void (*dfsdm_callback_t)(const int32_t *samples, size_t len);
+
+/**
+ * @brief Register the buffer the DMA writes to and its consumer
+ * @param callback may be NULL
  */
-void dfsdm_init();
+void dfsdm_set_callback(int32_t *buf, size_t len, dfsdm_callback_t callback);
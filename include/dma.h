@@ -30,8 +30,15 @@
  */
 
 extern DMA_HandleTypeDef hdma_dfsdm1_flt0;
+extern DMA_HandleTypeDef hdma_usart1_tx;
 
 /**
  * @brief Initialize DMA for use with DFSDM
  */
 void dma_init(void);
+
+/**
+ * @brief Initialize DMA for transmitting with USART1
+ * @return 0 on success
+ */
+int dma_uart_tx_init(UART_HandleTypeDef *uart_hd);
@@ -0,0 +1,77 @@
+/**
+ * @file event.h
+ * @brief Sleep until an interrupt has something for the main loop
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Things the main loop may wait for, one bit each
+ */
+enum event {
+	EVENT_UART_RX = 1 << 0, /**< A byte arrived on the debug UART */
+	EVENT_UART_TX = 1 << 1, /**< A stream frame has been sent by the DMA */
+	EVENT_MIC = 1 << 2, /**< Half of the microphone buffer is filled */
+	EVENT_TASK = 1 << 3, /**< All tasks are done, see scheduler.h */
+};
+
+#define EVENT_WAIT_FOREVER UINT32_MAX
+
+/**
+ * @brief Set up sleeping, call once before event_wait()
+ */
+void event_init(void);
+
+/**
+ * @brief Mark events as pending, safe to call from interrupts
+ */
+void event_signal(uint32_t events);
+
+/**
+ * @brief Sleep until one of the events in mask is pending or the timeout
+ * expires
+ *
+ * The events returned are no longer pending. An event signalled before the
+ * call counts, so check the condition the event stands for first and wait
+ * only if it does not hold. Must not be called from interrupts.
+ *
+ * @param timeout milliseconds, or EVENT_WAIT_FOREVER
+ * @return the events that ended the wait, 0 on timeout
+ */
+uint32_t event_wait(uint32_t mask, uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,143 @@
+/**
+ * @file frontend.h
+ * @brief Spectrogram front end feeding the classifier
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <dsp/transform_functions.h>
+
+namespace speech
+{
+/**
+ * @brief Short-time Fourier transform of a one second clip
+ *
+ * Produces the 124 x 129 spectrogram the model was trained on from 16-bit
+ * samples. Every frame of 256 samples is normalized to [-1, 1] using the
+ * minimum and maximum of the whole clip, freed of its DC component,
+ * multiplied by a Hanning window and transformed. The magnitudes are scaled and stored as 8-bit values.
+ */
+class frontend {
+    public:
+	static constexpr uint32_t window_size = 256;
+	static constexpr uint32_t frame_step = 128;
+	static constexpr uint32_t num_frames = 124;
+	static constexpr uint32_t num_bins = window_size / 2 + 1;
+	static constexpr size_t num_samples =
+		(num_frames - 1) * frame_step + window_size;
+	static constexpr size_t features_size = num_frames * num_bins;
+
+	/**
+	 * @param remove_mean subtract the mean of every frame, not needed if
+	 * the samples went through a DC blocker such as capture_process()
+	 */
+	explicit frontend(bool remove_mean = true);
+
+	/**
+	 * @brief Compute the spectrogram of a clip
+	 * @param waveform num_samples samples
+	 * @param len number of samples used to find the value range
+	 * @param features output, features_size bytes
+	 */
+	void compute(const int16_t *waveform, size_t len, uint8_t *features);
+
+	/**
+	 * @brief Compute the spectrogram straight into an int8 input tensor
+	 * @param scale quantization of the tensor, e.g. from
+	 * TfLiteTensor::params
+	 */
+	void compute(const int16_t *waveform, size_t len, int8_t *features,
+		     float scale, int32_t zero_point);
+
+	/**
+	 * @brief Compute a single spectrogram column for continuous listening
+	 *
+	 * There is no clip to take the value range from, so the full 16-bit
+	 * range is mapped to [-1, 1], as when the training set is decoded.
+	 * @param samples window_size samples
+	 * @param column output, num_bins bytes
+	 */
+	void compute_frame(const int16_t *samples, uint8_t *column);
+
+	/**
+	 * @brief Find the value range of a clip
+	 */
+	static void minmax(const int16_t *waveform, size_t len, float *min,
+			   float *max);
+
+	/**
+	 * @brief Normalize, remove the mean if enabled and apply the window
+	 * @param samples window_size samples
+	 * @param frame output, window_size values
+	 */
+	void condition_frame(const int16_t *samples, float min, float max,
+			     float *frame) const;
+
+	/**
+	 * @brief Magnitude spectrum of a conditioned frame
+	 * @param frame window_size values, used as scratch memory
+	 * @param mag output, num_bins values
+	 */
+	void magnitude(float *frame, float *mag);
+
+	/**
+	 * @brief Turn the packed output of the real FFT, window_size values,
+	 * into num_bins magnitudes
+	 */
+	static void unpack_magnitude(const float *spectrum, float *mag);
+
+	/**
+	 * @brief Scale magnitudes to the 8-bit model input
+	 */
+	static void quantize(const float *mag, uint8_t *features);
+
+	/**
+	 * @brief Quantize magnitudes with the parameters of an int8 tensor
+	 */
+	static void quantize(const float *mag, int8_t *features, float scale,
+			     int32_t zero_point);
+
+	/**
+	 * @brief Name of the kernels behind minmax(), condition_frame() and
+	 * magnitude(): "cmsis" on the device, see frontend_dsp.cc
+	 */
+	static const char *backend();
+
+    private:
+	bool remove_mean;
+	arm_rfft_fast_instance_f32 fft;
+	float hanning[window_size];
+	float frame[window_size];
+	float spectrum[window_size];
+	float mag[num_bins];
+};
+};
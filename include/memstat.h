@@ -0,0 +1,74 @@
+/**
+ * @file memstat.h
+ * @brief Stack, heap and arena high-water marks
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fill pattern of the unused stack */
+#define MEMSTAT_STACK_PAINT 0xa5a5a5a5
+
+/**
+ * @brief Memory high-water marks, all in bytes and little endian
+ *
+ * Sent as a result record of SERIAL_CMD_MEMORY and as the payload of
+ * STREAM_TYPE_TELEMETRY.
+ */
+struct memstat {
+	uint32_t stack_size; /**< _Min_Stack_Size of the linker script */
+	uint32_t stack_used; /**< Deepest the stack has been since reset */
+	uint32_t heap_used; /**< Handed out by _sbrk() */
+	uint32_t arena_size;
+	uint32_t arena_used; /**< Tensor arena of the current model */
+	uint32_t pool_size;
+	uint32_t pool_used; /**< Sum of the pool region high-water marks */
+};
+
+/**
+ * @brief Stack used so far, found by scanning for the paint
+ *
+ * The stack is painted before main() runs. If the whole reserved stack was
+ * overwritten, it may have grown further than that.
+ */
+size_t memstat_stack_used(void);
+
+/**
+ * @brief Bytes given to the newlib heap, implemented in sysmem.c
+ */
+size_t memstat_heap_used(void);
+
+/**
+ * @brief Collect stack, heap and pool figures
+ *
+ * The arena is not known here, the owner of the tensor arena fills it in.
+ */
+void memstat_collect(struct memstat *stat);
@@ -29,14 +29,54 @@
  *
  */
 
+extern "C" {
+#include "pool.h"
+}
+
 namespace speech
 {
 class mic {
 	int32_t *buf;
-	size_t buf_size = 8000;
+	size_t buf_size = POOL_MIC_SIZE / sizeof(int32_t);
 
     public:
-	void init();
+	/**
+	 * @brief Half of the buffer, filled by the DMA
+	 */
+	struct block {
+		const int32_t *samples;
+		size_t len;
+	};
+
+	/**
+	 * @brief Start continuous conversions into a buffer of buf_size samples
+	 *
+	 * The buffer is POOL_REGION_MIC, which bounds buf_size.
+	 * @param callback receives each half of the buffer once it is filled,
+	 * see dfsdm_callback_t. Without one, the halves are queued for read().
+	 * @returns false if buf_size exceeds the region or the DMA could not
+	 * be started, nothing is converted then
+	 */
+	bool init(void (*callback)(const int32_t *samples, size_t len) = nullptr,
+		  size_t buf_size = POOL_MIC_SIZE / sizeof(int32_t));
+
+	/**
+	 * @brief Stop conversions
+	 */
+	void stop();
+
+	/**
+	 * @brief Take the oldest filled half of the buffer
+	 *
+	 * It stays valid until the DMA comes around again, i.e. for the time
+	 * it takes to fill the other half.
+	 * @return false if none is ready
+	 */
+	bool read(block &b);
+
+	/**
+	 * @brief Print one buffer worth of samples
+	 */
 	void dump_recording();
 };
 };
@@ -0,0 +1,85 @@
+/**
+ * @file mic_source.h
+ * @brief Pipeline source recording from the PDM microphone
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frontend.h"
+#include "mic.h"
+
+namespace speech
+{
+/**
+ * @brief One second recorded through the DFSDM and its DMA, see
+ * speech::pipeline
+ *
+ * The samples go through capture_process() like while listening, so the
+ * front end can be constructed without mean removal.
+ */
+class mic_source {
+    public:
+	static constexpr size_t capacity = frontend::num_samples;
+
+	mic_source(mic &microphone, int16_t (&waveform)[capacity]);
+
+	/**
+	 * @brief Record until the buffer is full or the host sends a byte
+	 *
+	 * Stops at the last whole DMA block that fits, the pipeline pads
+	 * the rest.
+	 * @returns false if interrupted before anything was recorded or if the
+	 * microphone could not be started
+	 */
+	bool acquire();
+
+	int16_t *samples()
+	{
+		return this->waveform;
+	}
+
+	size_t length() const
+	{
+		return this->num_samples;
+	}
+
+	const uint8_t *features() const
+	{
+		return nullptr;
+	}
+
+    private:
+	mic &microphone;
+	int16_t *waveform;
+	size_t num_samples = 0;
+};
+};
@@ -0,0 +1,77 @@
+/**
+ * @file model_store.h
+ * @brief Flash slot for models uploaded at runtime
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Erase the slot, invalidating the stored model
+ * @return 0 on success
+ */
+int model_store_erase(void);
+
+/**
+ * @brief Program part of a model into the erased slot
+ * @param offset position within the model, multiple of 8
+ * @param len number of bytes, multiple of 8
+ * @return 0 on success
+ */
+int model_store_write(size_t offset, const uint8_t *data, size_t len);
+
+/**
+ * @brief Mark the model written to the slot as valid
+ *
+ * This writes the header that model_store_get() looks for, so it must only
+ * be called once the whole model has been written and validated.
+ *
+ * @param len size of the model in bytes
+ * @return 0 on success
+ */
+int model_store_commit(size_t len);
+
+/**
+ * @brief Start of the model data within the slot
+ */
+const uint8_t *model_store_data(void);
+
+/**
+ * @brief Largest model the slot can hold in bytes
+ */
+size_t model_store_capacity(void);
+
+/**
+ * @brief Look up a committed model
+ * @param[out] len size of the model in bytes
+ * @return the model or NULL if the slot does not contain a valid model
+ */
+const uint8_t *model_store_get(size_t *len);
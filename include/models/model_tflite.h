@@ -1 +1,9 @@
 extern const unsigned char model_tflite[];
+
+/* Only linked when ml/train.py --streaming exported a step model */
+extern const unsigned char model_step_tflite[] __attribute__((weak));
+extern unsigned int model_step_tflite_len __attribute__((weak));
+
+/* Only linked when ml/train.py --wake exported a wake detector */
+extern const unsigned char model_wake_tflite[] __attribute__((weak));
+extern unsigned int model_wake_tflite_len __attribute__((weak));
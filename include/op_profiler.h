@@ -0,0 +1,72 @@
+/**
+ * @file op_profiler.h
+ * @brief Per-operator cycle profiler for the TFLM interpreter
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tensorflow/lite/micro/micro_profiler_interface.h>
+
+namespace speech
+{
+/**
+ * @brief Records the ticks spent in each operator of one Invoke()
+ *
+ * The interpreter opens one event per operator in execution order, so after
+ * an Invoke() of a model without control flow, event i belongs to operator i
+ * of the primary subgraph. Call clear() before each Invoke().
+ */
+class op_profiler : public tflite::MicroProfilerInterface {
+    public:
+	static constexpr size_t max_events = 32;
+
+	uint32_t BeginEvent(const char *tag) override;
+	void EndEvent(uint32_t event_handle) override;
+
+	void clear();
+	size_t events() const;
+	const char *tag(size_t event) const;
+	uint32_t ticks(size_t event) const;
+	uint32_t total_ticks() const;
+
+	/**
+	 * @brief Print one line per event with its tag and ticks
+	 */
+	void log() const;
+
+    private:
+	const char *tags[max_events];
+	uint32_t start[max_events];
+	uint32_t end[max_events];
+	size_t num_events = 0;
+};
+};
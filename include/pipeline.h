@@ -0,0 +1,210 @@
+/**
+ * @file pipeline.h
+ * @brief Clip classification composed of stages at compile time
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <tensorflow/lite/core/c/common.h>
+
+#include "frontend.h"
+
+namespace speech
+{
+/**
+ * @brief Features stage computing the spectrogram with a speech::frontend
+ *
+ * Quantizes straight into the input tensor with INT8_IO, otherwise
+ * writes the 8-bit features.
+ */
+class frontend_features {
+    public:
+	static constexpr size_t num_samples = frontend::num_samples;
+	static constexpr size_t features_size = frontend::features_size;
+
+	explicit frontend_features(frontend &fe) : fe(fe)
+	{
+	}
+
+	/**
+	 * @param waveform num_samples samples, padded after len
+	 * @param len samples the value range is taken from
+	 */
+	void compute(const int16_t *waveform, size_t len, TfLiteTensor *input)
+	{
+#ifdef INT8_IO
+		this->fe.compute(waveform, len, input->data.int8,
+				 input->params.scale, input->params.zero_point);
+#else
+		this->fe.compute(waveform, len, input->data.uint8);
+#endif
+	}
+
+    private:
+	frontend &fe;
+};
+
+/**
+ * @brief Decision stage taking the label with the highest score
+ * @tparam N number of labels
+ */
+template <size_t N> struct argmax_decision {
+	static constexpr size_t num_labels = N;
+	uint8_t label;
+	uint8_t scores[N];
+
+	template <typename model> void decide(model &m)
+	{
+		this->label = 0;
+		for (uint32_t i = 0; i < N; i++) {
+			this->scores[i] = m.score(i);
+			if (this->scores[i] > this->scores[this->label]) {
+				this->label = i;
+			}
+		}
+	}
+};
+
+/**
+ * @brief Source, features, model and decision of a clip, composed at compile
+ * time
+ *
+ * The stages are plain classes called directly, without virtual functions,
+ * so a firmware variant is a different set of template arguments and costs
+ * nothing at runtime. The pipeline only holds references; the stages and
+ * their buffers are wherever the caller puts them, e.g. the waveform in
+ * SRAM2. The stages need:
+ *
+ * - source: capacity, the waveform length as constant; acquire() to take
+ *   the next clip, false if there is none; samples() and length(), the
+ *   waveform and its valid part; features(), precomputed features of
+ *   features_size bytes or NULL. See uart_source, mic_source and the host
+ *   wav_source.
+ * - features: num_samples and features_size as constants;
+ *   compute(waveform, len, input), see frontend_features.
+ * - model: input(), invoke() and score(label), see speech::classifier.
+ * - decision: decide(model), see argmax_decision.
+ *
+ * run() processes one clip. The steps are public as well, to time them or
+ * to test a stage on its own.
+ */
+template <typename source, typename features, typename model,
+	  typename decision>
+class pipeline {
+	static_assert(source::capacity == features::num_samples,
+		      "The source must fill the window of the features");
+
+    public:
+	pipeline(source &src, features &feat, model &net, decision &out)
+		: src(src), feat(feat), net(net), out(out)
+	{
+	}
+
+	/**
+	 * @brief Take the next clip from the source and pad it with silence
+	 */
+	bool acquire()
+	{
+		if (!this->src.acquire()) {
+			return false;
+		}
+		if (this->src.features() == nullptr) {
+			size_t len = this->src.length();
+			memset(this->src.samples() + len, 0,
+			       (source::capacity - len) * sizeof(int16_t));
+		}
+		return true;
+	}
+
+	/**
+	 * @brief Fill the model input, from the waveform unless the source
+	 * has the features already
+	 */
+	void extract()
+	{
+		TfLiteTensor *input = this->net.input();
+		const uint8_t *precomputed = this->src.features();
+		if (precomputed == nullptr) {
+			this->feat.compute(this->src.samples(),
+					   this->src.length(), input);
+		} else if (precomputed != input->data.uint8) {
+			memcpy(input->data.uint8, precomputed,
+			       features::features_size);
+		}
+	}
+
+	bool infer()
+	{
+		return this->net.invoke();
+	}
+
+	void decide()
+	{
+		this->out.decide(this->net);
+	}
+
+	bool run()
+	{
+		if (!this->acquire()) {
+			return false;
+		}
+		this->extract();
+		if (!this->infer()) {
+			return false;
+		}
+		this->decide();
+		return true;
+	}
+
+	source &input_source()
+	{
+		return this->src;
+	}
+
+	model &network()
+	{
+		return this->net;
+	}
+
+	decision &result()
+	{
+		return this->out;
+	}
+
+    private:
+	source &src;
+	features &feat;
+	model &net;
+	decision &out;
+};
+};
@@ -0,0 +1,78 @@
+/**
+ * @file pool.h
+ * @brief Statically sized memory regions in place of the heap
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Buffers that used to come from malloc()
+ *
+ * Every region has a fixed size and address, decided at compile time. Its
+ * owner gets it back with pool_get() as often as it likes; nothing is ever
+ * freed. Regions of features that are never active at the same time may be
+ * merged into one.
+ */
+enum pool_region {
+	/** DMA target of the DFSDM, see speech::mic */
+	POOL_REGION_MIC = 0,
+	/** Block and batch frame receive buffer, see serial.h */
+	POOL_REGION_SERIAL,
+	POOL_NUM_REGIONS,
+};
+
+/* Bytes reserved for the microphone DMA buffer */
+#ifndef POOL_MIC_SIZE
+#define POOL_MIC_SIZE (8000 * sizeof(int32_t))
+#endif
+
+/**
+ * @brief Get the memory of a region
+ * @param size bytes needed this time, recorded for the high-water mark
+ * @return 8-byte aligned storage, NULL if size exceeds the region
+ */
+void *pool_get(enum pool_region region, size_t size);
+
+/**
+ * @brief Largest size requested from a region so far
+ */
+size_t pool_high_water(enum pool_region region);
+
+/**
+ * @brief Bytes reserved for all regions together
+ */
+size_t pool_size(void);
+
+/**
+ * @brief Print size and high-water mark of every region
+ */
+void pool_report(void);
@@ -0,0 +1,120 @@
+/**
+ * @file scheduler.h
+ * @brief Prioritized run-to-completion tasks dispatched by the NVIC
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Work that runs outside the main loop, most urgent first
+ *
+ * Every task is a function that runs to completion in the handler of an
+ * otherwise unused interrupt, so the NVIC preempts a task as soon as a more
+ * urgent one is posted. The main loop stays in thread mode, below all of
+ * them, and takes care of the host. The priorities, lower is more urgent:
+ *
+ *  0  DFSDM DMA (DMA1 channel 4) and SysTick
+ *  1  debug UART receive (USART1), no byte is lost behind a task
+ *  2  TASK_CAPTURE, drains the DMA buffer before it is overwritten
+ *  4  TASK_FEATURES
+ *  8  TASK_TELEMETRY, sends the results while the classifier runs
+ *  10 debug UART transmit DMA (DMA2 channel 6)
+ *  12 TASK_INFERENCE, may take as long as it likes
+ */
+enum task {
+	TASK_CAPTURE = 0, /**< Condition the raw microphone samples */
+	TASK_FEATURES, /**< Spectrogram columns and the first stage */
+	TASK_TELEMETRY, /**< Result records to the host */
+	TASK_INFERENCE, /**< The classifier */
+	TASK_COUNT,
+};
+
+/**
+ * @brief Set the task priorities, with no task installed
+ */
+void scheduler_init(void);
+
+/**
+ * @brief Install the function of a task
+ * @param fn called with ctx on every run, NULL disables the task and drops
+ * a pending run
+ */
+void scheduler_set(enum task task, void (*fn)(void *ctx), void *ctx);
+
+/**
+ * @brief Make a task run, safe to call from interrupts and other tasks
+ *
+ * Posts that arrive before the task has started are merged into one run,
+ * so a task has to process everything it finds queued. A post while the
+ * task runs makes it run again afterwards. Tasks run in CLOCK_PROFILE_BOOST,
+ * the time it takes to switch there counts towards the start latency.
+ * Once none is left, EVENT_TASK wakes the main loop.
+ */
+void scheduler_post(enum task task);
+
+/**
+ * @brief Whether no task is running or waiting to run
+ *
+ * Only meaningful while the scheduler is locked, e.g. to lower the clock
+ * before going to sleep.
+ */
+bool scheduler_idle(void);
+
+/**
+ * @brief Keep all tasks from starting, interrupts still run
+ * @return the previous state for scheduler_unlock()
+ */
+uint32_t scheduler_lock(void);
+
+void scheduler_unlock(uint32_t state);
+
+/**
+ * @brief Start over with the statistics of scheduler_report()
+ */
+void scheduler_reset_stats(void);
+
+/**
+ * @brief Print how often each task ran, its share of the CPU since the last
+ * scheduler_reset_stats(), its longest run and the longest time it waited to
+ * start, after being posted
+ *
+ * Interrupts that preempt a task count towards it, more urgent tasks do not.
+ */
+void scheduler_report(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -29,21 +29,202 @@
  *
  */
 
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
 #define SERIAL_BLOCK_SIZE					256
+#define SERIAL_CMD_LEN						5
 #define SERIAL_CMD_START_TRANSACTION		"START"
+#define SERIAL_CMD_MODEL_TRANSACTION		"MODEL"
+#define SERIAL_CMD_BATCH_TRANSACTION		"BATCH"
+#define SERIAL_CMD_AUDIO_TRANSACTION		"AUDIO"
+#define SERIAL_CMD_MEMORY_TRANSACTION		"WMARK"
+#define SERIAL_CMD_LISTEN_TRANSACTION		"LISTN"
+#define SERIAL_CMD_TRACE_TRANSACTION		"TRACE"
 #define SERIAL_CMD_ACK						"A"
 #define SERIAL_CMD_NACK						"N"
+#define SERIAL_CMD_RESULT					"R"
+// Instead of ACK or NACK: the device gave up, the host stops sending
+#define SERIAL_CMD_ABORT					"X"
+#define SERIAL_PAYLOAD_MAGIC				"SPLD"
 
+/* Batch blocks carry a 4 digit hex sequence number in front of the CRC */
+#define SERIAL_BATCH_FRAME_LEN				(4 + 8 + SERIAL_BLOCK_SIZE)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
- * @brief Receive up to len bytes
+ * @brief Commands that start a transaction
+ */
+enum serial_cmd {
+	SERIAL_CMD_NONE = 0,
+	SERIAL_CMD_TRANSFER, /**< Input data for inference */
+	SERIAL_CMD_MODEL, /**< TFLite model to replace the running one */
+	SERIAL_CMD_BATCH, /**< Several inputs for inference in one session */
+	SERIAL_CMD_AUDIO, /**< Stream the microphone, see stream.h */
+	SERIAL_CMD_MEMORY, /**< Report high-water marks, see memstat.h */
+	SERIAL_CMD_LISTEN, /**< Classify the microphone continuously */
+	SERIAL_CMD_TRACE, /**< Dump the event trace, see trace.h */
+};
+
+/**
+ * @brief Consumer of the data received in a transaction
+ */
+struct serial_sink {
+	/**
+	 * @brief Called once the file size is known, may be NULL
+	 * @returns 0 to accept the transfer, otherwise it is rejected
+	 */
+	int (*begin)(void *ctx, size_t filesize);
+
+	/**
+	 * @brief Called for every block with a valid checksum, in order
+	 * @param offset position of the block within the file
+	 * @returns 0 to acknowledge the block, SERIAL_SINK_ABORT if resending
+	 * cannot help and the transfer has to fail, otherwise the host has to
+	 * resend it
+	 */
+	int (*block)(void *ctx, const uint8_t *block, size_t offset,
+		     size_t len);
+
+	void *ctx;
+};
+
+/**
+ * @brief Returned by serial_sink::block() to end the transfer, which is
+ * answered with SERIAL_CMD_ABORT
+ */
+#define SERIAL_SINK_ABORT (-2)
+
+/**
+ * @brief Content of an inference payload
+ */
+enum serial_payload_type {
+	SERIAL_PAYLOAD_WAVEFORM_U8 = 0, /**< 8-bit unsigned samples */
+	SERIAL_PAYLOAD_WAVEFORM_S16 = 1, /**< 16-bit signed samples */
+	SERIAL_PAYLOAD_FEATURES_U8 = 2, /**< Spectrogram computed by the host */
+	SERIAL_PAYLOAD_WAVEFORM_ADPCM = 3, /**< IMA-ADPCM, see adpcm.h */
+	SERIAL_PAYLOAD_NUM_TYPES,
+};
+
+/**
+ * @brief Optional header in front of an inference payload
+ *
+ * All fields are little endian. Files that do not start with
+ * SERIAL_PAYLOAD_MAGIC are taken as SERIAL_PAYLOAD_WAVEFORM_U8 in full.
+ */
+struct serial_payload_header {
+	char magic[4];
+	uint8_t type; /**< enum serial_payload_type */
+	uint8_t reserved[3];
+	uint32_t len; /**< Payload bytes following the header */
+};
+
+/**
+ * @brief Consumer of a typed payload, without header and padding
+ */
+struct serial_payload_sink {
+	/**
+	 * @brief Called once the payload type and length are known
+	 * @returns 0 to accept the payload, otherwise it is discarded
+	 */
+	int (*begin)(void *ctx, enum serial_payload_type type, size_t len);
+
+	/**
+	 * @brief Called for the payload bytes of every block, in order
+	 * @returns 0 to acknowledge the block, otherwise the host has to
+	 * resend it
+	 */
+	int (*data)(void *ctx, const uint8_t *data, size_t offset, size_t len);
+
+	void *ctx;
+};
+
+/**
+ * @brief Consumer of the clips of a batch transaction
+ */
+struct serial_batch_sink {
+	/** Receives the payload of every clip, begin() is called per clip */
+	const struct serial_payload_sink *payload;
+
+	/**
+	 * @brief Called after the last block of a clip was acknowledged
+	 *
+	 * The host keeps sending the next clip in the meantime, up to the
+	 * window announced in the handshake.
+	 * @param len payload length or -1 if the payload was discarded
+	 */
+	void (*clip_done)(void *ctx, uint32_t index, int len);
+
+	/** Passed to clip_done(), apart from the context of the payload */
+	void *ctx;
+};
+
+/**
+ * @brief Wait until the host starts a transaction
+ * @returns the command received
+ */
+enum serial_cmd serial_wait_cmd(void);
+
+/**
+ * @brief Run the transfer of a transaction
+ * @param cmd command returned by serial_wait_cmd()
+ * @param max_len largest file accepted, rounded up to whole blocks
+ * @param sink consumer of the received blocks
+ * @returns number of bytes received (multiple of the block size) or 0
+ */
+int serial_transfer(enum serial_cmd cmd, size_t max_len,
+		    const struct serial_sink *sink);
+
+/**
+ * @brief Run the transfer of a transaction into a buffer
  * @returns number of bytes received
+ */
+int serial_recv_into(enum serial_cmd cmd, char *buf, size_t len);
+
+/**
+ * @brief Run the transfer of a transaction carrying a typed payload
+ * @param max_len largest file accepted, including header and padding
+ * @returns payload length, 0 if the transfer failed or -1 if the payload
+ * was discarded by the sink
+ */
+int serial_recv_payload(enum serial_cmd cmd, size_t max_len,
+			const struct serial_payload_sink *sink);
+
+/**
+ * @brief Run a batch transaction
  *
+ * The host announces the number of clips and the size of each clip, which
+ * is the same for all of them. The blocks of all clips are then numbered
+ * consecutively and may be sent without waiting for the acknowledgment of
+ * the previous ones, as long as no more than the announced window is
+ * outstanding. Blocks that do not carry the expected sequence number are
+ * dropped without a reply, so after a NACK or a timeout the host resumes
+ * with the oldest unacknowledged block. A frame cut short by a lost byte,
+ * or one whose sequence number is garbled or far from the expected one, is
+ * answered with a NACK once the line has gone quiet, so the next frame is
+ * read from its start again.
+ * @param max_len largest clip accepted, including header and padding
+ * @returns number of clips received or 0 if the batch was rejected
  */
-#ifdef __cplusplus
-extern "C"
-#endif
-int serial_recv(char* buf, size_t len);
+int serial_batch(size_t max_len, const struct serial_batch_sink *sink);
 
+/**
+ * @brief Send a result record, e.g. from serial_batch_sink.clip_done()
+ */
+void serial_send_result(const void *record, uint8_t len);
 
+/**
+ * @brief Receive up to len bytes
+ * @returns number of bytes received
+ *
+ */
+int serial_recv(char* buf, size_t len);
 
+#ifdef __cplusplus
+}
+#endif
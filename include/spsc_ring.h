@@ -0,0 +1,213 @@
+/**
+ * @file spsc_ring.h
+ * @brief Lock-free single-producer single-consumer ring buffer
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace speech
+{
+/**
+ * @brief Ring buffer between exactly one producer and one consumer
+ *
+ * Typically an interrupt on one side and the main loop on the other. Each
+ * index is only written by its own side, so no locking is needed. The
+ * release store of an index publishes the elements written before it to
+ * the acquire load on the other side.
+ *
+ * Besides copying, the free and the filled part can be accessed in place
+ * as contiguous spans, e.g. to hand them to a DMA, and committed or
+ * consumed afterwards.
+ *
+ * @tparam N capacity, power of two
+ */
+template <typename T, size_t N> class spsc_ring {
+	static_assert((N != 0) && ((N & (N - 1)) == 0),
+		      "Capacity must be a power of two");
+
+    public:
+	/**
+	 * @brief Contiguous elements within the ring
+	 */
+	struct span {
+		T *data;
+		size_t size;
+	};
+
+	static constexpr size_t capacity = N;
+
+	/**
+	 * @brief Number of filled elements, exact on the calling side
+	 */
+	size_t size() const
+	{
+		return this->head.load(std::memory_order_acquire) -
+		       this->tail.load(std::memory_order_acquire);
+	}
+
+	bool empty() const
+	{
+		return this->size() == 0;
+	}
+
+	/* Producer side */
+
+	bool push(const T &value)
+	{
+		span free = this->write_span();
+		if (free.size == 0) {
+			return false;
+		}
+		free.data[0] = value;
+		this->commit(1);
+		return true;
+	}
+
+	/**
+	 * @brief Copy in as many elements as fit
+	 * @return number of elements pushed
+	 */
+	size_t push(const T *values, size_t len)
+	{
+		size_t done = 0;
+		while (done < len) {
+			span free = this->write_span();
+			if (free.size == 0) {
+				break;
+			}
+			size_t n = (len - done < free.size) ? len - done :
+							      free.size;
+			for (size_t i = 0; i < n; i++) {
+				free.data[i] = values[done + i];
+			}
+			this->commit(n);
+			done += n;
+		}
+		return done;
+	}
+
+	/**
+	 * @brief Free elements up to the end of the storage
+	 */
+	span write_span()
+	{
+		size_t head = this->head.load(std::memory_order_relaxed);
+		size_t tail = this->tail.load(std::memory_order_acquire);
+		size_t free = N - (head - tail);
+		size_t contiguous = N - (head & (N - 1));
+		return { &this->buf[head & (N - 1)],
+			 (free < contiguous) ? free : contiguous };
+	}
+
+	/**
+	 * @brief Publish n elements written to the write_span()
+	 */
+	void commit(size_t n)
+	{
+		this->head.store(this->head.load(std::memory_order_relaxed) + n,
+				 std::memory_order_release);
+	}
+
+	/* Consumer side */
+
+	bool pop(T &value)
+	{
+		span filled = this->read_span();
+		if (filled.size == 0) {
+			return false;
+		}
+		value = filled.data[0];
+		this->consume(1);
+		return true;
+	}
+
+	/**
+	 * @brief Copy out up to len elements
+	 * @return number of elements popped
+	 */
+	size_t pop(T *values, size_t len)
+	{
+		size_t done = 0;
+		while (done < len) {
+			span filled = this->read_span();
+			if (filled.size == 0) {
+				break;
+			}
+			size_t n = (len - done < filled.size) ? len - done :
+								filled.size;
+			for (size_t i = 0; i < n; i++) {
+				values[done + i] = filled.data[i];
+			}
+			this->consume(n);
+			done += n;
+		}
+		return done;
+	}
+
+	/**
+	 * @brief Filled elements up to the end of the storage
+	 */
+	span read_span()
+	{
+		size_t tail = this->tail.load(std::memory_order_relaxed);
+		size_t head = this->head.load(std::memory_order_acquire);
+		size_t filled = head - tail;
+		size_t contiguous = N - (tail & (N - 1));
+		return { &this->buf[tail & (N - 1)],
+			 (filled < contiguous) ? filled : contiguous };
+	}
+
+	/**
+	 * @brief Release n elements of the read_span()
+	 */
+	void consume(size_t n)
+	{
+		this->tail.store(this->tail.load(std::memory_order_relaxed) + n,
+				 std::memory_order_release);
+	}
+
+	/**
+	 * @brief Drop all elements, only while neither side is active
+	 */
+	void clear()
+	{
+		this->tail.store(this->head.load(std::memory_order_relaxed),
+				 std::memory_order_release);
+	}
+
+    private:
+	// Free running, wrap around together with the unsigned arithmetic
+	std::atomic<size_t> head{ 0 };
+	std::atomic<size_t> tail{ 0 };
+	T buf[N];
+};
+};
@@ -0,0 +1,119 @@
+/**
+ * @file step_classifier.h
+ * @brief Keyword classifier that runs one spectrogram column at a time
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tensorflow/lite/micro/micro_interpreter.h>
+#include <tensorflow/lite/micro/micro_mutable_op_resolver.h>
+#include <tensorflow/lite/micro/micro_profiler_interface.h>
+#include <tensorflow/lite/schema/schema_generated.h>
+
+#include "classifier.h"
+#include "frontend.h"
+
+namespace speech
+{
+/**
+ * @brief Runs the step model exported by ml/train.py --streaming
+ *
+ * Input 0 is one spectrogram column and output 0 the scores. Every further
+ * input is the state of a layer that looks back in time, and the output with
+ * the same index is that state advanced by one column. After every step the
+ * states are copied back, so each layer only computes its newest column.
+ */
+class step_classifier {
+    public:
+	static constexpr size_t num_labels = classifier::num_labels;
+
+	/**
+	 * @param arena tensor arena, the end of it holds a copy of the states
+	 * @param profiler attached to the interpreter, may be NULL
+	 */
+	step_classifier(uint8_t *arena, size_t arena_size,
+			tflite::MicroProfilerInterface *profiler = nullptr);
+	~step_classifier();
+
+	/**
+	 * @brief Check whether a buffer holds a step model with matching
+	 * state inputs and outputs
+	 */
+	static bool validate(const uint8_t *buf, size_t len);
+
+	/**
+	 * @param buf model flatbuffer, must outlive the classifier
+	 * @returns true if the tensors could be allocated
+	 */
+	bool load(const uint8_t *buf);
+	void unload();
+
+	/**
+	 * @brief Forget everything heard so far
+	 */
+	void reset();
+
+	/**
+	 * @brief Input for the next column, frontend::num_bins bytes
+	 */
+	TfLiteTensor *column();
+
+	/**
+	 * @brief Classify the window ending with the current column
+	 */
+	bool step();
+
+	TfLiteTensor *output();
+	uint8_t score(size_t label);
+
+	/**
+	 * @brief Whether the states span a whole window, the scores are
+	 * meaningless before
+	 */
+	bool warm() const;
+
+	size_t arena_used() const;
+
+    private:
+	void carry();
+
+	uint8_t *arena;
+	size_t arena_size;
+	tflite::MicroProfilerInterface *profiler;
+	tflite::MicroMutableOpResolver<13> resolver;
+	tflite::MicroInterpreter *interp = nullptr;
+	alignas(tflite::MicroInterpreter) uint8_t
+		storage[sizeof(tflite::MicroInterpreter)];
+	uint8_t *states = nullptr; /**< Outputs are staged here */
+	size_t steps = 0;
+};
+};
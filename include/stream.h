@@ -0,0 +1,112 @@
+/**
+ * @file stream.h
+ * @brief Framed binary stream to the host over the debug UART
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef STREAM_BAUDRATE
+#define STREAM_BAUDRATE 921600
+#endif
+
+#define STREAM_SYNC 0xa55a
+
+/* Largest payload of a single frame */
+#define STREAM_MAX_PAYLOAD 512
+
+/* Milliseconds between STREAM_TYPE_TELEMETRY frames */
+#define STREAM_TELEMETRY_PERIOD 1000
+
+/* Frames queued for transmission, power of two */
+#define STREAM_SLOTS 4
+
+/**
+ * @brief Content of a frame
+ */
+enum stream_type {
+	STREAM_TYPE_INFO = 0, /**< struct stream_info */
+	STREAM_TYPE_AUDIO = 1, /**< int16 samples */
+	STREAM_TYPE_TELEMETRY = 2, /**< struct memstat */
+};
+
+/**
+ * @brief Sent in front of every payload, all fields little endian
+ */
+struct stream_header {
+	uint16_t sync; /**< STREAM_SYNC */
+	uint8_t type; /**< enum stream_type */
+	uint8_t flags;
+	uint16_t seq; /**< Counts all frames, including dropped ones */
+	uint16_t len; /**< Payload bytes following the header */
+	uint32_t drops; /**< Frames dropped so far, the queue was full */
+};
+
+/**
+ * @brief Payload of STREAM_TYPE_INFO, sent when the stream starts
+ */
+struct stream_info {
+	uint32_t sample_rate;
+	uint8_t bits;
+	uint8_t channels;
+	uint16_t reserved;
+};
+
+/**
+ * @brief Hand the UART over to the stream
+ *
+ * Switches to STREAM_BAUDRATE and waits for the host to confirm with an 'A'
+ * at the new rate. Until stream_stop(), stdout must not be used.
+ * @return 0 on success
+ */
+int stream_start(void);
+
+/**
+ * @brief Send the queued frames and go back to the debug baud rate
+ */
+void stream_stop(void);
+
+/**
+ * @brief Queue a frame
+ *
+ * Safe to call from interrupts. If the queue is full, the frame is counted
+ * as dropped.
+ * @return 0 if the frame was queued
+ */
+int stream_write(uint8_t type, uint8_t flags, const void *payload,
+		 size_t len);
+
+/**
+ * @brief Condition DFSDM samples and queue them as STREAM_TYPE_AUDIO frames
+ *
+ * Matches dfsdm_callback_t, see capture_process() for the conditioning.
+ */
+void stream_audio(const int32_t *samples, size_t len);
@@ -0,0 +1,202 @@
+/**
+ * @file trace.h
+ * @brief Timestamped event trace in RAM
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef TRACE_SIZE
+#include "cycles.h"
+#endif
+
+/*
+ * Built with -DTRACE_SIZE=<events>, a power of two, the firmware keeps the
+ * last events in a ring. The host fetches them with SERIAL_CMD_TRACE: the
+ * device answers SERIAL_CMD_TRACE_TRANSACTION and SERIAL_CMD_NACK if built
+ * without, otherwise SERIAL_CMD_ACK, the length of the record as uint32_t,
+ * the record (a trace_header followed by num_events trace_event, oldest
+ * first) and the CRC32 of the record. All fields are little endian, see
+ * tools/trace.py. Every dump starts a new trace.
+ *
+ * Without TRACE_SIZE, all of this compiles to nothing.
+ */
+
+/**
+ * @brief What an event stands for, keep in sync with tools/trace.py
+ */
+enum trace_id {
+	/** Span, SystemCoreClock in Hz before and after the switch */
+	TRACE_CLOCK = 0,
+	/** Mark on waking up, the cycles asleep; the counter stands still */
+	TRACE_SLEEP,
+	/** Mark, a transaction starts, its enum serial_cmd */
+	TRACE_SERIAL_CMD,
+	/** Span, a block of a transfer from its checksum to the reply, the
+	 * offset */
+	TRACE_SERIAL_BLOCK,
+	/** Span, a frame of a batch, its sequence number */
+	TRACE_SERIAL_FRAME,
+	/** Mark, a block was answered with a NACK, offset or sequence number */
+	TRACE_SERIAL_NACK,
+	/** Mark, a batch frame out of sequence was dropped, its number */
+	TRACE_SERIAL_SKIP,
+	/** Span, a stream frame sent by the DMA, its sequence number */
+	TRACE_STREAM_FRAME,
+	/** Mark, a stream frame did not fit, its sequence number */
+	TRACE_STREAM_DROP,
+	/** Span, a clip from its features to the decision, its index */
+	TRACE_CLIP,
+	/** Span, the features of a clip */
+	TRACE_FEATURES,
+	/** Span, Invoke() of the classifier */
+	TRACE_INVOKE,
+	/** Span, an operator, its index in execution order */
+	TRACE_OP,
+	/** Span, a run of a task, its enum task, see scheduler.h */
+	TRACE_TASK,
+	/** Span, interrupt of the microphone DMA */
+	TRACE_IRQ_MIC,
+	/** Span, interrupt of the UART transmit DMA */
+	TRACE_IRQ_UART_TX,
+	/** Span, interrupt of the UART */
+	TRACE_IRQ_UART,
+	TRACE_NUM_IDS,
+};
+
+enum trace_phase {
+	TRACE_BEGIN = 0,
+	TRACE_END,
+	TRACE_MARK,
+};
+
+struct trace_event {
+	uint32_t cycles; /**< DWT cycle counter */
+	uint32_t arg; /**< Meaning depends on the id */
+	uint8_t id; /**< enum trace_id */
+	uint8_t phase; /**< enum trace_phase */
+	uint16_t reserved;
+};
+
+struct trace_header {
+	uint32_t core_clock; /**< SystemCoreClock after the last event, in Hz */
+	uint32_t lost; /**< Events overwritten since the last dump */
+	uint16_t num_events;
+	uint16_t event_size; /**< sizeof(struct trace_event) */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef TRACE_SIZE
+extern struct trace_event trace_events[TRACE_SIZE];
+extern uint32_t trace_head;
+extern volatile bool trace_paused;
+
+/**
+ * @brief Append an event, safe to call from interrupts
+ */
+static inline void trace(enum trace_id id, enum trace_phase phase,
+			 uint32_t arg)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if (!trace_paused) {
+		struct trace_event *e =
+			&trace_events[trace_head++ & (TRACE_SIZE - 1)];
+		e->cycles = cycles_now();
+		e->arg = arg;
+		e->id = id;
+		e->phase = phase;
+	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief Call with interrupts disabled right before sleeping
+ * @return what trace_sleep_end() needs
+ */
+static inline uint32_t trace_sleep_begin(void)
+{
+	return SysTick->VAL;
+}
+
+/**
+ * @brief Call with interrupts still disabled after waking up
+ *
+ * Consecutive sleeps are merged into one event, so a trace of an idle
+ * device is not just SysTick.
+ */
+void trace_sleep_end(uint32_t begin);
+#else
+static inline void trace(enum trace_id id, enum trace_phase phase,
+			 uint32_t arg)
+{
+	(void)id;
+	(void)phase;
+	(void)arg;
+}
+
+static inline uint32_t trace_sleep_begin(void)
+{
+	return 0;
+}
+
+static inline void trace_sleep_end(uint32_t begin)
+{
+	(void)begin;
+}
+#endif
+
+static inline void trace_begin(enum trace_id id, uint32_t arg)
+{
+	trace(id, TRACE_BEGIN, arg);
+}
+
+static inline void trace_end(enum trace_id id, uint32_t arg)
+{
+	trace(id, TRACE_END, arg);
+}
+
+static inline void trace_mark(enum trace_id id, uint32_t arg)
+{
+	trace(id, TRACE_MARK, arg);
+}
+
+/**
+ * @brief Answer SERIAL_CMD_TRACE
+ */
+void trace_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
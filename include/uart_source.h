@@ -0,0 +1,107 @@
+/**
+ * @file uart_source.h
+ * @brief Pipeline source fed by serial payloads
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "frontend.h"
+
+extern "C" {
+#include "adpcm.h"
+#include "serial.h"
+}
+
+namespace speech
+{
+/**
+ * @brief Clips received by serial_recv_payload() or serial_batch(), see
+ * speech::pipeline
+ *
+ * Waveform payloads are decoded into the buffer block by block as they
+ * arrive, feature payloads go straight into the model input. With INT8_IO
+ * the model input is int8, so the uint8 feature payloads are rejected.
+ */
+class uart_source {
+    public:
+	static constexpr size_t capacity = frontend::num_samples;
+
+	explicit uart_source(int16_t (&waveform)[capacity]);
+
+	/**
+	 * @brief Prepare for the next transfer
+	 * @param features model input, destination of feature payloads
+	 * @returns the sink to pass to the serial transfer
+	 */
+	const struct serial_payload_sink *sink(uint8_t *features);
+
+	/**
+	 * @brief The payload is in place once the transfer completed
+	 */
+	bool acquire()
+	{
+		return true;
+	}
+
+	int16_t *samples()
+	{
+		return this->waveform;
+	}
+
+	size_t length() const
+	{
+		return this->num_samples;
+	}
+
+	/**
+	 * @returns the model input for feature payloads, NULL for waveforms
+	 */
+	const uint8_t *features() const
+	{
+		return (this->type == SERIAL_PAYLOAD_FEATURES_U8) ?
+			       this->input :
+			       nullptr;
+	}
+
+    private:
+	static int begin(void *ctx, enum serial_payload_type type, size_t len);
+	static int data(void *ctx, const uint8_t *data, size_t offset,
+			size_t len);
+
+	int16_t *waveform;
+	uint8_t *input = nullptr;
+	enum serial_payload_type type = SERIAL_PAYLOAD_WAVEFORM_S16;
+	size_t num_samples = 0; /**< Waveform samples in the payload */
+	struct adpcm_state adpcm;
+	struct serial_payload_sink payload_sink;
+};
+};
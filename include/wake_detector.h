@@ -0,0 +1,130 @@
+/**
+ * @file wake_detector.h
+ * @brief Small always-on model that decides when to run the classifier
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tensorflow/lite/micro/micro_interpreter.h>
+#include <tensorflow/lite/micro/micro_mutable_op_resolver.h>
+#include <tensorflow/lite/micro/micro_profiler_interface.h>
+#include <tensorflow/lite/schema/schema_generated.h>
+
+#include "classifier.h"
+#include "frontend.h"
+
+/* Score out of 255 at which the classifier runs */
+#ifndef WAKE_THRESHOLD
+#define WAKE_THRESHOLD 128
+#endif
+
+namespace speech
+{
+/**
+ * @brief First stage of the cascade, runs the model exported by
+ * ml/train.py --wake
+ *
+ * Spectrogram columns are averaged over pool_frames columns and pool_bins
+ * bins, the Nyquist bin is dropped. The detector sees the last num_rows of
+ * these rows, i.e. the same second as the classifier at a fraction of the
+ * resolution, and returns how likely it contains a keyword.
+ */
+class wake_detector {
+    public:
+	static constexpr size_t pool_frames = 4;
+	static constexpr size_t pool_bins = 8;
+	static constexpr size_t num_rows = frontend::num_frames / pool_frames;
+	static constexpr size_t num_bands =
+		(frontend::num_bins - 1) / pool_bins;
+
+	/**
+	 * @param arena its own part of the tensor arena
+	 * @param profiler attached to the interpreter, may be NULL
+	 */
+	wake_detector(uint8_t *arena, size_t arena_size,
+		      tflite::MicroProfilerInterface *profiler = nullptr);
+	~wake_detector();
+
+	/**
+	 * @brief Check whether a buffer holds a detector for pooled features
+	 */
+	static bool validate(const uint8_t *buf, size_t len);
+
+	/**
+	 * @param buf model flatbuffer, must outlive the detector
+	 * @returns true if the tensors could be allocated
+	 */
+	bool load(const uint8_t *buf);
+	void unload();
+	bool loaded() const;
+
+	/**
+	 * @brief Forget all rows, e.g. after the classifier ran on them
+	 */
+	void reset();
+
+	/**
+	 * @brief Pool a spectrogram column
+	 * @param column frontend::num_bins bytes
+	 * @returns true if it completed a row
+	 */
+	bool push(const uint8_t *column);
+
+	/**
+	 * @brief Whether a whole window of rows has been pushed since reset()
+	 */
+	bool warm() const;
+
+	/**
+	 * @brief Score the last num_rows rows
+	 * @returns 0 to 255, 0 if the invocation failed
+	 */
+	uint8_t invoke();
+
+	size_t arena_used() const;
+
+    private:
+	uint8_t *arena;
+	size_t arena_size;
+	tflite::MicroProfilerInterface *profiler;
+	tflite::MicroMutableOpResolver<6> resolver;
+	tflite::MicroInterpreter *interp = nullptr;
+	alignas(tflite::MicroInterpreter) uint8_t
+		storage[sizeof(tflite::MicroInterpreter)];
+
+	/* Kept apart from the input tensor, which the interpreter may reuse */
+	uint8_t rows[num_rows * num_bands]; /**< Oldest first */
+	uint16_t sums[num_bands];
+	size_t columns = 0; /**< Columns in sums */
+	size_t filled = 0; /**< Rows pushed since reset(), up to num_rows */
+};
+};
@@ -0,0 +1,100 @@
+/**
+ * @file weight_cache.h
+ * @brief Copies constant weight tensors from flash into SRAM
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <tensorflow/lite/micro/micro_interpreter.h>
+#include <tensorflow/lite/schema/schema_generated.h>
+
+#include "op_profiler.h"
+
+namespace speech
+{
+/**
+ * @brief Profile-guided placement of constant tensors in SRAM
+ *
+ * Weights of the compiled-in model are read directly from flash, where every
+ * access that misses the ART cache stalls for the flash wait states. This
+ * moves the constant inputs of the most expensive operators into a RAM pool
+ * and rewrites the data pointers of the interpreter's tensors, so the kernels
+ * fetch them from SRAM instead.
+ */
+class weight_cache {
+    public:
+	static constexpr size_t max_entries = 16;
+
+	/**
+	 * @param pool RAM the tensors are copied to, 16-byte aligned
+	 * @param pool_size size of the pool in bytes
+	 */
+	weight_cache(uint8_t *pool, size_t pool_size);
+
+	/**
+	 * @brief Move constant tensors into the pool
+	 *
+	 * Operators are visited from the most to the least expensive one as
+	 * measured by a profiled Invoke(). Their constant inputs are copied as
+	 * long as they fit into the pool. After each copy, the model is invoked
+	 * again to measure the cycles saved by that tensor.
+	 *
+	 * @note Must be called after AllocateTensors(), with profiler attached
+	 * to the interpreter. The contents of the input tensor are used as-is.
+	 * @returns number of tensors copied
+	 */
+	size_t promote(const tflite::Model *model,
+		       tflite::MicroInterpreter &interpreter,
+		       op_profiler &profiler);
+
+	/**
+	 * @brief Print the copied tensors and the cycles saved by each
+	 */
+	void report() const;
+
+    private:
+	struct entry {
+		int32_t tensor;
+		size_t op;
+		const char *tag;
+		size_t bytes;
+		int32_t saved;
+	};
+
+	uint8_t *pool;
+	size_t pool_size;
+	size_t used = 0;
+	entry entries[max_entries];
+	size_t count = 0;
+	uint32_t baseline = 0;
+};
+};
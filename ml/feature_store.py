@@ -0,0 +1,78 @@
+# Reads the feature stores written by speech_featurize (host/featurize.cc),
+# see host/feature_store.h for the format. The records are memory-mapped,
+# nothing is read before it is used.
+
+import struct
+
+import numpy as np
+
+MAGIC = b'SPFS'
+VERSION = 1
+HEADER_FORMAT = '<4sHBBIIIHHfi8xQQQQ'
+LABEL_LEN = 16
+TYPES = {0: ('uint8', np.uint8), 1: ('int8', np.int8)}
+
+# Same as speech::frontend, for the configuration hash
+FRONTEND_VERSION = 1
+WINDOW_SIZE = 256
+FRAME_STEP = 128
+NUM_FRAMES = 124
+NUM_BINS = 129
+NUM_SAMPLES = 16000
+
+
+def config_hash(type_name, scale, zero_point):
+    """Same as speech::feature_store::config_hash()"""
+    config = (f'frontend-{FRONTEND_VERSION} window={WINDOW_SIZE} '
+              f'step={FRAME_STEP} frames={NUM_FRAMES} bins={NUM_BINS} '
+              f'samples={NUM_SAMPLES} type={type_name} scale={scale:.9g} '
+              f'zero_point={zero_point}')
+    h = 2166136261
+    for c in config.encode():
+        h = ((h ^ c) * 16777619) & 0xffffffff
+    return h
+
+
+class FeatureStore:
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            header = f.read(struct.calcsize(HEADER_FORMAT))
+        (magic, version, type_id, num_labels, hash_, num_records,
+         record_size, num_frames, num_bins, scale, zero_point, labels_offset,
+         index_offset, names_offset, data_offset) = \
+            struct.unpack(HEADER_FORMAT, header)
+        if magic != MAGIC or version != VERSION or type_id not in TYPES:
+            raise ValueError(f'{path} is not a feature store')
+        type_name, dtype = TYPES[type_id]
+        if (num_frames, num_bins) != (NUM_FRAMES, NUM_BINS) or \
+                hash_ != config_hash(type_name, scale, zero_point):
+            raise ValueError(f'{path} was computed by a different front end')
+
+        raw = np.memmap(path, dtype=np.uint8, mode='r')
+        self.scale = scale
+        self.zero_point = zero_point
+        self.label_names = [
+            bytes(raw[labels_offset + i * LABEL_LEN:
+                      labels_offset + (i + 1) * LABEL_LEN])
+            .rstrip(b'\0').decode() for i in range(num_labels)]
+        index = raw[index_offset:index_offset + 8 * num_records] \
+            .view('<u4').reshape(num_records, 2)
+        self.labels = np.array(index[:, 0], dtype=np.int32)
+        self._names = raw[names_offset:data_offset]
+        self._name_offsets = np.array(index[:, 1])
+        self.features = np.memmap(path, dtype=dtype, mode='r',
+                                  offset=data_offset,
+                                  shape=(num_records, num_frames, num_bins))
+
+    def __len__(self):
+        return len(self.labels)
+
+    def name(self, i):
+        start = self._name_offsets[i]
+        end = start + np.argmax(self._names[start:] == 0)
+        return bytes(self._names[start:end]).decode()
+
+    def spectrograms(self, index):
+        """Magnitudes of the records, as the front end computed them"""
+        features = np.asarray(self.features[index], dtype=np.float32)
+        return self.scale * (features - self.zero_point)
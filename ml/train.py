@@ -16,6 +16,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import argparse
 import os
 import pathlib
 import shutil
@@ -29,6 +30,37 @@ from tensorflow.keras import layers
 from tensorflow.keras import models
 from sklearn.model_selection import train_test_split
 
+parser = argparse.ArgumentParser(
+    description='Train the keyword model and convert it for the firmware')
+parser.add_argument('--streaming', action='store_true',
+                    help='train a time-causal model and also export its '
+                    'step model, which processes one spectrogram column '
+                    'per call for continuous listening')
+parser.add_argument('--wake', action='store_true',
+                    help='also train the wake detector, a small model on '
+                    'pooled features that gates the keyword model')
+parser.add_argument('--int8-io', action='store_true',
+                    help='give the keyword model int8 input and output, '
+                    'for firmware built with -DINT8_IO=1')
+parser.add_argument('--device-features', action='store_true',
+                    help='compute the spectrograms with the front end of '
+                    'the firmware, speech_frontend from the host build '
+                    '(on PYTHONPATH), instead of tf.signal.stft')
+parser.add_argument('--feature-store', metavar='DIR',
+                    help='read the spectrograms of the train and val splits '
+                    'from DIR/train.spfs and DIR/val.spfs, written once by '
+                    'speech_featurize from the host build')
+args = parser.parse_args()
+
+if args.device_features:
+    import speech_frontend
+
+# The firmware quantizes the features for an int8 input itself, while a
+# uint8 input costs a Quantize op over the whole spectrogram
+IO_TYPE = tf.int8 if args.int8_io else tf.uint8
+
+MODEL_FILE = 'model_stream.keras' if args.streaming else 'model.keras'
+
 # Set the seed value for experiment reproducibility.
 seed = 42
 tf.random.set_seed(seed)
@@ -109,12 +141,27 @@ val_ds = val_ds.map(squeeze, tf.data.AUTOTUNE)
 test_ds = val_ds.shard(num_shards=2, index=0)
 val_ds = val_ds.shard(num_shards=2, index=1)
 
+# The magnitudes the firmware computes before quantizing them, from the same
+# 16-bit samples it receives. Takes one clip or a batch.
+def device_spectrogram(waveform):
+  clips = np.clip(np.round(waveform * 32768), -32768, 32767).astype(np.int16)
+  spectrogram = np.frombuffer(speech_frontend.spectrogram(clips),
+                              dtype=np.float32)
+  return spectrogram.reshape(clips.shape[:-1] + (speech_frontend.num_frames,
+                                                 speech_frontend.num_bins))
+
 # Apply STFT to waveforms to get spectrogram
 def get_spectrogram(waveform):
-  # Convert the waveform to a spectrogram via a STFT.
-  spectrogram = tf.signal.stft(waveform, frame_length=255, frame_step=128)
-  # Obtain the magnitude of the STFT.
-  spectrogram = tf.abs(spectrogram)
+  if args.device_features:
+    spectrogram = tf.numpy_function(device_spectrogram, [waveform],
+                                    tf.float32)
+    spectrogram.set_shape(waveform.shape[:-1].concatenate(
+        [speech_frontend.num_frames, speech_frontend.num_bins]))
+  else:
+    # Convert the waveform to a spectrogram via a STFT.
+    spectrogram = tf.signal.stft(waveform, frame_length=255, frame_step=128)
+    # Obtain the magnitude of the STFT.
+    spectrogram = tf.abs(spectrogram)
   # Add a `channels` dimension, so that the spectrogram can be used
   # as image-like input data with convolution layers (which expect
   # shape (`batch_size`, `height`, `width`, `channels`).
@@ -141,9 +188,29 @@ def make_spec_ds(ds):
       map_func=lambda audio,label: (get_spectrogram(audio), label),
       num_parallel_calls=tf.data.AUTOTUNE)
 
-train_spectrogram_ds = make_spec_ds(train_ds)
-val_spectrogram_ds = make_spec_ds(val_ds)
-test_spectrogram_ds = make_spec_ds(test_ds)
+# Batches of a feature store, read from the mapped file as they are used
+def make_store_ds(split):
+  from feature_store import FeatureStore
+  store = FeatureStore(os.path.join(args.feature_store, f'{split}.spfs'))
+  def batches():
+    for start in range(0, len(store), 32):
+      batch = slice(start, start + 32)
+      yield store.spectrograms(batch)[..., np.newaxis], store.labels[batch]
+  return tf.data.Dataset.from_generator(batches, output_signature=(
+      tf.TensorSpec((None, store.features.shape[1], store.features.shape[2], 1),
+                    tf.float32),
+      tf.TensorSpec((None,), tf.int32)))
+
+if args.feature_store:
+  train_spectrogram_ds = make_store_ds('train')
+  # Split like the waveforms above
+  val_spectrogram_ds = make_store_ds('val')
+  test_spectrogram_ds = val_spectrogram_ds.shard(num_shards=2, index=0)
+  val_spectrogram_ds = val_spectrogram_ds.shard(num_shards=2, index=1)
+else:
+  train_spectrogram_ds = make_spec_ds(train_ds)
+  val_spectrogram_ds = make_spec_ds(val_ds)
+  test_spectrogram_ds = make_spec_ds(test_ds)
 
 train_spectrogram_ds = train_spectrogram_ds.cache().shuffle(10000).prefetch(tf.data.AUTOTUNE)
 val_spectrogram_ds = val_spectrogram_ds.cache().prefetch(tf.data.AUTOTUNE)
@@ -155,30 +222,98 @@ print(train_spectrogram_ds)
 input_shape = train_spectrogram_ds.element_spec[0].shape[1:]
 print(f'Input shape={input_shape}')
 
+def build_streaming_model(input_shape, norm_layer, num_labels):
+    """
+    Time-causal CNN, returned twice with shared layers: once for the whole
+    window, for training and clip inference, and once as step model.
+
+    The step model takes one spectrogram column and, per layer that looks
+    back in time, the columns that layer saw last time. It returns the
+    scores and those states shifted by one column. Fed back every hop, it
+    computes only the newly exposed column of every layer, and its scores
+    match the full model once the states have filled up.
+    """
+    pool = layers.AveragePooling2D(pool_size=(1, 4))
+    convs = [
+        layers.Conv2D(16, (3, 3), activation='relu'),
+        layers.Conv2D(16, (3, 3), strides=(1, 2), activation='relu'),
+    ]
+
+    inputs = layers.Input(shape=input_shape)
+    x = pool(norm_layer(inputs))
+    for conv in convs:
+        x = conv(x)
+    # One embedding per column, averaged over the window
+    embed = layers.Conv2D(32, (1, x.shape[2]), activation='relu')
+    x = embed(x)
+    window = x.shape[1]
+    average = layers.AveragePooling2D(pool_size=(window, 1))
+    head = layers.Dense(num_labels, name='scores')
+    x = layers.Flatten()(average(x))
+    x = layers.Dropout(0.5)(x)
+    model = models.Model(inputs, head(x))
+
+    # Inputs and outputs are named so the converter keeps them in order:
+    # column, then state0, state1, ...
+    column = layers.Input(shape=(1,) + tuple(input_shape[1:]), batch_size=1,
+                          name='column')
+    states_in = []
+    states_out = []
+
+    def shift(x, length, name):
+        state = layers.Input(shape=(length,) + tuple(x.shape[2:]),
+                             batch_size=1, name=name)
+        x = layers.Concatenate(axis=1)([state, x])
+        states_in.append(state)
+        states_out.append(layers.Cropping2D(((1, 0), (0, 0)),
+                                            name=f'{name}_next')(x))
+        return x
+
+    x = pool(norm_layer(column))
+    for i, conv in enumerate(convs):
+        x = conv(shift(x, conv.kernel_size[0] - 1, f'state{i}'))
+    x = embed(x)
+    x = shift(x, window - 1, f'state{len(convs)}')
+    x = layers.Flatten()(average(x))
+    step = models.Model([column] + states_in, [head(x)] + states_out)
+    return model, step
+
+def export_c_array(tflite_file, cc_file):
+    """Convert a model to a C array in the firmware tree"""
+    os.system(f'xxd -i {tflite_file} > {cc_file}')
+    os.system(f'sed -i \'s/unsigned char/const unsigned char/\' {cc_file}')
+    os.system(f'sed -i \'1i #include <model_tflite.h>\\n\' {cc_file}')
 
+    if not os.path.exists('../src/models'):
+        os.makedirs('../src/models')
+    shutil.copyfile(cc_file, os.path.join('../src/models', cc_file))
 
-if not os.path.exists('model.keras'):
+if not os.path.exists(MODEL_FILE):
     # Instantiate the `tf.keras.layers.Normalization` layer.
     norm_layer = layers.Normalization()
     # Fit the state of the layer to the spectrograms
     # with `Normalization.adapt`.
     norm_layer.adapt(data=train_spectrogram_ds.map(map_func=lambda spec, label: spec))
 
-    model = models.Sequential([
-        layers.Input(shape=input_shape),
-        # Downsample the input.
-        layers.Resizing(32, 32),
-        # Normalize.
-        norm_layer,
-        layers.Conv2D(32, 3, activation='relu'),
-        layers.Conv2D(16, 3, activation='relu'),
-        layers.MaxPooling2D(),
-        layers.Dropout(0.25),
-        layers.Flatten(),
-        layers.Dense(24, activation='relu'),
-        layers.Dropout(0.5),
-        layers.Dense(num_labels),
-    ])
+    if args.streaming:
+        model, step = build_streaming_model(input_shape, norm_layer,
+                                            num_labels)
+    else:
+        model = models.Sequential([
+            layers.Input(shape=input_shape),
+            # Downsample the input.
+            layers.Resizing(32, 32),
+            # Normalize.
+            norm_layer,
+            layers.Conv2D(32, 3, activation='relu'),
+            layers.Conv2D(16, 3, activation='relu'),
+            layers.MaxPooling2D(),
+            layers.Dropout(0.25),
+            layers.Flatten(),
+            layers.Dense(24, activation='relu'),
+            layers.Dropout(0.5),
+            layers.Dense(num_labels),
+        ])
 
     model.summary()
 
@@ -195,7 +330,7 @@ if not os.path.exists('model.keras'):
         epochs=EPOCHS,
         callbacks=tf.keras.callbacks.EarlyStopping(verbose=1, patience=2),
     )
-    model.save('model.keras')
+    model.save(MODEL_FILE)
 
     def representative_dataset():
         for input_value, _ in train_spectrogram_ds.take(100):
@@ -206,8 +341,8 @@ if not os.path.exists('model.keras'):
     converter.optimizations = [tf.lite.Optimize.DEFAULT]
     converter.representative_dataset = representative_dataset
     converter.target_spec.supported_ops = [tf.lite.OpsSet.TFLITE_BUILTINS_INT8]
-    converter.inference_input_type = tf.uint8
-    converter.inference_output_type = tf.uint8
+    converter.inference_input_type = IO_TYPE
+    converter.inference_output_type = IO_TYPE
     tflite_model = converter.convert()
 
     # Save the model.
@@ -215,13 +350,33 @@ if not os.path.exists('model.keras'):
       f.write(tflite_model)
 
     # Convert the model to a c array
-    os.system('xxd -i model.tflite > model.cc')
-    os.system('sed -i \'s/unsigned char/const unsigned char/\' model.cc')
-    os.system('sed -i \'1i #include <model_tflite.h>\n\' model.cc')
-
-    if not os.path.exists('../src/models'):
-        os.makedirs('../src/models')
-    shutil.copyfile('model.cc', '../src/models/model.cc')
+    export_c_array('model.tflite', 'model.cc')
+
+    if args.streaming:
+        # Representative steps run the float step model over whole clips,
+        # so the states are calibrated with the values they really take
+        def representative_steps():
+            for spec, _ in train_spectrogram_ds.unbatch().take(20):
+                states = [np.zeros(state.shape, dtype=np.float32)
+                          for state in step.inputs[1:]]
+                for t in range(spec.shape[0]):
+                    inputs = [spec[tf.newaxis, t:t + 1]] + states
+                    yield inputs
+                    outputs = step(inputs)
+                    states = [output.numpy() for output in outputs[1:]]
+
+        converter = tf.lite.TFLiteConverter.from_keras_model(step)
+        converter.optimizations = [tf.lite.Optimize.DEFAULT]
+        converter.representative_dataset = representative_steps
+        converter.target_spec.supported_ops = [tf.lite.OpsSet.TFLITE_BUILTINS_INT8]
+        converter.inference_input_type = tf.uint8
+        converter.inference_output_type = tf.uint8
+        with open('model_step.tflite', 'wb') as f:
+            f.write(converter.convert())
+        export_c_array('model_step.tflite', 'model_step.cc')
+    elif os.path.exists('../src/models/model_step.cc'):
+        # It would not match the model above
+        os.remove('../src/models/model_step.cc')
 
     #metrics = history.history
     #plt.figure(figsize=(16,6))
@@ -257,7 +412,76 @@ if not os.path.exists('model.keras'):
     plt.show()
 
 else:
-    model = tf.keras.models.load_model('model.keras')
+    model = tf.keras.models.load_model(MODEL_FILE)
+
+# Pooling of speech::wake_detector, in frames and bins
+WAKE_POOL = (4, 8)
+
+def pool_for_wake(spectrogram):
+    """
+    Features of the wake detector, computed like on the device: magnitudes
+    scaled to 8 bits as by frontend::quantize(), without the Nyquist bin,
+    averaged over WAKE_POOL.
+    """
+    x = tf.clip_by_value(spectrogram[:, :, :128, :] * 8.0, 0.0, 255.0)
+    return tf.nn.avg_pool2d(x, ksize=WAKE_POOL, strides=WAKE_POOL,
+                            padding='VALID')
+
+def make_wake_ds(ds):
+    """
+    Keywords are positives. The dataset has no background recordings, so
+    the negatives are noise at random levels, as many as there are keywords.
+    """
+    def add_negatives(audio, label):
+        n = tf.shape(audio)[0]
+        level = tf.pow(10.0, tf.random.uniform([n, 1], -4.0, -1.0))
+        noise = tf.random.normal(tf.shape(audio)) * level
+        audio = tf.concat([audio, noise], 0)
+        target = tf.concat([tf.ones([n]), tf.zeros([n])], 0)
+        return pool_for_wake(get_spectrogram(audio)), target
+    return ds.map(add_negatives, num_parallel_calls=tf.data.AUTOTUNE)
+
+if args.wake and not os.path.exists('model_wake.keras'):
+    wake_train_ds = make_wake_ds(train_ds).cache().prefetch(tf.data.AUTOTUNE)
+    wake_val_ds = make_wake_ds(val_ds).cache().prefetch(tf.data.AUTOTUNE)
+    wake_shape = wake_train_ds.element_spec[0].shape[1:]
+
+    # A thousand parameters or so, cheap enough to run on every row
+    wake = models.Sequential([
+        layers.Input(shape=wake_shape),
+        layers.Conv2D(8, 3, activation='relu'),
+        layers.MaxPooling2D(),
+        layers.Conv2D(8, 3, activation='relu'),
+        layers.Flatten(),
+        layers.Dense(1, activation='sigmoid'),
+    ])
+    wake.summary()
+    wake.compile(
+        optimizer=tf.keras.optimizers.Adam(),
+        loss=tf.keras.losses.BinaryCrossentropy(),
+        metrics=['accuracy', tf.keras.metrics.Recall()],
+    )
+    wake.fit(
+        wake_train_ds,
+        validation_data=wake_val_ds,
+        epochs=10,
+        callbacks=tf.keras.callbacks.EarlyStopping(verbose=1, patience=2),
+    )
+    wake.save('model_wake.keras')
+
+    def representative_wake():
+        for input_value, _ in wake_train_ds.take(100):
+            yield [input_value]
+
+    converter = tf.lite.TFLiteConverter.from_keras_model(wake)
+    converter.optimizations = [tf.lite.Optimize.DEFAULT]
+    converter.representative_dataset = representative_wake
+    converter.target_spec.supported_ops = [tf.lite.OpsSet.TFLITE_BUILTINS_INT8]
+    converter.inference_input_type = tf.uint8
+    converter.inference_output_type = tf.uint8
+    with open('model_wake.tflite', 'wb') as f:
+        f.write(converter.convert())
+    export_c_array('model_wake.tflite', 'model_wake.cc')
 
 # ## Run inference on an audio file
 
@@ -291,7 +515,13 @@ spec = np.array(x)
 # first. However, due to memory and performance contraints this is difficult
 # to reproduce on the microcontroller, and just multiplying by 256 seem to
 # work well enough
-preprocessed_input_data = (spec * 256).astype('uint8')
+if args.int8_io:
+    # Quantized like frontend::quantize() does for int8 inputs
+    scale, zero_point = interpreter.get_input_details()[0]['quantization']
+    preprocessed_input_data = np.clip(np.round(spec / scale) + zero_point,
+                                      -128, 127).astype('int8')
+else:
+    preprocessed_input_data = (spec * 256).astype('uint8')
 
 with open('sample_input.bin', 'wb') as f:
     f.write(preprocessed_input_data)
@@ -0,0 +1,103 @@
+/**
+ * @file adpcm.c
+ * @brief IMA-ADPCM decoder for compressed audio transfers
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include "adpcm.h"
+
+static const int8_t adpcm_index_table[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+static const int16_t adpcm_step_table[89] = {
+	7,     8,     9,     10,    11,    12,    13,    14,    16,
+	17,    19,    21,    23,    25,    28,    31,    34,    37,
+	41,    45,    50,    55,    60,    66,    73,    80,    88,
+	97,    107,   118,   130,   143,   157,   173,   190,   209,
+	230,   253,   279,   307,   337,   371,   408,   449,   494,
+	544,   598,   658,   724,   796,   876,   963,   1060,  1166,
+	1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,
+	3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,
+	7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899, 15289,
+	16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+void adpcm_init(struct adpcm_state *state,
+		const uint8_t preamble[ADPCM_PREAMBLE_LEN])
+{
+	state->predictor = (int16_t)(preamble[0] | (preamble[1] << 8));
+	state->index = preamble[2];
+	if (state->index > 88) {
+		state->index = 88;
+	}
+}
+
+static int16_t adpcm_decode_nibble(struct adpcm_state *state, uint8_t nibble)
+{
+	int32_t step = adpcm_step_table[state->index];
+
+	int32_t diff = step >> 3;
+	if (nibble & 4) {
+		diff += step;
+	}
+	if (nibble & 2) {
+		diff += step >> 1;
+	}
+	if (nibble & 1) {
+		diff += step >> 2;
+	}
+	if (nibble & 8) {
+		state->predictor -= diff;
+	} else {
+		state->predictor += diff;
+	}
+
+	if (state->predictor > INT16_MAX) {
+		state->predictor = INT16_MAX;
+	} else if (state->predictor < INT16_MIN) {
+		state->predictor = INT16_MIN;
+	}
+
+	state->index += adpcm_index_table[nibble];
+	if (state->index < 0) {
+		state->index = 0;
+	} else if (state->index > 88) {
+		state->index = 88;
+	}
+	return (int16_t)state->predictor;
+}
+
+void adpcm_decode(struct adpcm_state *state, const uint8_t *in, size_t len,
+		  int16_t *out)
+{
+	for (size_t i = 0; i < len; i++) {
+		*out++ = adpcm_decode_nibble(state, in[i] & 0x0f);
+		*out++ = adpcm_decode_nibble(state, in[i] >> 4);
+	}
+}
@@ -0,0 +1,143 @@
+/**
+ * @file capture.c
+ * @brief Capture profiles turning DFSDM output into 16 kHz int16 audio
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <dsp/basic_math_functions.h>
+#include <dsp/filtering_functions.h>
+#include <dsp/support_functions.h>
+
+#include "stm32l4xx_hal.h"
+#include "capture.h"
+
+/* Input samples handled per filter call, bounds the state buffers */
+#define CAPTURE_BLOCK 128
+
+#define CAPTURE_FIR_TAPS 31
+
+static const struct capture_config capture_configs[] = {
+	[CAPTURE_PROFILE_FILTER_16K] = {
+		.sinc_order = DFSDM_FILTER_SINC3_ORDER,
+		.oversampling = 50,
+		.int_oversampling = 4,
+		.decimation = 1,
+		.sample_rate = 16000,
+		.input_shift = 14,
+		.gain_shift = 0,
+	},
+	[CAPTURE_PROFILE_DECIMATE_16K] = {
+		.sinc_order = DFSDM_FILTER_SINC2_ORDER,
+		.oversampling = 25,
+		.int_oversampling = 4,
+		.decimation = 2,
+		.sample_rate = 16000,
+		.input_shift = 21,
+		.gain_shift = 0,
+	},
+};
+
+/* Hamming windowed sinc, 7 kHz cut-off at 32 kHz */
+static const q31_t capture_fir_coeffs[CAPTURE_FIR_TAPS] = {
+	3568799,    1679403,    -5226334,   -6748079,  8001249,   19540086,
+	-5883888,   -41951857,  -11182163,  71662510,  58372610,  -102251076,
+	-172480410, 125353011,  662423455,  937729017, 662423455, 125353011,
+	-172480410, -102251076, 58372610,   71662510,  -11182163, -41951857,
+	-5883888,   19540086,   8001249,    -6748079,  -5226334,  1679403,
+	3568799,
+};
+
+/* y[n] = x[n] - x[n-1] + 0.995 y[n-1], halved for Q31 and a post shift of 1 */
+static const q31_t capture_dc_coeffs[5] = {
+	0x40000000, -0x40000000, 0, 0x3FAE147B, 0,
+};
+
+static const struct capture_config *capture_cfg =
+	&capture_configs[CAPTURE_PROFILE];
+static arm_fir_decimate_instance_q31 capture_fir;
+static q31_t capture_fir_state[CAPTURE_FIR_TAPS + CAPTURE_BLOCK - 1];
+static arm_biquad_casd_df1_inst_q31 capture_dc;
+static q31_t capture_dc_state[4];
+
+const struct capture_config *capture_init(enum capture_profile profile)
+{
+	capture_cfg = &capture_configs[profile];
+	if (capture_cfg->decimation > 1) {
+		arm_fir_decimate_init_q31(&capture_fir, CAPTURE_FIR_TAPS,
+					  capture_cfg->decimation,
+					  capture_fir_coeffs, capture_fir_state,
+					  CAPTURE_BLOCK);
+	}
+	arm_biquad_cascade_df1_init_q31(&capture_dc, 1, capture_dc_coeffs,
+					capture_dc_state, 1);
+	return capture_cfg;
+}
+
+uint32_t capture_sample_rate(void)
+{
+	return capture_cfg->sample_rate;
+}
+
+size_t capture_process(const int32_t *in, size_t len, int16_t *out)
+{
+	size_t produced = 0;
+
+	while (len > 0) {
+		q31_t buf[CAPTURE_BLOCK];
+		size_t n = (len < CAPTURE_BLOCK) ? len : CAPTURE_BLOCK;
+
+		// 24 bit result in the upper bits of the data register
+		const int32_t limit = INT32_MAX >> capture_cfg->input_shift;
+		for (size_t i = 0; i < n; i++) {
+			int32_t sample = in[i] >> 8;
+			if (sample > limit) {
+				sample = limit;
+			} else if (sample < -limit) {
+				sample = -limit;
+			}
+			buf[i] = sample << capture_cfg->input_shift;
+		}
+
+		size_t m = n;
+		if (capture_cfg->decimation > 1) {
+			m = n / capture_cfg->decimation;
+			q31_t decimated[CAPTURE_BLOCK];
+			arm_fir_decimate_q31(&capture_fir, buf, decimated, n);
+			arm_copy_q31(decimated, buf, m);
+		}
+
+		arm_biquad_cascade_df1_q31(&capture_dc, buf, buf, m);
+		arm_shift_q31(buf, capture_cfg->gain_shift, buf, m);
+		arm_q31_to_q15(buf, out + produced, m);
+
+		produced += m;
+		in += n;
+		len -= n;
+	}
+	return produced;
+}
@@ -0,0 +1,274 @@
+/**
+ * @file classifier.cc
+ * @brief Keyword classifier running a TFLite model
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cassert>
+#include <new>
+
+#include "classifier.h"
+
+const char *const speech::classifier::labels[num_labels] = {
+	"DOWN", "LEFT", "NO", "RIGHT", "UP", "YES"
+};
+
+size_t speech::num_elements(const tflite::Tensor *tensor)
+{
+	if (tensor->shape() == nullptr) {
+		return 0;
+	}
+	size_t n = 1;
+	for (size_t i = 0; i < tensor->shape()->size(); i++) {
+		int32_t dim = tensor->shape()->Get(i);
+		// Batch dimension may be dynamic
+		n *= (dim > 0) ? dim : 1;
+	}
+	return n;
+}
+
+/**
+ * @brief Every index refers to a tensor of the subgraph
+ * @param optional whether -1 may stand for an input left out
+ */
+static bool valid_indices(const flatbuffers::Vector<int32_t> *indices,
+			  size_t num_tensors, bool optional)
+{
+	if (indices == nullptr) {
+		return false;
+	}
+	for (size_t i = 0; i < indices->size(); i++) {
+		int32_t index = indices->Get(i);
+		if ((index >= (int32_t)num_tensors) ||
+		    ((index < 0) && !((index == -1) && optional))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const tflite::SubGraph *speech::model_subgraph(const uint8_t *buf, size_t len)
+{
+	if (!tflite::ModelBufferHasIdentifier(buf)) {
+		return nullptr;
+	}
+	flatbuffers::Verifier verifier(buf, len);
+	if (!tflite::VerifyModelBuffer(verifier)) {
+		return nullptr;
+	}
+
+	const tflite::Model *model = tflite::GetModel(buf);
+	if ((model->version() != TFLITE_SCHEMA_VERSION) ||
+	    (model->subgraphs() == nullptr) ||
+	    (model->subgraphs()->size() < 1) ||
+	    (model->operator_codes() == nullptr) ||
+	    (model->buffers() == nullptr)) {
+		return nullptr;
+	}
+
+	// The verifier only checks the structure, not what the indices
+	// point to, nor which of the optional fields are there
+	const tflite::SubGraph *subgraph = model->subgraphs()->Get(0);
+	if ((subgraph == nullptr) || (subgraph->tensors() == nullptr) ||
+	    (subgraph->operators() == nullptr)) {
+		return nullptr;
+	}
+	const size_t num_tensors = subgraph->tensors()->size();
+	if (!valid_indices(subgraph->inputs(), num_tensors, false) ||
+	    !valid_indices(subgraph->outputs(), num_tensors, false)) {
+		return nullptr;
+	}
+	for (size_t i = 0; i < subgraph->operators()->size(); i++) {
+		const tflite::Operator *op = subgraph->operators()->Get(i);
+		if ((op == nullptr) ||
+		    (op->opcode_index() >= model->operator_codes()->size()) ||
+		    !valid_indices(op->inputs(), num_tensors, true) ||
+		    !valid_indices(op->outputs(), num_tensors, true)) {
+			return nullptr;
+		}
+	}
+	for (size_t i = 0; i < num_tensors; i++) {
+		const tflite::Tensor *tensor = subgraph->tensors()->Get(i);
+		if ((tensor == nullptr) ||
+		    (tensor->buffer() >= model->buffers()->size())) {
+			return nullptr;
+		}
+		// Quantized tensors need their parameters, e.g. for score()
+		bool quantized = (tensor->type() == tflite::TensorType_INT8) ||
+				 (tensor->type() == tflite::TensorType_UINT8);
+		const tflite::QuantizationParameters *q = tensor->quantization();
+		if (quantized &&
+		    ((q == nullptr) || (q->scale() == nullptr) ||
+		     (q->scale()->size() < 1) || (q->zero_point() == nullptr) ||
+		     (q->zero_point()->size() < 1))) {
+			return nullptr;
+		}
+	}
+	return subgraph;
+}
+
+speech::classifier::classifier(uint8_t *arena, size_t arena_size,
+			       tflite::MicroProfilerInterface *profiler)
+	: arena(arena)
+	, arena_size(arena_size)
+	, profiler(profiler)
+{
+	if (resolver.AddRelu() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddConv2D() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddMaxPool2D() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddReshape() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddFullyConnected() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddSoftmax() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddResizeBilinear() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+#ifndef INT8_IO
+	// Converts the uint8 input and output of the model
+	if (resolver.AddQuantize() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+#endif
+}
+
+speech::classifier::~classifier()
+{
+	this->unload();
+}
+
+bool speech::classifier::validate(const uint8_t *buf, size_t len)
+{
+	const tflite::SubGraph *subgraph = speech::model_subgraph(buf, len);
+	if (subgraph == nullptr) {
+		return false;
+	}
+	if ((subgraph->inputs()->size() != 1) ||
+	    (subgraph->outputs()->size() != 1)) {
+		return false;
+	}
+	const tflite::Tensor *input =
+		subgraph->tensors()->Get(subgraph->inputs()->Get(0));
+	const tflite::Tensor *output =
+		subgraph->tensors()->Get(subgraph->outputs()->Get(0));
+
+#ifdef INT8_IO
+	const tflite::TensorType io_type = tflite::TensorType_INT8;
+#else
+	const tflite::TensorType io_type = tflite::TensorType_UINT8;
+#endif
+	return (input->type() == io_type) && (output->type() == io_type) &&
+	       (num_elements(input) == input_frames * input_bins) &&
+	       (num_elements(output) == num_labels);
+}
+
+void speech::classifier::unload()
+{
+	if (this->interp != nullptr) {
+		this->interp->~MicroInterpreter();
+		this->interp = nullptr;
+	}
+	this->current = nullptr;
+}
+
+bool speech::classifier::load(const uint8_t *buf)
+{
+	this->unload();
+
+	const tflite::Model *model = tflite::GetModel(buf);
+	this->interp = new (this->storage)
+		tflite::MicroInterpreter(model, this->resolver, this->arena,
+					 this->arena_size, nullptr,
+					 this->profiler);
+	if (this->interp->AllocateTensors() != kTfLiteOk) {
+		this->unload();
+		return false;
+	}
+	this->current = model;
+	return true;
+}
+
+bool speech::classifier::loaded() const
+{
+	return this->current != nullptr;
+}
+
+const tflite::Model *speech::classifier::model() const
+{
+	return this->current;
+}
+
+size_t speech::classifier::arena_used() const
+{
+	return this->loaded() ? this->interp->arena_used_bytes() : 0;
+}
+
+size_t speech::classifier::arena_capacity() const
+{
+	return this->arena_size;
+}
+
+tflite::MicroInterpreter &speech::classifier::interpreter()
+{
+	return *this->interp;
+}
+
+TfLiteTensor *speech::classifier::input()
+{
+	return this->interp->input(0);
+}
+
+TfLiteTensor *speech::classifier::output()
+{
+	return this->interp->output(0);
+}
+
+bool speech::classifier::invoke()
+{
+	return this->interp->Invoke() == kTfLiteOk;
+}
+
+uint8_t speech::classifier::score(size_t label)
+{
+#ifdef INT8_IO
+	// Same scale as a uint8 output, whose zero point is 128 higher
+	return (uint8_t)(this->output()->data.int8[label] + 128);
+#else
+	return this->output()->data.uint8[label];
+#endif
+}
@@ -32,36 +32,145 @@
 #include "clock.h"
 #include "error.h"
 #include "stm32l4xx_hal.h"
+#include "trace.h"
 
-void SystemClock_Config(void)
+struct clock_profile_config {
+	uint32_t plln;
+	uint32_t pllr;
+	uint32_t latency;
+	uint32_t voltage;
+};
+
+/* MSI 4 MHz into the PLL, VCO at most 128 MHz in range 2 */
+static const struct clock_profile_config clock_profiles[] = {
+	[CLOCK_PROFILE_LOW] = {
+		.plln = 32,
+		.pllr = RCC_PLLR_DIV8,
+		.latency = FLASH_LATENCY_2,
+		.voltage = PWR_REGULATOR_VOLTAGE_SCALE2,
+	},
+	[CLOCK_PROFILE_BOOST] = {
+		.plln = 40,
+		.pllr = RCC_PLLR_DIV2,
+		.latency = FLASH_LATENCY_4,
+		.voltage = PWR_REGULATOR_VOLTAGE_SCALE1,
+	},
+};
+
+static enum clock_profile clock_profile = CLOCK_PROFILE_BOOST;
+
+static void clock_config_pll(const struct clock_profile_config *config)
 {
-	RCC_ClkInitTypeDef RCC_ClkInitStruct = { 0 };
 	RCC_OscInitTypeDef RCC_OscInitStruct = { 0 };
 
-	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_MSI;
-	RCC_OscInitStruct.MSIState = RCC_MSI_ON;
-	RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_6;
-	RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
 	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
 	RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_MSI;
 	RCC_OscInitStruct.PLL.PLLM = 1;
-	RCC_OscInitStruct.PLL.PLLN = 40;
-	RCC_OscInitStruct.PLL.PLLR = 2;
+	RCC_OscInitStruct.PLL.PLLN = config->plln;
+	RCC_OscInitStruct.PLL.PLLR = config->pllr;
 	RCC_OscInitStruct.PLL.PLLP = 7;
 	RCC_OscInitStruct.PLL.PLLQ = 4;
 	if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
-		ERR("Configuring oscillator failed.\n");
+		ERR("Configuring PLL failed.\n");
 	}
+}
+
+static void clock_select_sysclk(uint32_t source, uint32_t latency)
+{
+	RCC_ClkInitTypeDef RCC_ClkInitStruct = { 0 };
 
 	RCC_ClkInitStruct.ClockType =
 		(RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_HCLK |
 		 RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2);
-	RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+	RCC_ClkInitStruct.SYSCLKSource = source;
 	RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
 	RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
 	RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_4) !=
-	    HAL_OK) {
+	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, latency) != HAL_OK) {
 		ERR("Configuring clocks failed.\n");
 	}
 }
+
+void SystemClock_Config(void)
+{
+	RCC_OscInitTypeDef RCC_OscInitStruct = { 0 };
+	RCC_PeriphCLKInitTypeDef RCC_PeriphClkInit = { 0 };
+
+	__HAL_RCC_PWR_CLK_ENABLE();
+
+	/* HSI16 clocks USART1 whatever SYSCLK is */
+	RCC_OscInitStruct.OscillatorType =
+		RCC_OSCILLATORTYPE_MSI | RCC_OSCILLATORTYPE_HSI;
+	RCC_OscInitStruct.MSIState = RCC_MSI_ON;
+	RCC_OscInitStruct.MSIClockRange = RCC_MSIRANGE_6;
+	RCC_OscInitStruct.MSICalibrationValue = RCC_MSICALIBRATION_DEFAULT;
+	RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+	RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
+	if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK) {
+		ERR("Configuring oscillator failed.\n");
+	}
+
+	const struct clock_profile_config *boost =
+		&clock_profiles[CLOCK_PROFILE_BOOST];
+	if (HAL_PWREx_ControlVoltageScaling(boost->voltage) != HAL_OK) {
+		ERR("Configuring voltage range failed.\n");
+	}
+	clock_config_pll(boost);
+	clock_select_sysclk(RCC_SYSCLKSOURCE_PLLCLK, boost->latency);
+	clock_profile = CLOCK_PROFILE_BOOST;
+
+	/* SAI1 clock for the DFSDM output clock: 4 MHz * 28 / 7 = 16 MHz */
+	RCC_PeriphClkInit.PeriphClockSelection =
+		RCC_PERIPHCLK_SAI1 | RCC_PERIPHCLK_USART1;
+	RCC_PeriphClkInit.Sai1ClockSelection = RCC_SAI1CLKSOURCE_PLLSAI1;
+	RCC_PeriphClkInit.Usart1ClockSelection = RCC_USART1CLKSOURCE_HSI;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1Source = RCC_PLLSOURCE_MSI;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1M = 1;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1N = 28;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1P = RCC_PLLP_DIV7;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1Q = RCC_PLLQ_DIV2;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1R = RCC_PLLR_DIV2;
+	RCC_PeriphClkInit.PLLSAI1.PLLSAI1ClockOut = RCC_PLLSAI1_SAI1CLK;
+	if (HAL_RCCEx_PeriphCLKConfig(&RCC_PeriphClkInit) != HAL_OK) {
+		ERR("Configuring peripheral clocks failed.\n");
+	}
+}
+
+void clock_set_profile(enum clock_profile profile)
+{
+	if (profile == clock_profile) {
+		return;
+	}
+	const struct clock_profile_config *config = &clock_profiles[profile];
+	trace_begin(TRACE_CLOCK, SystemCoreClock);
+
+	/* More voltage before the frequency goes up */
+	if ((profile == CLOCK_PROFILE_BOOST) &&
+	    (HAL_PWREx_ControlVoltageScaling(config->voltage) != HAL_OK)) {
+		ERR("Configuring voltage range failed.\n");
+	}
+
+	/* The PLL can only be changed while it does not drive SYSCLK. HSI16
+	 * is on for USART1 anyway and keeps PCLK2, the DFSDM kernel clock,
+	 * above 12.8 MHz meanwhile. Same frequency as the low profile, so its
+	 * latency fits in either voltage range. */
+	clock_select_sysclk(RCC_SYSCLKSOURCE_HSI,
+			    clock_profiles[CLOCK_PROFILE_LOW].latency);
+	clock_config_pll(config);
+	clock_select_sysclk(RCC_SYSCLKSOURCE_PLLCLK, config->latency);
+
+	/* Less voltage once the frequency is down */
+	if ((profile == CLOCK_PROFILE_LOW) &&
+	    (HAL_PWREx_ControlVoltageScaling(config->voltage) != HAL_OK)) {
+		ERR("Configuring voltage range failed.\n");
+	}
+	clock_profile = profile;
+	trace_end(TRACE_CLOCK, SystemCoreClock);
+}
+
+enum clock_profile clock_get_profile(void)
+{
+	return clock_profile;
+}
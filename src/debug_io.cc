@@ -1,5 +1,5 @@
 /**
- * @file debug_io.c
+ * @file debug_io.cc
  * @brief Initializes UART to be used as a debug UART port.
  */
 
@@ -28,24 +28,35 @@
  *
  */
 
+#include <unistd.h>
+
+#include "spsc_ring.h"
+
+extern "C" {
 #include "debug_io.h"
+#include "event.h"
 #include "stm32l4xx_hal.h"
-
-#include <unistd.h>
+#include "trace.h"
 
 UART_HandleTypeDef uart_hd_debug_uart;
 
-#define UART_RX_FIFO_SIZE 16
-volatile static uint8_t uart_rx_fifo[UART_RX_FIFO_SIZE];
-volatile static uint8_t uart_rx_fifo_enqueue = 0;
-volatile static uint8_t uart_rx_fifo_dequeue = 0;
-volatile static uint32_t uart_rx_fifo_count = 0;
+int _write(int fd, const void *buf, int cnt);
+int _read(int fd, uint8_t *buf, int cnt);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *uart_hd);
+void USART1_IRQHandler(void);
+}
+
+/* Large enough to buffer a batch window while inference runs, see serial.c.
+ * Filled by the receive interrupt, emptied by _read(). */
+static speech::spsc_ring<uint8_t, UART_RX_FIFO_SIZE> uart_rx_fifo;
+static uint8_t uart_rx_byte;
 
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *uart_hd)
 {
-	uart_rx_fifo_enqueue = (uart_rx_fifo_enqueue + 1) % UART_RX_FIFO_SIZE;
-	uart_rx_fifo_count++;
-	HAL_UART_Receive_IT(uart_hd, (uint8_t*)uart_rx_fifo + uart_rx_fifo_enqueue, 1);
+	/* Dropped if full, the protocol never sends that much ahead */
+	uart_rx_fifo.push(uart_rx_byte);
+	event_signal(EVENT_UART_RX);
+	HAL_UART_Receive_IT(uart_hd, &uart_rx_byte, 1);
 }
 
 /* attach the _read,_write syscall to debug UART */
@@ -59,7 +70,7 @@ int _write(int fd, const void *buf, int cnt)
 #ifndef CONFIG_DEBUG_NOCR
 		/* check whether the last character was a newline,
          * and add a carriage return if it is */
-		if (*(uint8_t *)(buf + cnt - 1) == '\n') {
+		if (((const uint8_t *)buf)[cnt - 1] == '\n') {
 			_write(fd, "\r", 1);
 		}
 #endif
@@ -67,33 +78,38 @@ int _write(int fd, const void *buf, int cnt)
 	return cnt;
 }
 
+int uart_debug_write_raw(const void *buf, size_t len)
+{
+	if (HAL_UART_Transmit(&uart_hd_debug_uart, (uint8_t *)buf, len, 100) !=
+	    HAL_OK) {
+		return -1;
+	}
+	return len;
+}
+
+size_t uart_debug_available(void)
+{
+	return uart_rx_fifo.size();
+}
+
 int _read(int fd, uint8_t *buf, int cnt)
 {
-	size_t start = HAL_GetTick();
-	const size_t timeout = 500;
+	uint32_t start = HAL_GetTick();
+	const uint32_t timeout = 500;
 
 	if (fd != STDIN_FILENO){
 		return 0;
 	}
-	/* wait as long as fifo is empty or timeout expires */
-	while (uart_rx_fifo_count == 0){
-		if ((HAL_GetTick() - start) > timeout){
+	/* sleep as long as fifo is empty or timeout expires */
+	while (uart_rx_fifo.empty()){
+		uint32_t elapsed = HAL_GetTick() - start;
+		if (elapsed > timeout){
 			return 0;
 		}
+		event_wait(EVENT_UART_RX, timeout - elapsed + 1);
 	}
 
-	int i = 0;
-	while (uart_rx_fifo_count > 0) {
-		// Read at the dequeue index
-		buf[i++] = uart_rx_fifo[uart_rx_fifo_dequeue];
-		uart_rx_fifo_dequeue =
-			(uart_rx_fifo_dequeue + 1) % UART_RX_FIFO_SIZE;
-		uart_rx_fifo_count--;
-		if (i == cnt) {
-			break;
-		}
-	}
-	return i;
+	return uart_rx_fifo.pop(buf, cnt);
 }
 
 int uart_debug_init()
@@ -136,15 +152,42 @@ int uart_debug_init()
 	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
 	__HAL_UART_ENABLE_IT(&uart_hd_debug_uart, UART_IT_RXNE);
-	HAL_NVIC_SetPriority(USART1_IRQn, 10, 10);
+	/* Above every task, a long inference must not lose a byte */
+	HAL_NVIC_SetPriority(USART1_IRQn, 1, 0);
 	HAL_NVIC_EnableIRQ(USART1_IRQn);
 
-	HAL_UART_Receive_IT(&uart_hd_debug_uart, (uint8_t*)uart_rx_fifo +
-			uart_rx_fifo_enqueue, 1);
+	HAL_UART_Receive_IT(&uart_hd_debug_uart, &uart_rx_byte, 1);
+	return 0;
+}
+
+int uart_debug_set_baudrate(uint32_t baudrate)
+{
+	/* Let the last character go out at the old rate */
+	while (__HAL_UART_GET_FLAG(&uart_hd_debug_uart, UART_FLAG_TC) ==
+	       RESET)
+		;
+	__HAL_UART_DISABLE(&uart_hd_debug_uart);
+	uart_hd_debug_uart.Init.BaudRate = baudrate;
+	/* USART1 is clocked from HSI16, see clock.c */
+	const uint32_t clk = HSI_VALUE;
+	if (clk < 64 * baudrate) {
+		/* 16x oversampling is too coarse, e.g. 2 % off at 921600 */
+		uint32_t div = (2 * clk + baudrate / 2) / baudrate;
+		uart_hd_debug_uart.Init.OverSampling = UART_OVERSAMPLING_8;
+		USART1->CR1 |= USART_CR1_OVER8;
+		USART1->BRR = (div & 0xfff0) | ((div & 0xf) >> 1);
+	} else {
+		uart_hd_debug_uart.Init.OverSampling = UART_OVERSAMPLING_16;
+		USART1->CR1 &= ~USART_CR1_OVER8;
+		USART1->BRR = (clk + baudrate / 2) / baudrate;
+	}
+	__HAL_UART_ENABLE(&uart_hd_debug_uart);
 	return 0;
 }
 
 void USART1_IRQHandler()
 {
+	trace_begin(TRACE_IRQ_UART, 0);
 	HAL_UART_IRQHandler(&uart_hd_debug_uart);
+	trace_end(TRACE_IRQ_UART, 0);
 }
@@ -30,6 +30,7 @@
  */
 
 #include "stm32l4xx_hal.h"
+#include "capture.h"
 #include "dfsdm.h"
 #include "dma.h"
 #include "error.h"
@@ -41,24 +42,49 @@ DFSDM_Channel_HandleTypeDef hdfsdm1_channel2;
 static uint32_t HAL_RCC_DFSDM1_CLK_ENABLED = 0;
 static uint32_t DFSDM1_Init = 0;
 
-void dfsdm_init(void)
+static int32_t *dfsdm_buf;
+static size_t dfsdm_buf_len;
+static dfsdm_callback_t dfsdm_callback;
+
+void dfsdm_set_callback(int32_t *buf, size_t len, dfsdm_callback_t callback)
+{
+	dfsdm_buf = buf;
+	dfsdm_buf_len = len;
+	dfsdm_callback = callback;
+}
+
+void dfsdm_deinit(void)
+{
+	HAL_DFSDM_FilterRegularStop_DMA(&hdfsdm1_filter0);
+	if (HAL_DFSDM_FilterDeInit(&hdfsdm1_filter0) != HAL_OK) {
+		ERR("Failed to deinitialize DFSDM filter 0\n");
+	}
+	if (HAL_DFSDM_ChannelDeInit(&hdfsdm1_channel2) != HAL_OK) {
+		ERR("Failed to deinitialize DFSDM channel 2\n");
+	}
+	dfsdm_callback = NULL;
+}
+
+void dfsdm_init(const struct capture_config *config)
 {
 	hdfsdm1_filter0.Instance = DFSDM1_Filter0;
 	hdfsdm1_filter0.Init.RegularParam.Trigger = DFSDM_FILTER_SW_TRIGGER;
 	hdfsdm1_filter0.Init.RegularParam.FastMode = DISABLE;
 	hdfsdm1_filter0.Init.RegularParam.DmaMode = ENABLE;
-	hdfsdm1_filter0.Init.FilterParam.SincOrder = DFSDM_FILTER_SINC2_ORDER;
-	hdfsdm1_filter0.Init.FilterParam.Oversampling = 25;
-	hdfsdm1_filter0.Init.FilterParam.IntOversampling = 4;
+	hdfsdm1_filter0.Init.FilterParam.SincOrder = config->sinc_order;
+	hdfsdm1_filter0.Init.FilterParam.Oversampling = config->oversampling;
+	hdfsdm1_filter0.Init.FilterParam.IntOversampling =
+		config->int_oversampling;
 	if (HAL_DFSDM_FilterInit(&hdfsdm1_filter0) != HAL_OK) {
 		ERR("Failed to initialize DFSDM filter 0\n");
 	}
 	hdfsdm1_channel2.Instance = DFSDM1_Channel2;
 	hdfsdm1_channel2.Init.OutputClock.Activation = ENABLE;
+	/* SAI1 clock from PLLSAI1, independent of the clock profile */
 	hdfsdm1_channel2.Init.OutputClock.Selection =
-		DFSDM_CHANNEL_OUTPUT_CLOCK_SYSTEM;
+		DFSDM_CHANNEL_OUTPUT_CLOCK_AUDIO;
 	hdfsdm1_channel2.Init.OutputClock.Divider =
-		25; /* 80 MHz / 25 = 3.2 MHz */
+		5; /* 16 MHz / 5 = 3.2 MHz */
 	hdfsdm1_channel2.Init.Input.Multiplexer = DFSDM_CHANNEL_EXTERNAL_INPUTS;
 	hdfsdm1_channel2.Init.Input.DataPacking = DFSDM_CHANNEL_STANDARD_MODE;
 	hdfsdm1_channel2.Init.Input.Pins = DFSDM_CHANNEL_SAME_CHANNEL_PINS;
@@ -226,8 +252,19 @@ void HAL_DFSDM_ChannelMspDeInit(DFSDM_Channel_HandleTypeDef *hdfsdm_channel)
 	}
 }
 
+void HAL_DFSDM_FilterRegConvHalfCpltCallback(
+	DFSDM_Filter_HandleTypeDef *hdfsdm_filter)
+{
+	if (dfsdm_callback != NULL) {
+		dfsdm_callback(dfsdm_buf, dfsdm_buf_len / 2);
+	}
+}
+
 void HAL_DFSDM_FilterRegConvCpltCallback(
 	DFSDM_Filter_HandleTypeDef *hdfsdm_filter)
 {
-	dfsdm_conversion_done = 1;
+	if (dfsdm_callback != NULL) {
+		dfsdm_callback(dfsdm_buf + dfsdm_buf_len / 2,
+			       dfsdm_buf_len / 2);
+	}
 }
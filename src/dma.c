@@ -31,12 +31,23 @@
 
 #include "stm32l4xx_hal.h"
 #include "dma.h"
+#include "trace.h"
 
 DMA_HandleTypeDef hdma_dfsdm1_flt0;
+DMA_HandleTypeDef hdma_usart1_tx;
 
 void DMA1_Channel4_IRQHandler(void)
 {
+	trace_begin(TRACE_IRQ_MIC, 0);
 	HAL_DMA_IRQHandler(&hdma_dfsdm1_flt0);
+	trace_end(TRACE_IRQ_MIC, 0);
+}
+
+void DMA2_Channel6_IRQHandler(void)
+{
+	trace_begin(TRACE_IRQ_UART_TX, 0);
+	HAL_DMA_IRQHandler(&hdma_usart1_tx);
+	trace_end(TRACE_IRQ_UART_TX, 0);
 }
 
 /**
@@ -48,3 +59,29 @@ void dma_init(void)
 	HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 0, 0);
 	HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
 }
+
+/**
+  * Set up DMA for USART1 TX, DMA1 channel 4 is taken by the DFSDM
+  */
+int dma_uart_tx_init(UART_HandleTypeDef *uart_hd)
+{
+	__HAL_RCC_DMA2_CLK_ENABLE();
+
+	hdma_usart1_tx.Instance = DMA2_Channel6;
+	hdma_usart1_tx.Init.Request = DMA_REQUEST_2;
+	hdma_usart1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdma_usart1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_usart1_tx.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_usart1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma_usart1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma_usart1_tx.Init.Mode = DMA_NORMAL;
+	hdma_usart1_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+	if (HAL_DMA_Init(&hdma_usart1_tx) != HAL_OK) {
+		return -1;
+	}
+	__HAL_LINKDMA(uart_hd, hdmatx, hdma_usart1_tx);
+
+	HAL_NVIC_SetPriority(DMA2_Channel6_IRQn, 10, 0);
+	HAL_NVIC_EnableIRQ(DMA2_Channel6_IRQn);
+	return 0;
+}
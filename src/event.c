@@ -0,0 +1,79 @@
+/**
+ * @file event.c
+ * @brief Sleep until an interrupt has something for the main loop
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include "stm32l4xx_hal.h"
+#include "event.h"
+#include "trace.h"
+
+static volatile uint32_t event_pending;
+
+void event_init(void)
+{
+#ifdef DEBUG
+	/* Keep the debugger attached while the core sleeps */
+	HAL_DBGMCU_EnableDBGSleepMode();
+#endif
+	HAL_PWR_DisableSleepOnExit();
+}
+
+void event_signal(uint32_t events)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	event_pending |= events;
+	__set_PRIMASK(primask);
+}
+
+uint32_t event_wait(uint32_t mask, uint32_t timeout)
+{
+	uint32_t start = HAL_GetTick();
+	while (1) {
+		__disable_irq();
+		uint32_t events = event_pending & mask;
+		if (events != 0) {
+			event_pending &= ~events;
+			__enable_irq();
+			return events;
+		}
+		if ((timeout != EVENT_WAIT_FOREVER) &&
+		    (HAL_GetTick() - start >= timeout)) {
+			__enable_irq();
+			return 0;
+		}
+		/* An interrupt pending since the check above still ends the
+		 * sleep with interrupts disabled, it runs right after. SysTick
+		 * wakes the core every millisecond for the timeout. */
+		uint32_t asleep = trace_sleep_begin();
+		__WFI();
+		trace_sleep_end(asleep);
+		__enable_irq();
+	}
+}
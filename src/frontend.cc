@@ -0,0 +1,105 @@
+/**
+ * @file frontend.cc
+ * @brief Spectrogram front end feeding the classifier
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+#include <dsp/window_functions.h>
+
+#include "frontend.h"
+
+speech::frontend::frontend(bool remove_mean) : remove_mean(remove_mean)
+{
+	if (arm_rfft_fast_init_256_f32(&this->fft) != ARM_MATH_SUCCESS) {
+		assert(!"Failed to init RFFT");
+	}
+	arm_hanning_f32(this->hanning, window_size);
+}
+
+void speech::frontend::compute(const int16_t *waveform, size_t len,
+			       uint8_t *features)
+{
+	float min, max;
+	minmax(waveform, len, &min, &max);
+
+	for (uint32_t idx = 0; idx < num_frames; idx++) {
+		this->condition_frame(waveform + idx * frame_step, min, max,
+				      this->frame);
+		this->magnitude(this->frame, this->mag);
+		quantize(this->mag, features + idx * num_bins);
+	}
+}
+
+void speech::frontend::compute(const int16_t *waveform, size_t len,
+			       int8_t *features, float scale,
+			       int32_t zero_point)
+{
+	float min, max;
+	minmax(waveform, len, &min, &max);
+
+	for (uint32_t idx = 0; idx < num_frames; idx++) {
+		this->condition_frame(waveform + idx * frame_step, min, max,
+				      this->frame);
+		this->magnitude(this->frame, this->mag);
+		quantize(this->mag, features + idx * num_bins, scale,
+			 zero_point);
+	}
+}
+
+void speech::frontend::compute_frame(const int16_t *samples, uint8_t *column)
+{
+	this->condition_frame(samples, (float)INT16_MIN, (float)INT16_MAX,
+			      this->frame);
+	this->magnitude(this->frame, this->mag);
+	quantize(this->mag, column);
+}
+
+void speech::frontend::quantize(const float *mag, uint8_t *features)
+{
+	for (uint32_t i = 0; i < num_bins; i++) {
+#ifdef PRINT_SPECTROGRAM
+		printf("%08f\n", mag[i]);
+#endif
+		features[i] = (uint8_t)(mag[i] * 8.0f);
+	}
+}
+
+void speech::frontend::quantize(const float *mag, int8_t *features,
+				float scale, int32_t zero_point)
+{
+	const float inv_scale = 1.0f / scale;
+	for (uint32_t i = 0; i < num_bins; i++) {
+		int32_t q = (int32_t)(mag[i] * inv_scale + 0.5f) + zero_point;
+		q = (q < INT8_MIN) ? INT8_MIN : ((q > INT8_MAX) ? INT8_MAX : q);
+		features[i] = (int8_t)q;
+	}
+}
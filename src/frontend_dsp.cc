@@ -0,0 +1,123 @@
+/**
+ * @file frontend_dsp.cc
+ * @brief Front end kernels on CMSIS-DSP, as on the device
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cstdint>
+
+#include <dsp/fast_math_functions.h>
+
+#include "frontend.h"
+
+// The kernels of the front end are kept apart from the rest, so the host
+// build can swap in its own, see host/frontend_simd.cc
+
+const char *speech::frontend::backend()
+{
+	return "cmsis";
+}
+
+void speech::frontend::minmax(const int16_t *waveform, size_t len, float *min,
+			      float *max)
+{
+	*min = 999999.0f;
+	*max = -999999.0f;
+	for (uint32_t i = 0; i < len; i++) {
+		float val = (float)(waveform[i]);
+		if (val < *min) {
+			*min = val;
+		}
+		if (val > *max) {
+			*max = val;
+		}
+	}
+}
+
+void speech::frontend::condition_frame(const int16_t *samples, float min,
+				       float max, float *frame) const
+{
+	double sum = 0;
+	for (uint32_t i = 0; i < window_size; i++) {
+		frame[i] = (float)(samples[i]);
+
+		// Normalize from -1 to 1
+		frame[i] = (2.0f * (frame[i] - min) / (max - min)) - 1;
+		sum += frame[i];
+	}
+
+	// Remove DC component
+	float mean = this->remove_mean ? (float)(sum / (double)window_size) :
+					 0.0f;
+	for (uint32_t i = 0; i < window_size; i++) {
+		frame[i] = frame[i] - mean;
+
+		// Apply window function
+		frame[i] *= this->hanning[i];
+	}
+}
+
+void speech::frontend::magnitude(float *frame, float *mag)
+{
+	arm_rfft_fast_f32(&this->fft, frame, this->spectrum, 0);
+	unpack_magnitude(this->spectrum, mag);
+}
+
+void speech::frontend::unpack_magnitude(const float *dst, float *mag)
+{
+	// From to the CMSIS documentation:
+	// https://arm-software.github.io/CMSIS-DSP/latest/group__RealFFT.html
+	//
+	// The FFT of a real N-point sequence has even symmetry in the
+	// frequency domain. The second half of the data equals the conjugate
+	// of the first half flipped in frequency. This conjugate part is not
+	// computed by the float RFFT. As consequence, the output of a N point
+	// real FFT should be a N//2 + 1 complex numbers so N + 2 floats.
+
+	// It happens that the first complex of number of the RFFT output is
+	// actually all real. Its real part represents the DC offset. The value
+	// at Nyquist frequency is also real.
+
+	// Those two complex numbers can be encoded with 2 floats rather than
+	// using two numbers with an imaginary part set to zero.
+
+	// The implementation is using a trick so that the output buffer can be
+	// N float : the last real is packaged in the imaginary part of the
+	// first complex (since this imaginary part is not used and is zero).
+
+	// The first "complex" is actually to reals, X[0] and X[N/2]
+	float first_real = (dst[0] < 0.0f) ? (-1.0f * dst[0]) : dst[0];
+	float second_real = (dst[1] < 0.0f) ? (-1.0f * dst[1]) : dst[1];
+
+	// Take the magnitude for all the complex values in between
+	arm_cmplx_mag_f32(dst + 2, mag + 1, window_size / 2 - 1);
+
+	// Fill in the two real numbers at 0 and N/2
+	mag[0] = first_real;
+	mag[num_bins - 1] = second_real;
+}
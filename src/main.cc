@@ -17,6 +17,8 @@ limitations under the License.
 #include <string.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <stm32l4xx_hal.h>
 
 #include <models/model_tflite.h>
@@ -30,22 +32,56 @@ limitations under the License.
 #include <tensorflow/lite/micro/system_setup.h>
 #include <tensorflow/lite/schema/schema_generated.h>
 
-#include <dsp/basic_math_functions.h>
-#include <dsp/transform_functions.h>
-#include <dsp/window_functions.h>
-#include <dsp/fast_math_functions.h>
-
 #include <serial.h>
 
+#include "classifier.h"
+#include "frontend.h"
 #include "mic.h"
-int dfsdm_conversion_done;
+#include "op_profiler.h"
+#include "pipeline.h"
+#include "spsc_ring.h"
+#include "step_classifier.h"
+#include "uart_source.h"
+#include "wake_detector.h"
+#include "weight_cache.h"
+
+extern "C" {
+#include "capture.h"
+#include "clock.h"
+#include "cycles.h"
+#include "debug_io.h"
+#include "event.h"
+#include "memstat.h"
+#include "model_store.h"
+#include "pool.h"
+#include "scheduler.h"
+#include "stream.h"
+#include "trace.h"
+}
 
 
 const int kTensorArenaSize = 66800;
 alignas(16) static uint8_t tensor_arena[kTensorArenaSize];
 
-static uint8_t waveform[16128];
-static uint8_t last_ffts[125];
+#ifdef WAKE_ARENA_SIZE
+// The wake detector keeps the end of the arena to itself, so both models
+// stay loaded
+static_assert((WAKE_ARENA_SIZE % 16 == 0) &&
+		      (WAKE_ARENA_SIZE < kTensorArenaSize),
+	      "WAKE_ARENA_SIZE must be a multiple of 16 within the arena");
+const int kClassifierArenaSize = kTensorArenaSize - WAKE_ARENA_SIZE;
+#else
+const int kClassifierArenaSize = kTensorArenaSize;
+#endif
+
+#ifdef WEIGHT_CACHE_SIZE
+// SRAM traded for inference latency, see speech::weight_cache
+alignas(16) static uint8_t weight_pool[WEIGHT_CACHE_SIZE];
+#endif
+
+// Too large for SRAM1 next to the tensor arena, not stored in flash
+__attribute__((section(".sram2_bss")))
+static int16_t waveform[speech::frontend::num_samples];
 
 #define DEBUG_PRINTF(...)            \
 	{                            \
@@ -122,227 +158,776 @@ void print_shape(TfLiteTensor *tensor)
 	RAW_PRINTF(")\n");
 }
 
-int main(int argc, char *argv[])
+/**
+ * @brief Build the interpreter for a model and prepare it for inference
+ */
+static bool activate_model(speech::classifier &classifier,
+			   speech::op_profiler &profiler, const uint8_t *buf)
 {
-	tflite::InitializeTarget();
-	speech::mic microphone;
-	/*	microphone.init();
-
-	while (!dfsdm_conversion_done)
-		;
-	microphone.dump_recording();
-*/
-
-	const static uint32_t window_size = 256;
-	const static uint32_t frame_step = 128;
+	DEBUG_PRINTF("Model architecture:\n");
+	DEBUG_PRINTF("==============================================\n");
+	PrintModelDetails(tflite::GetModel(buf));
 
-	arm_rfft_fast_instance_f32 fft;
-	if (arm_rfft_fast_init_256_f32(&fft) != ARM_MATH_SUCCESS) {
-		assert(!"Failed to init RFFT");
+	if (!classifier.load(buf)) {
+		return false;
 	}
+	DEBUG_PRINTF("MicroInterpreter tensors allocated.\n");
 
-	static float hanning[window_size];
-	arm_hanning_f32(hanning, window_size);
-
+#ifdef WEIGHT_CACHE_SIZE
+	// Profile with a silent input and move the weights of the
+	// most expensive operators to SRAM
+	TfLiteTensor *profile_input = classifier.input();
+	memset(profile_input->data.uint8, 0, profile_input->bytes);
+	speech::weight_cache weights(weight_pool, sizeof(weight_pool));
+	weights.promote(classifier.model(), classifier.interpreter(), profiler);
+	weights.report();
+#endif
+	return true;
+}
 
-	const tflite::Model *model = tflite::GetModel(model_tflite);
-	DEBUG_PRINTF("Model architecture:\n");
-	DEBUG_PRINTF("==============================================\n");
-	PrintModelDetails(model);
+/**
+ * @brief Activate the uploaded model, or the compiled-in one if there is none
+ */
+static void activate_default_model(speech::classifier &classifier,
+				   speech::op_profiler &profiler)
+{
+	size_t stored_len = 0;
+	const uint8_t *stored = model_store_get(&stored_len);
+	if ((stored != nullptr) &&
+	    speech::classifier::validate(stored, stored_len) &&
+	    activate_model(classifier, profiler, stored)) {
+		DEBUG_PRINTF("Using uploaded model (%u bytes).\n", stored_len);
+	} else if (!activate_model(classifier, profiler, model_tflite)) {
+		assert(!"AllocateTensors() failed\n");
+	}
+}
 
-	tflite::MicroMutableOpResolver<8> op_resolver;
+static int model_begin(void *ctx, size_t filesize)
+{
+	*(size_t *)ctx = filesize;
+	return model_store_erase();
+}
 
-	// Not really sure which ops to add
-	if (op_resolver.AddRelu() != kTfLiteOk) {
-		assert(!"Failed to add op");
-	}
-	if (op_resolver.AddConv2D() != kTfLiteOk) {
-		assert(!"Failed to add op");
-	}
-	if (op_resolver.AddMaxPool2D() != kTfLiteOk) {
-		assert(!"Failed to add op");
+static int model_block(void *ctx, const uint8_t *block, size_t offset,
+		       size_t len)
+{
+	// Programmed flash cannot be programmed again without an erase, so
+	// a resent block would fail the same way
+	if (model_store_write(offset, block, len) != 0) {
+		return SERIAL_SINK_ABORT;
 	}
-	if (op_resolver.AddReshape() != kTfLiteOk) {
-		assert(!"Failed to add op");
+	return 0;
+}
+
+/**
+ * @brief Receive a model into the flash slot and switch over to it
+ *
+ * Falls back to the compiled-in model if the upload fails after the slot
+ * was erased.
+ */
+static void receive_model(speech::classifier &classifier,
+			  speech::op_profiler &profiler)
+{
+	size_t filesize = 0;
+	const struct serial_sink sink = { model_begin, model_block, &filesize };
+
+	int len = serial_transfer(SERIAL_CMD_MODEL, model_store_capacity(),
+				  &sink);
+	if (filesize == 0) {
+		// Rejected before the slot was touched
+		RAW_PRINTF("[!] Model upload rejected.\n");
+		return;
 	}
-	if (op_resolver.AddFullyConnected() != kTfLiteOk) {
-		assert(!"Failed to add op");
+
+	const uint8_t *buf = model_store_data();
+	if ((len > 0) && speech::classifier::validate(buf, filesize) &&
+	    (model_store_commit(filesize) == 0) &&
+	    activate_model(classifier, profiler, buf)) {
+		SUCCESS_PRINTF("Model loaded (%u bytes).\n", filesize);
+		return;
 	}
-	if (op_resolver.AddSoftmax() != kTfLiteOk) {
-		assert(!"Failed to add op");
+
+	RAW_PRINTF("[!] Invalid model, using compiled-in model.\n");
+	if (!activate_model(classifier, profiler, model_tflite)) {
+		assert(!"AllocateTensors() failed\n");
 	}
-	if (op_resolver.AddResizeBilinear() != kTfLiteOk) {
-		assert(!"Failed to add op");
+}
+
+/**
+ * @brief Outcome of one clip, sent as binary record in batch mode
+ */
+struct clip_result {
+	uint32_t index;
+	uint8_t status; /**< 0 on success, 1 if the payload was rejected */
+	uint8_t label;
+	uint8_t num_scores;
+	uint8_t reserved;
+	uint32_t frontend_us;
+	uint32_t inference_us;
+	uint8_t scores[speech::classifier::num_labels];
+};
+
+typedef speech::argmax_decision<speech::classifier::num_labels> decision;
+
+/**
+ * @brief Clips received over the serial link
+ */
+typedef speech::pipeline<speech::uart_source, speech::frontend_features,
+			 speech::classifier, decision>
+	clip_pipeline;
+
+static void collect_memstat(const speech::classifier &classifier,
+			    struct memstat *stat)
+{
+	memstat_collect(stat);
+	stat->arena_size = classifier.arena_capacity();
+	stat->arena_used = classifier.arena_used();
+}
+
+/**
+ * @brief Stream the microphone to the host until it sends anything
+ *
+ * Announces the stream baud rate, which the host switches to right after.
+ * The memory high-water marks go out every STREAM_TELEMETRY_PERIOD.
+ */
+static void stream_microphone(speech::mic &microphone,
+			      const speech::classifier &classifier)
+{
+	RAW_PRINTF("%s%08lu", SERIAL_CMD_AUDIO_TRANSACTION,
+		   (unsigned long)STREAM_BAUDRATE);
+	if (stream_start() != 0) {
+		return;
 	}
-	if (op_resolver.AddQuantize() != kTfLiteOk) {
-		assert(!"Failed to add op");
+	// Two frames per half of the buffer
+	if (!microphone.init(stream_audio, 2 * STREAM_MAX_PAYLOAD)) {
+		stream_stop();
+		return;
 	}
 
-	DEBUG_PRINTF("Added operations to OpsResolver.\n");
+	uint32_t telemetry = HAL_GetTick() - STREAM_TELEMETRY_PERIOD;
+	char c;
+	do {
+		if (HAL_GetTick() - telemetry >= STREAM_TELEMETRY_PERIOD) {
+			struct memstat stat;
+			collect_memstat(classifier, &stat);
+			stream_write(STREAM_TYPE_TELEMETRY, 0, &stat,
+				     sizeof(stat));
+			telemetry = HAL_GetTick();
+		}
+	} while (read(STDIN_FILENO, &c, 1) != 1);
 
-	// Interpreter
-	tflite::MicroInterpreter interpreter(model, op_resolver, tensor_arena,
-						 kTensorArenaSize);
-	DEBUG_PRINTF("MicroInterpreter initialized.\n");
+	microphone.stop();
+	stream_stop();
+	pool_report();
+}
 
-	if (interpreter.AllocateTensors() != kTfLiteOk) {
-		assert(!"AllocateTensors() failed\n");
+static uint32_t cycles_to_us(uint32_t cycles)
+{
+	return cycles / (SystemCoreClock / 1000000);
+}
+
+static TfLiteTensor *prepare_input(speech::classifier &classifier)
+{
+	TfLiteTensor *input = classifier.input();
+	input->dims->size = 4;
+	input->dims->data[0] = 1;
+	input->dims->data[1] = speech::frontend::num_frames;
+	input->dims->data[2] = speech::frontend::num_bins;
+	input->dims->data[3] = 1;
+	input->bytes = speech::frontend::features_size;
+	static const char input_name[] = "Input";
+	input->name = input_name;
+	return input;
+}
+
+/**
+ * @brief Compute the features of a received clip, if needed, and classify it
+ */
+static void run_clip(clip_pipeline &clips, struct clip_result *result)
+{
+	// Only the computation itself runs at full speed
+	clock_set_profile(CLOCK_PROFILE_BOOST);
+	result->num_scores = speech::classifier::num_labels;
+	trace_begin(TRACE_CLIP, result->index);
+
+	uint32_t start = cycles_now();
+	trace_begin(TRACE_FEATURES, result->index);
+	clips.acquire();
+	clips.extract();
+	trace_end(TRACE_FEATURES, result->index);
+	result->frontend_us = cycles_to_us(cycles_now() - start);
+
+#ifdef PRINT_SPECTROGRAM
+	const uint8_t *features = clips.network().input()->data.uint8;
+	for (uint32_t i = 0; i < speech::frontend::features_size; i++) {
+		printf("%u\n", features[i]);
 	}
-	DEBUG_PRINTF("MicroInterpreter tensors allocated.\n");
+#endif
 
-	while (1) {
-		uint32_t waveform_len = serial_recv((char*)waveform, sizeof(waveform));
-		if (waveform_len == 0) {
-			assert(!"Transfer failed.");
+	start = cycles_now();
+	trace_begin(TRACE_INVOKE, result->index);
+	if (!clips.infer()) {
+		assert(!"Inference failed.\n");
+	}
+	trace_end(TRACE_INVOKE, result->index);
+	result->inference_us = cycles_to_us(cycles_now() - start);
+
+	clips.decide();
+	result->label = clips.result().label;
+	memcpy(result->scores, clips.result().scores, sizeof(result->scores));
+	trace_end(TRACE_CLIP, result->index);
+	clock_set_profile(CLOCK_PROFILE_LOW);
+}
+
+/**
+ * @brief Outcome of one hop, sent as binary record while listening
+ */
+struct listen_result {
+	uint32_t hop;
+	uint8_t warm; /**< 0 while the first window is still filling up */
+	uint8_t label;
+	uint8_t num_scores; /**< 0 if the wake detector did not trigger */
+	uint8_t wake_score; /**< UINT8_MAX without a wake detector */
+	uint32_t step_us; /**< Front end and step model or wake detector */
+	uint32_t classify_us; /**< Features and classifier once triggered */
+	uint8_t scores[speech::classifier::num_labels];
+};
+
+template <typename model>
+static void copy_scores(model &m, struct listen_result *result)
+{
+	result->num_scores = speech::classifier::num_labels;
+	for (uint32_t i = 0; i < result->num_scores; i++) {
+		result->scores[i] = m.score(i);
+		if (result->scores[i] > result->scores[result->label]) {
+			result->label = i;
 		}
+	}
+}
+
+/**
+ * @brief Spectrogram column on its way to the step model
+ */
+struct listen_column {
+	uint8_t bins[speech::frontend::num_bins];
+	uint32_t cycles; /**< Spent on the front end */
+};
+
+/**
+ * @brief State of continuous listening, shared by the tasks
+ *
+ * The DMA interrupt hands the halves of its buffer to TASK_CAPTURE, which
+ * conditions them for TASK_FEATURES. That one runs the wake detector and
+ * leaves the classifier, or every column for the step model, to
+ * TASK_INFERENCE. Both post their records to TASK_TELEMETRY, which sends
+ * them even while the classifier runs. Every ring has one producer and one
+ * consumer, see scheduler.h for the priorities.
+ */
+struct listener {
+	speech::frontend *frontend;
+	speech::frontend_features *features;
+	speech::classifier *classifier;
+	speech::wake_detector *detector;
+	speech::step_classifier *stepper;
+	TfLiteTensor *input;
+
+	speech::spsc_ring<speech::mic::block, 2> blocks;
+	speech::spsc_ring<int16_t, 1024> samples;
+	speech::spsc_ring<struct listen_column, 4> columns;
+	// From TASK_FEATURES and TASK_INFERENCE respectively, to
+	// TASK_TELEMETRY
+	speech::spsc_ring<struct listen_result, 8> hops;
+	speech::spsc_ring<struct listen_result, 8> results;
+
+	// Within waveform, owned by TASK_FEATURES: the next frame starts at
+	// next, fill samples are valid
+	size_t fill;
+	size_t next;
+	uint32_t hop;
+	uint32_t wake_cycles;
+
+	// The hop the classifier runs for, owned by TASK_INFERENCE while set
+	struct listen_result trigger;
+	std::atomic<bool> classifying;
+
+	// Lost because the next stage fell behind
+	uint32_t dropped_blocks;
+	uint32_t dropped_samples;
+	uint32_t dropped_columns;
+	uint32_t dropped_results;
+};
+
+static struct listener listening;
+
+/**
+ * @brief Called by the DMA interrupt with a filled half of the buffer
+ */
+static void listen_block(const int32_t *samples, size_t len)
+{
+	if (!listening.blocks.push({ samples, len })) {
+		listening.dropped_blocks++;
+	}
+	scheduler_post(TASK_CAPTURE);
+}
 
-		float min = 999999.0f;
-		float max = 0;
-		for (uint32_t i = 0; i < waveform_len; i++) {
-			float val = (float)(waveform[i]);
-			if (val < min) {
-				min = val;
+/**
+ * @brief TASK_CAPTURE, urgent enough to be done before the DMA comes back
+ */
+static void capture_task(void *ctx)
+{
+	struct listener *l = (struct listener *)ctx;
+	speech::mic::block b;
+	while (l->blocks.pop(b)) {
+		int16_t conditioned[128];
+		for (size_t done = 0; done < b.len;
+		     done += sizeof(conditioned) / sizeof(conditioned[0])) {
+			size_t len = b.len - done;
+			if (len > sizeof(conditioned) / sizeof(conditioned[0])) {
+				len = sizeof(conditioned) / sizeof(conditioned[0]);
 			}
-			if (val > max) {
-				max = val;
+			len = capture_process(b.samples + done, len, conditioned);
+			l->dropped_samples += len - l->samples.push(conditioned, len);
+		}
+	}
+	scheduler_post(TASK_FEATURES);
+}
+
+/**
+ * @brief TASK_FEATURES for the step model: a column every frame_step
+ * samples
+ */
+static void features_steps(void *ctx)
+{
+	struct listener *l = (struct listener *)ctx;
+	// Samples not yet covered by a whole frame are kept at the start
+	while (!l->samples.empty()) {
+		l->fill += l->samples.pop(waveform + l->fill,
+					  speech::frontend::num_samples -
+						  l->fill);
+		size_t pos = 0;
+		for (; l->fill - pos >= speech::frontend::window_size;
+		     pos += speech::frontend::frame_step) {
+			auto free = l->columns.write_span();
+			if (free.size == 0) {
+				l->dropped_columns++;
+				continue;
 			}
+			uint32_t start = cycles_now();
+			l->frontend->compute_frame(waveform + pos,
+						   free.data->bins);
+			free.data->cycles = cycles_now() - start;
+			l->columns.commit(1);
 		}
+		l->fill -= pos;
+		memmove(waveform, waveform + pos,
+			l->fill * sizeof(waveform[0]));
+	}
+	scheduler_post(TASK_INFERENCE);
+}
 
-		for (uint32_t idx = 0; idx < 124; idx++) {
-			float dst[window_size];
-			static float mag[window_size + 1];
-			double sum = 0;
+/**
+ * @brief TASK_INFERENCE for the step model
+ */
+static void inference_steps(void *ctx)
+{
+	struct listener *l = (struct listener *)ctx;
+	while (!l->columns.empty()) {
+		auto column = l->columns.read_span();
+		struct listen_result result = {};
+		result.hop = l->hop++;
+		result.wake_score = UINT8_MAX;
+
+		uint32_t start = cycles_now();
+		memcpy(l->stepper->column()->data.uint8, column.data->bins,
+		       sizeof(column.data->bins));
+		uint32_t cycles = column.data->cycles;
+		l->columns.consume(1);
+		if (!l->stepper->step()) {
+			assert(!"Invoke() failed.");
+		}
+		result.step_us = cycles_to_us(cycles + cycles_now() - start);
 
-			static float* signal_chunk = mag;
+		result.warm = l->stepper->warm() ? 1 : 0;
+		copy_scores(*l->stepper, &result);
+		if (!l->results.push(result)) {
+			l->dropped_results++;
+		}
+		scheduler_post(TASK_TELEMETRY);
+	}
+}
 
-			for (uint32_t i = 0; i < window_size; i++) {
-				signal_chunk[i] =
-					(float)((uint8_t)waveform[idx * frame_step + i]);
+/**
+ * @brief TASK_FEATURES for the cascade: the wake detector on every row of
+ * pooled columns, and the features of the last second whenever it triggers
+ *
+ * The classifier sees the same features as for a clip, normalized to the
+ * value range of the second. Afterwards the detector starts over, so a
+ * keyword is not reported twice. It keeps triggering while the classifier
+ * is still busy with the previous keyword, the classifier runs once that
+ * is done.
+ */
+static void features_cascade(void *ctx)
+{
+	struct listener *l = (struct listener *)ctx;
+	uint8_t column[speech::frontend::num_bins];
+	while (true) {
+		auto s = l->samples.read_span();
+		if (s.size == 0) {
+			break;
+		}
+		uint32_t start = cycles_now();
+		if (l->fill + s.size > speech::frontend::num_samples) {
+			size_t drop = l->fill + s.size -
+				      speech::frontend::num_samples;
+			l->fill -= drop;
+			l->next -= drop;
+			memmove(waveform, waveform + drop,
+				l->fill * sizeof(waveform[0]));
+		}
+		memcpy(waveform + l->fill, s.data, s.size * sizeof(s.data[0]));
+		l->fill += s.size;
+		l->samples.consume(s.size);
+
+		bool row = false;
+		for (; l->fill - l->next >= speech::frontend::window_size;
+		     l->next += speech::frontend::frame_step) {
+			l->frontend->compute_frame(waveform + l->next, column);
+			row |= l->detector->push(column);
+		}
+		if (!row) {
+			l->wake_cycles += cycles_now() - start;
+			continue;
+		}
 
-				// Normalize from -1 to 1
-				signal_chunk[i] = (2.0f * (signal_chunk[i] - min) / (max - min)) - 1;
-				sum += signal_chunk[i];
+		struct listen_result result = {};
+		result.hop = l->hop++;
+		result.warm = l->detector->warm() ? 1 : 0;
+		if (result.warm) {
+			result.wake_score = l->detector->invoke();
+		}
+		l->wake_cycles += cycles_now() - start;
+		result.step_us = cycles_to_us(l->wake_cycles);
+		l->wake_cycles = 0;
+
+		if ((result.wake_score >= WAKE_THRESHOLD) &&
+		    !l->classifying.load(std::memory_order_acquire)) {
+			start = cycles_now();
+			memset(waveform + l->fill, 0,
+			       sizeof(waveform) - l->fill * sizeof(waveform[0]));
+			l->features->compute(waveform, l->fill, l->input);
+			result.classify_us = cycles_to_us(cycles_now() - start);
+			l->detector->reset();
+			l->trigger = result;
+			l->classifying.store(true, std::memory_order_release);
+			scheduler_post(TASK_INFERENCE);
+		} else {
+			if (!l->hops.push(result)) {
+				l->dropped_results++;
 			}
+			scheduler_post(TASK_TELEMETRY);
+		}
+	}
+}
 
-			// Remove DC component
-			float mean = (float)(sum / (double)window_size);
-			for (uint32_t i = 0; i < window_size; i++) {
-				signal_chunk[i] = signal_chunk[i] - mean;
+/**
+ * @brief TASK_INFERENCE for the cascade, may take longer than a hop
+ */
+static void inference_cascade(void *ctx)
+{
+	struct listener *l = (struct listener *)ctx;
+	if (!l->classifying.load(std::memory_order_acquire)) {
+		return;
+	}
+	uint32_t start = cycles_now();
+	if (!l->classifier->invoke()) {
+		assert(!"Invoke() failed.");
+	}
+	copy_scores(*l->classifier, &l->trigger);
+	l->trigger.classify_us += cycles_to_us(cycles_now() - start);
+	if (!l->results.push(l->trigger)) {
+		l->dropped_results++;
+	}
+	l->classifying.store(false, std::memory_order_release);
+	scheduler_post(TASK_TELEMETRY);
+}
 
-				// Apply window function
-				signal_chunk[i] *= hanning[i];
+/**
+ * @brief TASK_TELEMETRY, the records of both stages in the order they come
+ */
+static void telemetry_task(void *ctx)
+{
+	struct listener *l = (struct listener *)ctx;
+	struct listen_result result;
+	while (l->hops.pop(result) || l->results.pop(result)) {
+		serial_send_result(&result, sizeof(result));
+	}
+}
+
+/**
+ * @brief Run the tasks on the microphone and send their records until the
+ * host sends anything
+ */
+static void listen_tasks(speech::mic &microphone, void (*features)(void *),
+			 void (*inference)(void *))
+{
+	struct listener *l = &listening;
+	l->blocks.clear();
+	l->samples.clear();
+	l->columns.clear();
+	l->hops.clear();
+	l->results.clear();
+	l->fill = 0;
+	l->next = 0;
+	l->hop = 0;
+	l->wake_cycles = 0;
+	l->classifying = false;
+	l->dropped_blocks = 0;
+	l->dropped_samples = 0;
+	l->dropped_columns = 0;
+	l->dropped_results = 0;
+	memset(waveform, 0, sizeof(waveform));
+
+	scheduler_set(TASK_CAPTURE, capture_task, l);
+	scheduler_set(TASK_FEATURES, features, l);
+	scheduler_set(TASK_TELEMETRY, telemetry_task, l);
+	scheduler_set(TASK_INFERENCE, inference, l);
+	scheduler_reset_stats();
+	if (microphone.init(listen_block)) {
+		while (uart_debug_available() == 0) {
+			// The tasks raise the clock again when they start
+			uint32_t state = scheduler_lock();
+			if (scheduler_idle()) {
+				clock_set_profile(CLOCK_PROFILE_LOW);
 			}
+			scheduler_unlock(state);
+			event_wait(EVENT_TASK | EVENT_UART_RX,
+				   EVENT_WAIT_FOREVER);
+		}
+		microphone.stop();
+	} else {
+		printf("[!] Failed to start the microphone.\n");
+	}
+	scheduler_set(TASK_CAPTURE, nullptr, nullptr);
+	scheduler_set(TASK_FEATURES, nullptr, nullptr);
+	scheduler_set(TASK_TELEMETRY, nullptr, nullptr);
+	scheduler_set(TASK_INFERENCE, nullptr, nullptr);
+	clock_set_profile(CLOCK_PROFILE_LOW);
+
+	printf("listen dropped %lu blocks, %lu samples, %lu columns, "
+	       "%lu results\n",
+	       (unsigned long)l->dropped_blocks,
+	       (unsigned long)l->dropped_samples,
+	       (unsigned long)l->dropped_columns,
+	       (unsigned long)l->dropped_results);
+	scheduler_report();
+}
 
-			arm_rfft_fast_f32(&fft, signal_chunk, dst, 0);
+/**
+ * @brief Run the step model on every frame_step samples
+ */
+static void listen_steps(speech::mic &microphone, speech::frontend &frontend,
+			 speech::step_classifier &stepper)
+{
+	listening.frontend = &frontend;
+	listening.stepper = &stepper;
+	listen_tasks(microphone, features_steps, inference_steps);
+}
 
-			// From to the CMSIS documentation:
-			// https://arm-software.github.io/CMSIS-DSP/latest/group__RealFFT.html
-			//
-			// The FFT of a real N-point sequence has even symmetry in the
-			// frequency domain. The second half of the data equals the conjugate
-			// of the first half flipped in frequency. This conjugate part is not
-			// computed by the float RFFT. As consequence, the output of a N point
-			// real FFT should be a N//2 + 1 complex numbers so N + 2 floats.
+/**
+ * @brief Run the wake detector on every row of pooled columns and the
+ * classifier on the last second whenever the detector triggers
+ */
+static void listen_cascade(speech::mic &microphone, speech::frontend &frontend,
+			   speech::classifier &classifier,
+			   speech::wake_detector &detector)
+{
+	TfLiteTensor *input = prepare_input(classifier);
+	speech::frontend_features features(frontend);
+
+	listening.frontend = &frontend;
+	listening.features = &features;
+	listening.classifier = &classifier;
+	listening.detector = &detector;
+	listening.input = input;
+	detector.reset();
+	listen_tasks(microphone, features_cascade, inference_cascade);
+}
 
-			// It happens that the first complex of number of the RFFT output is
-			// actually all real. Its real part represents the DC offset. The value
-			// at Nyquist frequency is also real.
+/**
+ * @brief Classify the microphone continuously until the host sends anything
+ *
+ * With a wake detector loaded, it gates the classifier. Otherwise the step
+ * model runs on every frame; it takes over the classifier's part of the
+ * tensor arena, so the classifier is unloaded meanwhile and reactivated
+ * afterwards. Replies with NACK if there is neither. frontend can skip the
+ * mean removal, the samples went through capture_process().
+ */
+static void listen_microphone(speech::mic &microphone,
+			      speech::frontend &frontend,
+			      speech::classifier &classifier,
+			      speech::op_profiler &profiler,
+			      speech::wake_detector *detector)
+{
+	if ((detector != nullptr) && detector->loaded()) {
+		RAW_PRINTF("%s%s", SERIAL_CMD_LISTEN_TRANSACTION,
+			   SERIAL_CMD_ACK);
+		listen_cascade(microphone, frontend, classifier, *detector);
+		return;
+	}
 
-			// Those two complex numbers can be encoded with 2 floats rather than
-			// using two numbers with an imaginary part set to zero.
+	static speech::step_classifier stepper(tensor_arena,
+					       kClassifierArenaSize);
+	classifier.unload();
+	if ((model_step_tflite == nullptr) ||
+	    !speech::step_classifier::validate(model_step_tflite,
+					       model_step_tflite_len) ||
+	    !stepper.load(model_step_tflite)) {
+		RAW_PRINTF("%s%s", SERIAL_CMD_LISTEN_TRANSACTION,
+			   SERIAL_CMD_NACK);
+		activate_default_model(classifier, profiler);
+		return;
+	}
+	DEBUG_PRINTF("Step model uses %u bytes of the arena.\n",
+		     stepper.arena_used());
+	// Nothing but result records from here on
+	RAW_PRINTF("%s%s", SERIAL_CMD_LISTEN_TRANSACTION, SERIAL_CMD_ACK);
+
+	listen_steps(microphone, frontend, stepper);
+	stepper.unload();
+	activate_default_model(classifier, profiler);
+}
 
-			// The implementation is using a trick so that the output buffer can be
-			// N float : the last real is packaged in the imaginary part of the
-			// first complex (since this imaginary part is not used and is zero).
+static void batch_clip_done(void *ctx, uint32_t index, int len)
+{
+	clip_pipeline *clips = (clip_pipeline *)ctx;
+	struct clip_result result = {};
+	result.index = index;
+	if (len < 0) {
+		result.status = 1;
+	} else {
+		run_clip(*clips, &result);
+	}
+	serial_send_result(&result, sizeof(result));
+}
 
-			// The first "complex" is actually to reals, X[0] and X[N/2]
-			float first_real = (dst[0] < 0.0f) ? (-1.0f * dst[0]) : dst[0];
-			float second_real = (dst[1] < 0.0f) ? (-1.0f * dst[1]) : dst[1];
+int main(int argc, char *argv[])
+{
+	tflite::InitializeTarget();
+	speech::mic microphone;
+	/*	microphone.init();
+	microphone.dump_recording();
+*/
 
-			// Take the magnitude for all the complex values in between
-			arm_cmplx_mag_f32(dst + 2, mag + 1, window_size / 2);
+	static speech::frontend frontend;
+	// The microphone samples are freed of DC by capture_process() already
+	static speech::frontend mic_frontend(false);
+	speech::frontend_features features(frontend);
+	speech::uart_source uart(waveform);
 
-			// Fill in the two real numbers at 0 and N/2
-			mag[0] = first_real;
-			mag[128] = second_real;
+	speech::op_profiler profiler;
+	speech::classifier classifier(tensor_arena, kClassifierArenaSize,
+				      &profiler);
+	DEBUG_PRINTF("Added operations to OpsResolver.\n");
 
-			// N+1 FFT output, reuse waveform array
-			for (uint32_t i = 0; i < 129; i++) {
-#ifdef PRINT_SPECTROGRAM
-				printf("%08f\n", mag[i]);
+	// A model uploaded at runtime takes precedence over the compiled-in one
+	activate_default_model(classifier, profiler);
+
+	speech::wake_detector *detector = nullptr;
+#ifdef WAKE_ARENA_SIZE
+	static speech::wake_detector wake(tensor_arena + kClassifierArenaSize,
+					  WAKE_ARENA_SIZE);
+	if ((model_wake_tflite != nullptr) &&
+	    speech::wake_detector::validate(model_wake_tflite,
+					    model_wake_tflite_len) &&
+	    wake.load(model_wake_tflite)) {
+		DEBUG_PRINTF("Wake detector uses %u of %u bytes.\n",
+			     wake.arena_used(), WAKE_ARENA_SIZE);
+		detector = &wake;
+	} else {
+		RAW_PRINTF("[!] No wake detector, see train.py --wake.\n");
+	}
 #endif
+	pool_report();
 
-				// We can't override waveform[129 * idx + 128] yet
-				// because we need it for the next iteration, so we need to store
-				// it separately
-				if (i < 128) {
-					((uint8_t*)waveform)[128 * idx + i] = (uint8_t)(mag[i] * 8.0f);
-				}
-				else {
-					last_ffts[idx] = (uint8_t)(mag[i] * 8.0f);
-				}
-			}
+	decision outcome;
+	clip_pipeline clips(uart, features, classifier, outcome);
+
+	while (1) {
+		// Waiting, receiving and capturing need no more than this
+		clock_set_profile(CLOCK_PROFILE_LOW);
+		enum serial_cmd cmd = serial_wait_cmd();
+		if (cmd == SERIAL_CMD_MODEL) {
+			// Programs flash and rebuilds the interpreter
+			clock_set_profile(CLOCK_PROFILE_BOOST);
+			receive_model(classifier, profiler);
+			continue;
+		}
+		if (cmd == SERIAL_CMD_AUDIO) {
+			stream_microphone(microphone, classifier);
+			continue;
+		}
+		if (cmd == SERIAL_CMD_LISTEN) {
+			listen_microphone(microphone, mic_frontend, classifier,
+					  profiler, detector);
+			continue;
+		}
+		if (cmd == SERIAL_CMD_TRACE) {
+			trace_dump();
+			continue;
+		}
+		if (cmd == SERIAL_CMD_MEMORY) {
+			struct memstat stat;
+			collect_memstat(classifier, &stat);
+			RAW_PRINTF("%s", SERIAL_CMD_MEMORY_TRANSACTION);
+			serial_send_result(&stat, sizeof(stat));
+			continue;
 		}
 
-		uint8_t* input_tensor = waveform;
-		uint32_t input_tensor_len = 124 * 129;
-
-		// We need to append an additional 124 bytes at the end of the spectrogram
-		// because we need to transform it from 128 to 129 points
-		// and insert the the N+1 points
-		for (uint32_t idx = 123; idx > 0; idx--){
-			uint8_t tmp[128];
-			memcpy(tmp, waveform + (idx * 128), 128);
-			memcpy(waveform + (idx * 128 + idx), tmp, 128);
-			waveform[idx * 128 + (idx - 1)] = last_ffts[idx - 1];
+		TfLiteTensor *input = prepare_input(classifier);
+		const struct serial_payload_sink *sink =
+			uart.sink(input->data.uint8);
+		const size_t max_len = sizeof(waveform) + SERIAL_BLOCK_SIZE;
+
+		if (cmd == SERIAL_CMD_BATCH) {
+			// Results only, the host parses the stream
+			const struct serial_batch_sink batch = {
+				sink, batch_clip_done, &clips
+			};
+			serial_batch(max_len, &batch);
+			continue;
 		}
 
-#ifdef PRINT_SPECTROGRAM
-		for (uint32_t i = 0; i < input_tensor_len; i++){
-			printf("%u\n", input_tensor[i]);
+		int payload_len = serial_recv_payload(cmd, max_len, sink);
+		if (payload_len == 0) {
+			RAW_PRINTF("[!] Transfer failed.\n");
+			continue;
+		}
+		if (payload_len < 0) {
+			RAW_PRINTF("[!] Invalid payload.\n");
+			continue;
 		}
-#endif
 
-		size_t start_time = HAL_GetTick();
-		// Prepare input tensor
-		TfLiteTensor *input = interpreter.input(0);
-		input->dims->size = 4;
-		input->dims->data[0] = 1;
-		input->dims->data[1] = 124;
-		input->dims->data[2] = 129;
-		input->dims->data[3] = 1;
-		input->bytes = input_tensor_len;
-		const char input_name[] = "Input";
-		input->name = input_name;
-		memcpy(input->data.uint8, input_tensor, input->bytes);
 		print_shape(input);
-
-		// Perform inference
 		DEBUG_PRINTF("Running inference...\n");
-		if (interpreter.Invoke() != kTfLiteOk) {
-			assert(!"Inference failed.\n");
-		}
+		profiler.clear();
+		struct clip_result result = {};
+		run_clip(clips, &result);
 
-		// Get output tensor
-		TfLiteTensor *output = interpreter.output(0);
+		TfLiteTensor *output = classifier.output();
 		const char output_name[] = "Output";
 		output->name = output_name;
-		size_t end_time = HAL_GetTick();
 
-		DEBUG_PRINTF("Time: #%08u\n", end_time - start_time);
+		if (uart.features() == nullptr) {
+			DEBUG_PRINTF("Front end: %lu us\n", result.frontend_us);
+		}
+		DEBUG_PRINTF("Time: #%08lu\n", result.inference_us / 1000);
 
 		print_shape(output);
-		const char* labels[] = {"DOWN", "LEFT", "NO", "RIGHT", "UP", "YES"};
-
-		uint32_t pred = sizeof(labels);
-		uint32_t max_val = 0;
-		for (int32_t i = 0; i < output->dims->data[1]; i++){
-			SUCCESS_PRINTF("Prediction %s: %u\n", labels[i], output->data.uint8[i]);
-			if (output->data.uint8[i] > max_val){
-				max_val = output->data.uint8[i];
-				pred = i;
-			}
+		const char *const *labels = speech::classifier::labels;
+		for (uint32_t i = 0; i < result.num_scores; i++) {
+			SUCCESS_PRINTF("Prediction %s: %u\n", labels[i],
+				       result.scores[i]);
 		}
-		SUCCESS_PRINTF("@%s\n", labels[pred]);
+		SUCCESS_PRINTF("@%s\n", labels[result.label]);
 	}
 }
@@ -0,0 +1,85 @@
+/**
+ * @file memstat.c
+ * @brief Stack, heap and arena high-water marks
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include "stm32l4xx_hal.h"
+#include "memstat.h"
+#include "pool.h"
+
+extern uint32_t _estack; /* Symbol defined in the linker script */
+extern uint32_t _Min_Stack_Size; /* Symbol defined in the linker script */
+
+/* Words right below the stack pointer left alone while painting */
+#define MEMSTAT_PAINT_MARGIN 64
+
+static uint32_t *memstat_stack_bottom(void)
+{
+	return (uint32_t *)((uintptr_t)&_estack - (uintptr_t)&_Min_Stack_Size);
+}
+
+/**
+ * @brief Paint the stack below the current frame
+ *
+ * Runs from the preinit array, before the constructors and main(), while
+ * hardly any stack is in use.
+ */
+static void memstat_paint_stack(void)
+{
+	uint32_t *p = memstat_stack_bottom();
+	uint32_t *sp = (uint32_t *)(uintptr_t)__get_MSP() - MEMSTAT_PAINT_MARGIN;
+	while (p < sp) {
+		*(volatile uint32_t *)p++ = MEMSTAT_STACK_PAINT;
+	}
+}
+
+__attribute__((section(".preinit_array"), used))
+static void (*memstat_preinit)(void) = memstat_paint_stack;
+
+size_t memstat_stack_used(void)
+{
+	const uint32_t *p = memstat_stack_bottom();
+	const uint32_t *top = &_estack;
+	while ((p < top) && (*p == MEMSTAT_STACK_PAINT)) {
+		p++;
+	}
+	return (uintptr_t)top - (uintptr_t)p;
+}
+
+void memstat_collect(struct memstat *stat)
+{
+	stat->stack_size = (uintptr_t)&_Min_Stack_Size;
+	stat->stack_used = memstat_stack_used();
+	stat->heap_used = memstat_heap_used();
+	stat->pool_size = pool_size();
+	stat->pool_used = 0;
+	for (size_t i = 0; i < POOL_NUM_REGIONS; i++) {
+		stat->pool_used += pool_high_water((enum pool_region)i);
+	}
+}
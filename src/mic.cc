@@ -33,35 +33,79 @@
 #include <cstdint>
 #include <cassert>
 #include <cstring>
-#include <cstdlib>
 #include <cstdio>
 #include "mic.h"
+#include "spsc_ring.h"
 
 extern "C" {
 #include "stm32l4xx_hal.h"
 #include "dma.h"
+#include "capture.h"
 #include "dfsdm.h"
 #include "error.h"
+#include "event.h"
+#include "pool.h"
 }
 
-void speech::mic::init()
+// Filled halves, from the DMA interrupt to read()
+static speech::spsc_ring<speech::mic::block, 4> mic_blocks;
+
+static void mic_block_ready(const int32_t *samples, size_t len)
+{
+	// If the consumer falls behind, the oldest data is overwritten anyway
+	mic_blocks.push({ samples, len });
+	event_signal(EVENT_MIC);
+}
+
+bool speech::mic::init(dfsdm_callback_t callback, size_t buf_size)
 {
 	dma_init();
-	dfsdm_init();
-	this->buf = (int32_t *)malloc(this->buf_size * sizeof(int32_t));
+	dfsdm_init(capture_init(CAPTURE_PROFILE));
+	this->buf_size = buf_size;
+	this->buf = (int32_t *)pool_get(POOL_REGION_MIC,
+					this->buf_size * sizeof(int32_t));
 	if (this->buf == NULL) {
-		ERR("malloc failed.\n");
+		ERR("Buffer exceeds POOL_MIC_SIZE.\n");
+		// ERR() is a no-op in release builds, the DMA must not see NULL
+		dfsdm_deinit();
+		return false;
 	}
+	mic_blocks.clear();
+	dfsdm_set_callback(this->buf, this->buf_size,
+			   (callback != nullptr) ? callback : mic_block_ready);
 
 	if (HAL_DFSDM_FilterRegularStart_DMA(&hdfsdm1_filter0, this->buf,
 					     this->buf_size) != HAL_OK) {
 		ERR("Failed to start conversion.\n");
+		this->stop();
+		return false;
 	}
+	return true;
+}
+
+void speech::mic::stop()
+{
+	dfsdm_deinit();
+	this->buf = NULL;
+}
+
+bool speech::mic::read(block &b)
+{
+	return mic_blocks.pop(b);
 }
 
 void speech::mic::dump_recording()
 {
-	for (size_t i = 0; i < this->buf_size; i++) {
-		printf("%li\n", this->buf[i]);
+	size_t printed = 0;
+	while (printed < this->buf_size) {
+		block b;
+		if (!this->read(b)) {
+			event_wait(EVENT_MIC, EVENT_WAIT_FOREVER);
+			continue;
+		}
+		for (size_t i = 0; i < b.len; i++) {
+			printf("%li\n", b.samples[i]);
+		}
+		printed += b.len;
 	}
 }
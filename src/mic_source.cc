@@ -0,0 +1,67 @@
+/**
+ * @file mic_source.cc
+ * @brief Pipeline source recording from the PDM microphone
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include "mic_source.h"
+
+extern "C" {
+#include "capture.h"
+#include "debug_io.h"
+#include "event.h"
+}
+
+speech::mic_source::mic_source(mic &microphone, int16_t (&waveform)[capacity])
+	: microphone(microphone), waveform(waveform)
+{
+}
+
+bool speech::mic_source::acquire()
+{
+	this->num_samples = 0;
+	if (!this->microphone.init()) {
+		return false;
+	}
+	while (uart_debug_available() == 0) {
+		mic::block b;
+		if (!this->microphone.read(b)) {
+			event_wait(EVENT_MIC | EVENT_UART_RX,
+				   EVENT_WAIT_FOREVER);
+			continue;
+		}
+		// capture_process() writes at most one sample per input
+		if (this->num_samples + b.len > capacity) {
+			break;
+		}
+		this->num_samples += capture_process(
+			b.samples, b.len, this->waveform + this->num_samples);
+	}
+	this->microphone.stop();
+	return this->num_samples > 0;
+}
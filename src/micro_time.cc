@@ -28,6 +28,10 @@ limitations under the License.
 
 #if defined(TF_LITE_USE_CTIME)
 #include <ctime>
+#else
+extern "C" {
+#include "cycles.h"
+}
 #endif
 
 namespace tflite
@@ -35,22 +39,16 @@ namespace tflite
 
 #if !defined(TF_LITE_USE_CTIME)
 
-// Reference implementation of the ticks_per_second() function that's required
-// for a platform to support Tensorflow Lite for Microcontrollers profiling.
-// This returns 0 by default because timing is an optional feature that builds
-// without errors on platforms that do not need it.
+// Profiling ticks are core clock cycles taken from the DWT cycle counter,
+// which is enabled in InitializeTarget().
 uint32_t ticks_per_second()
 {
-	return 0;
+	return SystemCoreClock;
 }
 
-// Reference implementation of the GetCurrentTimeTicks() function that's
-// required for a platform to support Tensorflow Lite for Microcontrollers
-// profiling. This returns 0 by default because timing is an optional feature
-// that builds without errors on platforms that do not need it.
 uint32_t GetCurrentTimeTicks()
 {
-	return 0;
+	return cycles_now();
 }
 
 #else // defined(TF_LITE_USE_CTIME)
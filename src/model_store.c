@@ -0,0 +1,156 @@
+/**
+ * @file model_store.c
+ * @brief Flash slot for models uploaded at runtime
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <string.h>
+
+#include "stm32l4xx_hal.h"
+#include "model_store.h"
+#include <checksum.h>
+
+#define MODEL_STORE_MAGIC 0x4c444f4dUL /* "MODL" */
+
+/**
+ * @brief Stored in front of the model, written last
+ *
+ * The size is a multiple of 16 to keep the model data aligned.
+ */
+struct model_store_header {
+	uint32_t magic;
+	uint32_t len;
+	uint32_t crc32;
+	uint32_t reserved;
+};
+
+/* Defined in the linker script */
+extern uint8_t _smodel_store;
+extern uint8_t _emodel_store;
+
+static uint32_t model_store_start(void)
+{
+	return (uint32_t)&_smodel_store;
+}
+
+static int model_store_program(uint32_t addr, const uint8_t *data, size_t len)
+{
+	int ret = 0;
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+		uint64_t dword;
+		memcpy(&dword, data + i, sizeof(dword));
+		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr + i,
+				      dword) != HAL_OK) {
+			ret = -1;
+			break;
+		}
+	}
+	HAL_FLASH_Lock();
+
+	/* The data cache may still hold the erased contents */
+	__HAL_FLASH_DATA_CACHE_DISABLE();
+	__HAL_FLASH_DATA_CACHE_RESET();
+	__HAL_FLASH_DATA_CACHE_ENABLE();
+
+	if ((ret == 0) && (memcmp((const void *)addr, data, len) != 0)) {
+		ret = -1;
+	}
+	return ret;
+}
+
+int model_store_erase(void)
+{
+	uint32_t start = model_store_start();
+	FLASH_EraseInitTypeDef erase = { 0 };
+	uint32_t page_error = 0;
+
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = (start - FLASH_BASE < FLASH_BANK_SIZE) ? FLASH_BANK_1 :
+							       FLASH_BANK_2;
+	erase.Page = ((start - FLASH_BASE) % FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+	erase.NbPages = ((uint32_t)&_emodel_store - start) / FLASH_PAGE_SIZE;
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase, &page_error);
+	HAL_FLASH_Lock();
+
+	return (status == HAL_OK) ? 0 : -1;
+}
+
+int model_store_write(size_t offset, const uint8_t *data, size_t len)
+{
+	if ((offset % sizeof(uint64_t)) || (len % sizeof(uint64_t)) ||
+	    (offset + len > model_store_capacity())) {
+		return -1;
+	}
+	return model_store_program((uint32_t)model_store_data() + offset, data,
+				   len);
+}
+
+int model_store_commit(size_t len)
+{
+	if (len > model_store_capacity()) {
+		return -1;
+	}
+	struct model_store_header header = {
+		.magic = MODEL_STORE_MAGIC,
+		.len = len,
+		.crc32 = crc_32(model_store_data(), len),
+		.reserved = 0,
+	};
+	return model_store_program(model_store_start(),
+				   (const uint8_t *)&header, sizeof(header));
+}
+
+const uint8_t *model_store_data(void)
+{
+	return &_smodel_store + sizeof(struct model_store_header);
+}
+
+size_t model_store_capacity(void)
+{
+	return (size_t)(&_emodel_store - &_smodel_store) -
+	       sizeof(struct model_store_header);
+}
+
+const uint8_t *model_store_get(size_t *len)
+{
+	const struct model_store_header *header =
+		(const struct model_store_header *)&_smodel_store;
+
+	if ((header->magic != MODEL_STORE_MAGIC) ||
+	    (header->len > model_store_capacity()) ||
+	    (header->crc32 != crc_32(model_store_data(), header->len))) {
+		return NULL;
+	}
+	*len = header->len;
+	return model_store_data();
+}
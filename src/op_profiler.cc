@@ -0,0 +1,100 @@
+/**
+ * @file op_profiler.cc
+ * @brief Per-operator cycle profiler for the TFLM interpreter
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cstdio>
+
+#include <tensorflow/lite/micro/micro_time.h>
+
+#include "op_profiler.h"
+
+extern "C" {
+#include "trace.h"
+}
+
+uint32_t speech::op_profiler::BeginEvent(const char *tag)
+{
+	if (this->num_events >= max_events) {
+		return max_events;
+	}
+	uint32_t handle = this->num_events++;
+	trace_begin(TRACE_OP, handle);
+	this->tags[handle] = tag;
+	this->start[handle] = tflite::GetCurrentTimeTicks();
+	this->end[handle] = this->start[handle];
+	return handle;
+}
+
+void speech::op_profiler::EndEvent(uint32_t event_handle)
+{
+	if (event_handle < max_events) {
+		this->end[event_handle] = tflite::GetCurrentTimeTicks();
+		trace_end(TRACE_OP, event_handle);
+	}
+}
+
+void speech::op_profiler::clear()
+{
+	this->num_events = 0;
+}
+
+size_t speech::op_profiler::events() const
+{
+	return this->num_events;
+}
+
+const char *speech::op_profiler::tag(size_t event) const
+{
+	return this->tags[event];
+}
+
+uint32_t speech::op_profiler::ticks(size_t event) const
+{
+	return this->end[event] - this->start[event];
+}
+
+uint32_t speech::op_profiler::total_ticks() const
+{
+	uint32_t total = 0;
+	for (size_t i = 0; i < this->num_events; i++) {
+		total += this->ticks(i);
+	}
+	return total;
+}
+
+void speech::op_profiler::log() const
+{
+	for (size_t i = 0; i < this->num_events; i++) {
+		printf("[i]     %2u: %-16s %10lu cycles\n", (unsigned)i,
+		       this->tags[i], (unsigned long)this->ticks(i));
+	}
+	printf("[i]     total: %lu cycles\n",
+	       (unsigned long)this->total_ticks());
+}
@@ -0,0 +1,98 @@
+/**
+ * @file pool.c
+ * @brief Statically sized memory regions in place of the heap
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <stdio.h>
+
+#include "pool.h"
+#include "serial.h"
+
+#define POOL_ALIGN(x) (((x) + 7) & ~(size_t)7)
+
+#define POOL_SERIAL_SIZE SERIAL_BATCH_FRAME_LEN
+
+struct pool_layout {
+	const char *name;
+	size_t offset;
+	size_t size;
+};
+
+static const struct pool_layout pool_layout[] = {
+	[POOL_REGION_MIC] = {
+		.name = "mic",
+		.offset = 0,
+		.size = POOL_MIC_SIZE,
+	},
+	[POOL_REGION_SERIAL] = {
+		.name = "serial",
+		.offset = POOL_ALIGN(POOL_MIC_SIZE),
+		.size = POOL_SERIAL_SIZE,
+	},
+};
+
+#define POOL_SIZE (POOL_ALIGN(POOL_MIC_SIZE) + POOL_ALIGN(POOL_SERIAL_SIZE))
+
+_Static_assert(sizeof(pool_layout) / sizeof(pool_layout[0]) ==
+		       POOL_NUM_REGIONS,
+	       "Every region needs a layout entry");
+
+static uint8_t pool_arena[POOL_SIZE] __attribute__((aligned(8)));
+static size_t pool_peak[POOL_NUM_REGIONS];
+
+void *pool_get(enum pool_region region, size_t size)
+{
+	const struct pool_layout *layout = &pool_layout[region];
+	if (size > layout->size) {
+		return NULL;
+	}
+	if (size > pool_peak[region]) {
+		pool_peak[region] = size;
+	}
+	return pool_arena + layout->offset;
+}
+
+size_t pool_high_water(enum pool_region region)
+{
+	return pool_peak[region];
+}
+
+size_t pool_size(void)
+{
+	return POOL_SIZE;
+}
+
+void pool_report(void)
+{
+	for (size_t i = 0; i < POOL_NUM_REGIONS; i++) {
+		printf("pool %-8s %6u / %6u bytes\n", pool_layout[i].name,
+		       (unsigned)pool_peak[i], (unsigned)pool_layout[i].size);
+	}
+	printf("pool total    %6u bytes\n", (unsigned)POOL_SIZE);
+}
@@ -0,0 +1,245 @@
+/**
+ * @file scheduler.c
+ * @brief Prioritized run-to-completion tasks dispatched by the NVIC
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <stdio.h>
+
+#include "stm32l4xx_hal.h"
+#include "clock.h"
+#include "cycles.h"
+#include "event.h"
+#include "scheduler.h"
+#include "trace.h"
+
+/* The interrupts of peripherals this board does not use, one per task */
+static const struct {
+	IRQn_Type irq;
+	uint32_t priority;
+	const char *name;
+} task_vectors[TASK_COUNT] = {
+	[TASK_CAPTURE] = { COMP_IRQn, 2, "capture" },
+	[TASK_FEATURES] = { SWPMI1_IRQn, 4, "features" },
+	[TASK_TELEMETRY] = { LPTIM2_IRQn, 8, "telemetry" },
+	[TASK_INFERENCE] = { TSC_IRQn, 12, "inference" },
+};
+
+/* Masks every task, see scheduler_lock() */
+#define SCHEDULER_LOCK_PRIORITY 2
+
+struct task_state {
+	void (*fn)(void *ctx);
+	void *ctx;
+	uint32_t posted_at; /* Cycle counter at the first unserved post */
+	uint32_t posted_mhz; /* Rate of the cycle counter back then */
+	uint32_t runs;
+	uint64_t busy_us;
+	uint32_t longest_us;
+	uint32_t latency_us;
+};
+
+static struct task_state tasks[TASK_COUNT];
+/* Bit per task posted but not started, and per task running */
+static volatile uint32_t pending;
+static volatile uint32_t running;
+/* Cycles of all finished runs, a preempted task subtracts what the more
+ * urgent ones took meanwhile */
+static volatile uint32_t accounted;
+/* Cycle counter once dispatch() raised the clock the last time. The clock
+ * only goes down again with no task posted, so a task waits across at most
+ * this one switch. */
+static volatile uint32_t boosted_at;
+static uint32_t stats_since;
+
+void COMP_IRQHandler(void);
+void SWPMI1_IRQHandler(void);
+void LPTIM2_IRQHandler(void);
+void TSC_IRQHandler(void);
+
+void scheduler_init(void)
+{
+	for (int i = 0; i < TASK_COUNT; i++) {
+		scheduler_set((enum task)i, NULL, NULL);
+		HAL_NVIC_SetPriority(task_vectors[i].irq,
+				     task_vectors[i].priority, 0);
+	}
+	scheduler_reset_stats();
+}
+
+void scheduler_set(enum task task, void (*fn)(void *ctx), void *ctx)
+{
+	HAL_NVIC_DisableIRQ(task_vectors[task].irq);
+	NVIC_ClearPendingIRQ(task_vectors[task].irq);
+	__disable_irq();
+	pending &= ~(1u << task);
+	__enable_irq();
+	tasks[task].fn = fn;
+	tasks[task].ctx = ctx;
+	if (fn != NULL) {
+		HAL_NVIC_EnableIRQ(task_vectors[task].irq);
+	}
+}
+
+void scheduler_post(enum task task)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if ((pending & (1u << task)) == 0) {
+		pending |= 1u << task;
+		tasks[task].posted_at = cycles_now();
+		tasks[task].posted_mhz = SystemCoreClock / 1000000;
+	}
+	__set_PRIMASK(primask);
+	NVIC_SetPendingIRQ(task_vectors[task].irq);
+}
+
+bool scheduler_idle(void)
+{
+	return (pending | running) == 0;
+}
+
+uint32_t scheduler_lock(void)
+{
+	uint32_t state = __get_BASEPRI();
+	__set_BASEPRI_MAX(SCHEDULER_LOCK_PRIORITY << (8 - __NVIC_PRIO_BITS));
+	return state;
+}
+
+void scheduler_unlock(uint32_t state)
+{
+	__set_BASEPRI(state);
+}
+
+void scheduler_reset_stats(void)
+{
+	uint32_t state = scheduler_lock();
+	for (int i = 0; i < TASK_COUNT; i++) {
+		tasks[i].runs = 0;
+		tasks[i].busy_us = 0;
+		tasks[i].longest_us = 0;
+		tasks[i].latency_us = 0;
+	}
+	stats_since = HAL_GetTick();
+	scheduler_unlock(state);
+}
+
+void scheduler_report(void)
+{
+	uint32_t ms = HAL_GetTick() - stats_since;
+	if (ms == 0) {
+		ms = 1;
+	}
+	for (int i = 0; i < TASK_COUNT; i++) {
+		const struct task_state *t = &tasks[i];
+		/* Tenths of a percent */
+		uint32_t share = (uint32_t)(t->busy_us / ms);
+		printf("task %-9s %8lu runs %3lu.%lu %% cpu, longest %7lu us, "
+		       "latency %6lu us\n",
+		       task_vectors[i].name, (unsigned long)t->runs,
+		       (unsigned long)(share / 10), (unsigned long)(share % 10),
+		       (unsigned long)t->longest_us,
+		       (unsigned long)t->latency_us);
+	}
+}
+
+static void dispatch(enum task task)
+{
+	struct task_state *t = &tasks[task];
+
+	/* Only ever raised here and lowered by the idle main loop, both with
+	 * the tasks locked out */
+	if (clock_get_profile() != CLOCK_PROFILE_BOOST) {
+		uint32_t state = scheduler_lock();
+		clock_set_profile(CLOCK_PROFILE_BOOST);
+		boosted_at = cycles_now();
+		scheduler_unlock(state);
+	}
+
+	__disable_irq();
+	uint32_t start = cycles_now();
+	uint32_t cycles_per_us = SystemCoreClock / 1000000;
+	/* Cycles before the switch, including the PLL relock, went by at the
+	 * rate of the post */
+	uint32_t latency =
+		(t->posted_mhz == cycles_per_us) ?
+			(start - t->posted_at) / cycles_per_us :
+			(boosted_at - t->posted_at) / t->posted_mhz +
+				(start - boosted_at) / cycles_per_us;
+	uint32_t before = accounted;
+	pending &= ~(1u << task);
+	running |= 1u << task;
+	__enable_irq();
+
+	trace_begin(TRACE_TASK, task);
+	if (t->fn != NULL) {
+		t->fn(t->ctx);
+	}
+	trace_end(TRACE_TASK, task);
+
+	__disable_irq();
+	uint32_t own = cycles_now() - start - (accounted - before);
+	accounted += own;
+	running &= ~(1u << task);
+	bool idle = scheduler_idle();
+	__enable_irq();
+
+	/* Tasks only run in CLOCK_PROFILE_BOOST */
+	uint32_t us = own / cycles_per_us;
+	t->runs++;
+	t->busy_us += us;
+	if (us > t->longest_us) {
+		t->longest_us = us;
+	}
+	if (latency > t->latency_us) {
+		t->latency_us = latency;
+	}
+	if (idle) {
+		event_signal(EVENT_TASK);
+	}
+}
+
+void COMP_IRQHandler(void)
+{
+	dispatch(TASK_CAPTURE);
+}
+
+void SWPMI1_IRQHandler(void)
+{
+	dispatch(TASK_FEATURES);
+}
+
+void LPTIM2_IRQHandler(void)
+{
+	dispatch(TASK_TELEMETRY);
+}
+
+void TSC_IRQHandler(void)
+{
+	dispatch(TASK_INFERENCE);
+}
@@ -37,21 +37,56 @@
 
 #include <serial.h>
 #include <checksum.h>
+#include <debug_io.h>
+#include <pool.h>
+#include <trace.h>
 
 static uint32_t bytes_received = 0;
 
-int serial_recv(char* out, size_t len){
-	int i = 0;
-	// Wait for transaction to start
-	do {
-		i += read(STDIN_FILENO, out+i, strlen(SERIAL_CMD_START_TRANSACTION));
-	} while ((strstr(out, SERIAL_CMD_START_TRANSACTION) == NULL) && (i < len));
-	if (i >= len - 1){
-		write(STDOUT_FILENO, SERIAL_CMD_NACK, strlen(SERIAL_CMD_NACK));
-		return 0;
+static const char *const serial_cmds[] = {
+	[SERIAL_CMD_TRANSFER] = SERIAL_CMD_START_TRANSACTION,
+	[SERIAL_CMD_MODEL] = SERIAL_CMD_MODEL_TRANSACTION,
+	[SERIAL_CMD_BATCH] = SERIAL_CMD_BATCH_TRANSACTION,
+	[SERIAL_CMD_AUDIO] = SERIAL_CMD_AUDIO_TRANSACTION,
+	[SERIAL_CMD_MEMORY] = SERIAL_CMD_MEMORY_TRANSACTION,
+	[SERIAL_CMD_LISTEN] = SERIAL_CMD_LISTEN_TRANSACTION,
+	[SERIAL_CMD_TRACE] = SERIAL_CMD_TRACE_TRANSACTION,
+};
+
+// Outstanding batch blocks have to fit into the receive FIFO twice: after a
+// NACK, the blocks dropped by the device may still be queued when the host
+// starts over with a full window
+#define SERIAL_BATCH_WINDOW (UART_RX_FIFO_SIZE / (2 * SERIAL_BATCH_FRAME_LEN))
+
+enum serial_cmd serial_wait_cmd(void)
+{
+	// Sliding window over the last characters received
+	char window[SERIAL_CMD_LEN] = { 0 };
+	while (1) {
+		char c;
+		if (read(STDIN_FILENO, &c, 1) != 1) {
+			continue;
+		}
+		memmove(window, window + 1, SERIAL_CMD_LEN - 1);
+		window[SERIAL_CMD_LEN - 1] = c;
+
+		for (size_t cmd = SERIAL_CMD_TRANSFER;
+		     cmd < sizeof(serial_cmds) / sizeof(serial_cmds[0]);
+		     cmd++) {
+			if (memcmp(window, serial_cmds[cmd], SERIAL_CMD_LEN) ==
+			    0) {
+				trace_mark(TRACE_SERIAL_CMD, cmd);
+				return (enum serial_cmd)cmd;
+			}
+		}
 	}
-	// Send "START" back
-	write(STDOUT_FILENO, SERIAL_CMD_START_TRANSACTION, strlen(SERIAL_CMD_START_TRANSACTION));
+}
+
+int serial_transfer(enum serial_cmd cmd, size_t max_len,
+		    const struct serial_sink *sink)
+{
+	// Send the command back
+	write(STDOUT_FILENO, serial_cmds[cmd], SERIAL_CMD_LEN);
 
 	// Send expected block size
 	char blocksize[5];
@@ -59,16 +94,21 @@ int serial_recv(char* out, size_t len){
 	write(STDOUT_FILENO, blocksize, 4);
 
 	// Receive file size
-	i = 0;
+	char sizebuf[9];
+	int i = 0;
 	while (i < 8){
-		i += read(STDIN_FILENO, out+i, 8-i);
+		i += read(STDIN_FILENO, sizebuf+i, 8-i);
 	}
-	out[8] = '\0';
-	size_t filesize = atoi(out);
+	sizebuf[8] = '\0';
+	size_t filesize = atoi(sizebuf);
 	size_t rounded_filesize = (filesize + SERIAL_BLOCK_SIZE - 1)
 		/ SERIAL_BLOCK_SIZE * SERIAL_BLOCK_SIZE;
 
-	if ((rounded_filesize > len) || (filesize == 0)){
+	if ((rounded_filesize > max_len) || (filesize == 0)){
+		write(STDOUT_FILENO, SERIAL_CMD_NACK, strlen(SERIAL_CMD_NACK));
+		return 0;
+	}
+	if ((sink->begin != NULL) && (sink->begin(sink->ctx, filesize) != 0)){
 		write(STDOUT_FILENO, SERIAL_CMD_NACK, strlen(SERIAL_CMD_NACK));
 		return 0;
 	}
@@ -76,8 +116,10 @@ int serial_recv(char* out, size_t len){
 
 	// Receive data
 	bytes_received = 0;
-	unsigned char blockbuf[SERIAL_BLOCK_SIZE];
+	unsigned char *blockbuf =
+		pool_get(POOL_REGION_SERIAL, SERIAL_BLOCK_SIZE);
 	do {
+		trace_begin(TRACE_SERIAL_BLOCK, bytes_received);
 		int j = 0;
 		char checksum[9];
 		// 32 bit checksum first
@@ -100,15 +142,292 @@ int serial_recv(char* out, size_t len){
 			}
 		}
 
+		int status = -1;
 		if (crc_32(blockbuf, SERIAL_BLOCK_SIZE) == expected_crc32) {
+			status = sink->block(sink->ctx, blockbuf,
+					     bytes_received, SERIAL_BLOCK_SIZE);
+		}
+		if (status == SERIAL_SINK_ABORT) {
+			write(STDOUT_FILENO, SERIAL_CMD_ABORT,
+			      strlen(SERIAL_CMD_ABORT));
+			trace_mark(TRACE_SERIAL_NACK, bytes_received);
+			trace_end(TRACE_SERIAL_BLOCK, bytes_received);
+			return 0;
+		}
+		if (status == 0) {
 			write(STDOUT_FILENO, SERIAL_CMD_ACK, strlen(SERIAL_CMD_ACK));
-			memcpy(out + bytes_received, blockbuf, SERIAL_BLOCK_SIZE);
+			trace_end(TRACE_SERIAL_BLOCK, bytes_received);
 			bytes_received += SERIAL_BLOCK_SIZE;
 		}
 		else {
 			write(STDOUT_FILENO, SERIAL_CMD_NACK, strlen(SERIAL_CMD_NACK));
+			trace_mark(TRACE_SERIAL_NACK, bytes_received);
+			trace_end(TRACE_SERIAL_BLOCK, bytes_received);
 		}
 	} while (bytes_received < rounded_filesize);
 
 	return bytes_received;
 }
+
+static int serial_copy_block(void *ctx, const uint8_t *block, size_t offset,
+			     size_t len)
+{
+	memcpy((char *)ctx + offset, block, len);
+	return 0;
+}
+
+int serial_recv_into(enum serial_cmd cmd, char *buf, size_t len)
+{
+	const struct serial_sink sink = {
+		.begin = NULL,
+		.block = serial_copy_block,
+		.ctx = buf,
+	};
+	return serial_transfer(cmd, len, &sink);
+}
+
+struct serial_payload_state {
+	const struct serial_payload_sink *sink;
+	size_t filesize;
+	size_t skip; // header bytes in front of the payload
+	size_t len;
+	int discarded;
+};
+
+static int serial_payload_begin(void *ctx, size_t filesize)
+{
+	struct serial_payload_state *state = ctx;
+	state->filesize = filesize;
+	return 0;
+}
+
+static int serial_payload_block(void *ctx, const uint8_t *block,
+				size_t offset, size_t len)
+{
+	struct serial_payload_state *state = ctx;
+
+	if (offset == 0) {
+		struct serial_payload_header hdr;
+		enum serial_payload_type type = SERIAL_PAYLOAD_WAVEFORM_U8;
+		memcpy(&hdr, block, sizeof(hdr));
+
+		state->skip = 0;
+		state->len = state->filesize;
+		if (memcmp(hdr.magic, SERIAL_PAYLOAD_MAGIC, sizeof(hdr.magic)) ==
+		    0) {
+			// An empty payload would read as a failed transfer
+			if ((hdr.type >= SERIAL_PAYLOAD_NUM_TYPES) ||
+			    (state->filesize < sizeof(hdr)) || (hdr.len == 0) ||
+			    (hdr.len > state->filesize - sizeof(hdr))) {
+				state->discarded = 1;
+				return 0;
+			}
+			type = (enum serial_payload_type)hdr.type;
+			state->skip = sizeof(hdr);
+			state->len = hdr.len;
+		}
+		state->discarded =
+			(state->sink->begin(state->sink->ctx, type, state->len) !=
+			 0);
+	}
+
+	// Keep the host going, the result is reported after the transfer
+	if (state->discarded) {
+		return 0;
+	}
+
+	// Part of this block that belongs to the payload
+	size_t start = (offset < state->skip) ? (state->skip - offset) : 0;
+	size_t pos = offset + start - state->skip;
+	if (pos >= state->len) {
+		return 0;
+	}
+	size_t n = len - start;
+	if (n > state->len - pos) {
+		n = state->len - pos;
+	}
+	return state->sink->data(state->sink->ctx, block + start, pos, n);
+}
+
+int serial_recv_payload(enum serial_cmd cmd, size_t max_len,
+			const struct serial_payload_sink *sink)
+{
+	struct serial_payload_state state = {
+		.sink = sink,
+	};
+	const struct serial_sink raw = {
+		.begin = serial_payload_begin,
+		.block = serial_payload_block,
+		.ctx = &state,
+	};
+	if (serial_transfer(cmd, max_len, &raw) == 0) {
+		return 0;
+	}
+	return state.discarded ? -1 : (int)state.len;
+}
+
+static void serial_read_exact(char *buf, size_t len)
+{
+	size_t i = 0;
+	while (i < len) {
+		int n = read(STDIN_FILENO, buf + i, len - i);
+		if (n > 0) {
+			i += n;
+		}
+	}
+}
+
+/**
+ * @brief Wait for a frame, but give up on it once the line goes quiet
+ * halfway through
+ * @returns bytes received, less than len if a byte got lost on the line
+ */
+static size_t serial_read_frame(char *buf, size_t len)
+{
+	size_t i = 0;
+	while (i < len) {
+		int n = read(STDIN_FILENO, buf + i, len - i);
+		if (n > 0) {
+			i += n;
+		} else if (i > 0) {
+			break;
+		}
+	}
+	return i;
+}
+
+/**
+ * @brief Drop everything until the host waits for a reply, so the next
+ * frame is read from its start
+ */
+static void serial_resync(void)
+{
+	char c;
+	while (read(STDIN_FILENO, &c, 1) == 1)
+		;
+}
+
+/**
+ * @returns 0 if all len characters are hex digits
+ */
+static int serial_parse_hex(const char *field, size_t len, uint32_t *value)
+{
+	*value = 0;
+	for (size_t i = 0; i < len; i++) {
+		char c = field[i];
+		uint32_t digit;
+		if ((c >= '0') && (c <= '9')) {
+			digit = c - '0';
+		} else if ((c >= 'a') && (c <= 'f')) {
+			digit = c - 'a' + 10;
+		} else if ((c >= 'A') && (c <= 'F')) {
+			digit = c - 'A' + 10;
+		} else {
+			return -1;
+		}
+		*value = (*value << 4) | digit;
+	}
+	return 0;
+}
+
+int serial_batch(size_t max_len, const struct serial_batch_sink *sink)
+{
+	write(STDOUT_FILENO, SERIAL_CMD_BATCH_TRANSACTION, SERIAL_CMD_LEN);
+
+	// Block size and window
+	char params[7];
+	snprintf(params, sizeof(params), "%04u%02u", SERIAL_BLOCK_SIZE,
+		 SERIAL_BATCH_WINDOW);
+	write(STDOUT_FILENO, params, 6);
+
+	// Number of clips and size of every clip
+	char sizebuf[9] = { 0 };
+	serial_read_exact(sizebuf, 8);
+	uint32_t clips = strtoul(sizebuf, NULL, 10);
+	serial_read_exact(sizebuf, 8);
+	size_t filesize = strtoul(sizebuf, NULL, 10);
+	uint32_t clip_blocks =
+		(filesize + SERIAL_BLOCK_SIZE - 1) / SERIAL_BLOCK_SIZE;
+
+	// clips * clip_blocks counts every block of the batch
+	if ((clips == 0) || (filesize == 0) ||
+	    (clips > UINT32_MAX / clip_blocks) ||
+	    (clip_blocks * SERIAL_BLOCK_SIZE > max_len)) {
+		write(STDOUT_FILENO, SERIAL_CMD_NACK, strlen(SERIAL_CMD_NACK));
+		return 0;
+	}
+	write(STDOUT_FILENO, SERIAL_CMD_ACK, strlen(SERIAL_CMD_ACK));
+
+	struct serial_payload_state state = {
+		.sink = sink->payload,
+		.filesize = filesize,
+	};
+	char *frame = pool_get(POOL_REGION_SERIAL, SERIAL_BATCH_FRAME_LEN);
+	uint32_t total = clips * clip_blocks;
+	uint32_t expected = 0;
+	while (expected < total) {
+		uint32_t seq;
+		if ((serial_read_frame(frame, SERIAL_BATCH_FRAME_LEN) <
+		     SERIAL_BATCH_FRAME_LEN) ||
+		    (serial_parse_hex(frame, 4, &seq) != 0) ||
+		    ((uint16_t)(seq - expected + SERIAL_BATCH_WINDOW) >=
+		     2 * SERIAL_BATCH_WINDOW)) {
+			// A byte was lost or inserted, or the number is garbled:
+			// the frames no longer line up with the reads. Once the
+			// host waits for a reply, it starts over with the oldest
+			// unacknowledged block at a frame boundary.
+			serial_resync();
+			write(STDOUT_FILENO, SERIAL_CMD_NACK,
+			      strlen(SERIAL_CMD_NACK));
+			trace_mark(TRACE_SERIAL_NACK, expected);
+			continue;
+		}
+		if (seq != (uint16_t)expected) {
+			// Sent before the host saw the NACK of an earlier block,
+			// or again before it saw the ACK
+			trace_mark(TRACE_SERIAL_SKIP, seq);
+			continue;
+		}
+		trace_begin(TRACE_SERIAL_FRAME, expected);
+		uint32_t expected_crc32;
+		int crc_valid = serial_parse_hex(frame + 4, 8, &expected_crc32);
+
+		const uint8_t *block = (const uint8_t *)frame + 12;
+		size_t offset = (expected % clip_blocks) * SERIAL_BLOCK_SIZE;
+		if ((crc_valid != 0) ||
+		    (crc_32(block, SERIAL_BLOCK_SIZE) != expected_crc32) ||
+		    (serial_payload_block(&state, block, offset,
+					  SERIAL_BLOCK_SIZE) != 0)) {
+			write(STDOUT_FILENO, SERIAL_CMD_NACK,
+			      strlen(SERIAL_CMD_NACK));
+			trace_mark(TRACE_SERIAL_NACK, expected);
+			trace_end(TRACE_SERIAL_FRAME, expected);
+			continue;
+		}
+		write(STDOUT_FILENO, SERIAL_CMD_ACK, strlen(SERIAL_CMD_ACK));
+		trace_end(TRACE_SERIAL_FRAME, expected);
+		expected++;
+
+		if (expected % clip_blocks == 0) {
+			sink->clip_done(sink->ctx,
+					expected / clip_blocks - 1,
+					state.discarded ? -1 : (int)state.len);
+		}
+	}
+	return clips;
+}
+
+void serial_send_result(const void *record, uint8_t len)
+{
+	// Binary, must not go through the newline translation of write()
+	uart_debug_write_raw(SERIAL_CMD_RESULT, strlen(SERIAL_CMD_RESULT));
+	uart_debug_write_raw(&len, 1);
+	uart_debug_write_raw(record, len);
+}
+
+int serial_recv(char* out, size_t len){
+	// Wait for transaction to start
+	while (serial_wait_cmd() != SERIAL_CMD_TRANSFER)
+		;
+	return serial_recv_into(SERIAL_CMD_TRANSFER, out, len);
+}
@@ -0,0 +1,266 @@
+/**
+ * @file step_classifier.cc
+ * @brief Keyword classifier that runs one spectrogram column at a time
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include "step_classifier.h"
+
+static bool is_byte_tensor(const tflite::Tensor *tensor)
+{
+	return (tensor->type() == tflite::TensorType_UINT8) ||
+	       (tensor->type() == tflite::TensorType_INT8);
+}
+
+/**
+ * @brief Bytes taken by all state inputs of a validated model
+ */
+static size_t state_size(const tflite::Model *model)
+{
+	const tflite::SubGraph *subgraph = model->subgraphs()->Get(0);
+	size_t size = 0;
+	for (size_t i = 1; i < subgraph->inputs()->size(); i++) {
+		size += speech::num_elements(
+			subgraph->tensors()->Get(subgraph->inputs()->Get(i)));
+	}
+	return size;
+}
+
+speech::step_classifier::step_classifier(
+	uint8_t *arena, size_t arena_size,
+	tflite::MicroProfilerInterface *profiler)
+	: arena(arena)
+	, arena_size(arena_size)
+	, profiler(profiler)
+{
+	if (resolver.AddConv2D() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddRelu() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddAveragePool2D() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddConcatenation() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddStridedSlice() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddSlice() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddReshape() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddFullyConnected() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddQuantize() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddDequantize() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	// Normalization, unless the converter folded it
+	if (resolver.AddSub() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddMul() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddAdd() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+}
+
+speech::step_classifier::~step_classifier()
+{
+	this->unload();
+}
+
+bool speech::step_classifier::validate(const uint8_t *buf, size_t len)
+{
+	const tflite::SubGraph *subgraph = speech::model_subgraph(buf, len);
+	if (subgraph == nullptr) {
+		return false;
+	}
+	const auto *tensors = subgraph->tensors();
+	if ((subgraph->inputs()->size() < 2) ||
+	    (subgraph->inputs()->size() != subgraph->outputs()->size())) {
+		return false;
+	}
+	const tflite::Tensor *column = tensors->Get(subgraph->inputs()->Get(0));
+	const tflite::Tensor *scores = tensors->Get(subgraph->outputs()->Get(0));
+	if ((column->type() != tflite::TensorType_UINT8) ||
+	    (scores->type() != tflite::TensorType_UINT8) ||
+	    (num_elements(column) != frontend::num_bins) ||
+	    (num_elements(scores) != num_labels)) {
+		return false;
+	}
+
+	// Every state comes back with the same shape and type
+	for (size_t i = 1; i < subgraph->inputs()->size(); i++) {
+		const tflite::Tensor *in =
+			tensors->Get(subgraph->inputs()->Get(i));
+		const tflite::Tensor *out =
+			tensors->Get(subgraph->outputs()->Get(i));
+		if (!is_byte_tensor(in) || (in->type() != out->type()) ||
+		    (num_elements(in) != num_elements(out))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void speech::step_classifier::unload()
+{
+	if (this->interp != nullptr) {
+		this->interp->~MicroInterpreter();
+		this->interp = nullptr;
+	}
+	this->states = nullptr;
+}
+
+bool speech::step_classifier::load(const uint8_t *buf)
+{
+	this->unload();
+
+	// The staged states are carved off the end of the arena
+	const tflite::Model *model = tflite::GetModel(buf);
+	size_t staging = (state_size(model) + 15) & ~(size_t)15;
+	if (staging >= this->arena_size) {
+		return false;
+	}
+	this->states = this->arena + this->arena_size - staging;
+
+	this->interp = new (this->storage)
+		tflite::MicroInterpreter(model, this->resolver, this->arena,
+					 this->arena_size - staging, nullptr,
+					 this->profiler);
+	if (this->interp->AllocateTensors() != kTfLiteOk) {
+		this->unload();
+		return false;
+	}
+	this->reset();
+	return true;
+}
+
+void speech::step_classifier::reset()
+{
+	// A state of zero, as during training
+	for (size_t i = 1; i < this->interp->inputs_size(); i++) {
+		TfLiteTensor *state = this->interp->input(i);
+		memset(state->data.raw, state->params.zero_point, state->bytes);
+	}
+	this->steps = 0;
+}
+
+TfLiteTensor *speech::step_classifier::column()
+{
+	return this->interp->input(0);
+}
+
+TfLiteTensor *speech::step_classifier::output()
+{
+	return this->interp->output(0);
+}
+
+uint8_t speech::step_classifier::score(size_t label)
+{
+	return this->output()->data.uint8[label];
+}
+
+bool speech::step_classifier::step()
+{
+	if (this->interp->Invoke() != kTfLiteOk) {
+		return false;
+	}
+	this->carry();
+	if (this->steps < classifier::input_frames) {
+		this->steps++;
+	}
+	return true;
+}
+
+bool speech::step_classifier::warm() const
+{
+	return this->steps >= classifier::input_frames;
+}
+
+size_t speech::step_classifier::arena_used() const
+{
+	return (this->interp != nullptr) ? this->interp->arena_used_bytes() : 0;
+}
+
+void speech::step_classifier::carry()
+{
+	// The memory planner may reuse the buffer of one state input for
+	// another state output, so all of them are staged first
+	const size_t num_states = this->interp->outputs_size();
+	uint8_t *staged = this->states;
+	for (size_t i = 1; i < num_states; i++) {
+		const TfLiteTensor *out = this->interp->output(i);
+		memcpy(staged, out->data.raw, out->bytes);
+		staged += out->bytes;
+	}
+
+	staged = this->states;
+	for (size_t i = 1; i < num_states; i++) {
+		const TfLiteTensor *out = this->interp->output(i);
+		TfLiteTensor *in = this->interp->input(i);
+		if ((out->params.scale == in->params.scale) &&
+		    (out->params.zero_point == in->params.zero_point)) {
+			memcpy(in->data.raw, staged, in->bytes);
+			staged += in->bytes;
+			continue;
+		}
+
+		// Quantized independently by the converter
+		const bool is_signed = (in->type == kTfLiteInt8);
+		const int32_t lo = is_signed ? -128 : 0;
+		const int32_t hi = is_signed ? 127 : 255;
+		const float rescale = out->params.scale / in->params.scale;
+		for (size_t j = 0; j < in->bytes; j++) {
+			int32_t q = is_signed ? (int32_t)(int8_t)staged[j] :
+						(int32_t)staged[j];
+			float real = (float)(q - out->params.zero_point);
+			int32_t v = (int32_t)lroundf(real * rescale) +
+				    in->params.zero_point;
+			v = (v < lo) ? lo : ((v > hi) ? hi : v);
+			in->data.raw[j] = (char)v;
+		}
+		staged += in->bytes;
+	}
+}
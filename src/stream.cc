@@ -0,0 +1,189 @@
+/**
+ * @file stream.cc
+ * @brief Framed binary stream to the host over the debug UART
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cstring>
+#include <unistd.h>
+
+#include "spsc_ring.h"
+
+extern "C" {
+#include "stm32l4xx_hal.h"
+#include "capture.h"
+#include "debug_io.h"
+#include "dma.h"
+#include "event.h"
+#include "stream.h"
+#include "trace.h"
+
+extern UART_HandleTypeDef uart_hd_debug_uart;
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *uart_hd);
+}
+
+#define STREAM_DEBUG_BAUDRATE 115200
+
+struct stream_slot {
+	struct stream_header header;
+	uint8_t payload[STREAM_MAX_PAYLOAD];
+};
+
+/* Filled in place by stream_write(), sent in place by the DMA. Writers may
+ * be interrupts as well as the main loop, so they take turns with
+ * interrupts disabled. */
+static speech::spsc_ring<stream_slot, STREAM_SLOTS> stream_slots;
+static volatile bool stream_busy = false;
+static bool stream_active = false;
+static uint16_t stream_seq = 0;
+static uint32_t stream_drops = 0;
+
+/* Interrupts have to be disabled */
+static void stream_kick(void)
+{
+	if (stream_busy) {
+		return;
+	}
+	auto filled = stream_slots.read_span();
+	if (filled.size == 0) {
+		return;
+	}
+	stream_slot *slot = filled.data;
+	if (HAL_UART_Transmit_DMA(&uart_hd_debug_uart, (uint8_t *)slot,
+				  sizeof(slot->header) + slot->header.len) ==
+	    HAL_OK) {
+		trace_begin(TRACE_STREAM_FRAME, slot->header.seq);
+		stream_busy = true;
+	}
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *uart_hd)
+{
+	// This overrides the HAL for every UART. stream_stop() clears
+	// stream_active before the last frames are out, stream_busy is what
+	// tells that a frame of ours was sent.
+	if ((uart_hd->Instance != uart_hd_debug_uart.Instance) ||
+	    !stream_busy) {
+		return;
+	}
+	auto sent = stream_slots.read_span();
+	if (sent.size == 0) {
+		stream_busy = false;
+		return;
+	}
+	trace_end(TRACE_STREAM_FRAME, sent.data->header.seq);
+	stream_slots.consume(1);
+	event_signal(EVENT_UART_TX);
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	stream_busy = false;
+	stream_kick();
+	__set_PRIMASK(primask);
+}
+
+int stream_write(uint8_t type, uint8_t flags, const void *payload,
+		 size_t len)
+{
+	if (!stream_active || (len > STREAM_MAX_PAYLOAD)) {
+		return -1;
+	}
+
+	int ret = -1;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	auto free = stream_slots.write_span();
+	if (free.size == 0) {
+		stream_drops++;
+		trace_mark(TRACE_STREAM_DROP, stream_seq);
+	} else {
+		stream_slot *slot = free.data;
+		slot->header.sync = STREAM_SYNC;
+		slot->header.type = type;
+		slot->header.flags = flags;
+		slot->header.seq = stream_seq;
+		slot->header.len = len;
+		slot->header.drops = stream_drops;
+		memcpy(slot->payload, payload, len);
+		stream_slots.commit(1);
+		stream_kick();
+		ret = 0;
+	}
+	stream_seq++;
+	__set_PRIMASK(primask);
+	return ret;
+}
+
+void stream_audio(const int32_t *samples, size_t len)
+{
+	int16_t frame[STREAM_MAX_PAYLOAD / sizeof(int16_t)];
+	const size_t frame_len = sizeof(frame) / sizeof(frame[0]);
+
+	while (len > 0) {
+		size_t n = (len < frame_len) ? len : frame_len;
+		size_t m = capture_process(samples, n, frame);
+		stream_write(STREAM_TYPE_AUDIO, 0, frame, m * sizeof(int16_t));
+		samples += n;
+		len -= n;
+	}
+}
+
+int stream_start(void)
+{
+	if (dma_uart_tx_init(&uart_hd_debug_uart) != 0) {
+		return -1;
+	}
+	uart_debug_set_baudrate(STREAM_BAUDRATE);
+
+	// The host confirms it switched over as well
+	char c = 0;
+	if ((read(STDIN_FILENO, &c, 1) != 1) || (c != 'A')) {
+		uart_debug_set_baudrate(STREAM_DEBUG_BAUDRATE);
+		return -1;
+	}
+
+	stream_slots.clear();
+	stream_seq = 0;
+	stream_drops = 0;
+	stream_active = true;
+
+	struct stream_info info = {};
+	info.sample_rate = capture_sample_rate();
+	info.bits = 16;
+	info.channels = 1;
+	return stream_write(STREAM_TYPE_INFO, 0, &info, sizeof(info));
+}
+
+void stream_stop(void)
+{
+	stream_active = false;
+	while (!stream_slots.empty()) {
+		event_wait(EVENT_UART_TX, EVENT_WAIT_FOREVER);
+	}
+	uart_debug_set_baudrate(STREAM_DEBUG_BAUDRATE);
+}
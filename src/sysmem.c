@@ -24,10 +24,14 @@
 #include <errno.h>
 #include <stdint.h>
 
+#include "memstat.h"
+
+#ifndef NO_HEAP
 /**
  * Pointer to the current high watermark of the heap usage
  */
 static uint8_t *__sbrk_heap_end = NULL;
+#endif
 
 /**
  * @brief _sbrk() allocates memory to the newlib heap and is used by malloc
@@ -47,11 +51,20 @@ static uint8_t *__sbrk_heap_end = NULL;
  * NOTE: If the MSP stack, at any point during execution, grows larger than the
  * reserved size, please increase the '_Min_Stack_Size'.
  *
+ * With NO_HEAP, the heap is empty: malloc() and friends are not linked at
+ * all (see CMakeLists.txt), and allocations made inside the C library fail
+ * with ENOMEM. Buffers come from pool.h instead.
+ *
  * @param incr Memory size
  * @return Pointer to allocated memory
  */
 void *_sbrk(ptrdiff_t incr)
 {
+#ifdef NO_HEAP
+	(void)incr;
+	errno = ENOMEM;
+	return (void *)-1;
+#else
 	extern uint8_t _end; /* Symbol defined in the linker script */
 	extern uint8_t _estack; /* Symbol defined in the linker script */
 	extern uint32_t _Min_Stack_Size; /* Symbol defined in the linker script */
@@ -75,4 +88,15 @@ void *_sbrk(ptrdiff_t incr)
 	__sbrk_heap_end += incr;
 
 	return (void *)prev_heap_end;
+#endif
+}
+
+size_t memstat_heap_used(void)
+{
+#ifdef NO_HEAP
+	return 0;
+#else
+	extern uint8_t _end; /* Symbol defined in the linker script */
+	return (__sbrk_heap_end != NULL) ? (size_t)(__sbrk_heap_end - &_end) : 0;
+#endif
 }
@@ -20,7 +20,10 @@ extern "C" {
 #include "stm32l4xx_hal.h"
 #include "stm32l475e_iot01.h"
 #include "clock.h"
+#include "cycles.h"
 #include "debug_io.h"
+#include "event.h"
+#include "scheduler.h"
 }
 
 extern "C" void init_hw(void);
@@ -52,6 +55,15 @@ void init_hw(void)
 	/* Configure and start the necessary clocks and PLLs */
 	SystemClock_Config();
 
+	/* Cycle counter for profiling */
+	cycles_init();
+
+	/* Waiting for the host sleeps instead of spinning */
+	event_init();
+
+	/* Capture, features and inference preempt each other, see scheduler.h */
+	scheduler_init();
+
 	BSP_LED_Init(LED2);
 	BSP_LED_On(LED2);
 
@@ -0,0 +1,123 @@
+/**
+ * @file trace.c
+ * @brief Timestamped event trace in RAM
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <checksum.h>
+#include <serial.h>
+
+#ifdef TRACE_SIZE
+#include "stm32l4xx_hal.h"
+#include "debug_io.h"
+#endif
+#include "trace.h"
+
+#ifdef TRACE_SIZE
+_Static_assert(((TRACE_SIZE & (TRACE_SIZE - 1)) == 0) &&
+		       (TRACE_SIZE <= UINT16_MAX),
+	       "TRACE_SIZE must be a power of two below 65536");
+
+struct trace_event trace_events[TRACE_SIZE];
+/* Free running, like the indices of speech::spsc_ring */
+uint32_t trace_head;
+volatile bool trace_paused;
+/* Events before this one went out with the last dump */
+static uint32_t trace_tail;
+
+void trace_sleep_end(uint32_t begin)
+{
+	/* SysTick counts down and wakes the core when it wraps, so it wrapped
+	 * at most once */
+	uint32_t now = SysTick->VAL;
+	uint32_t cycles = (now <= begin) ? begin - now :
+					   begin + SysTick->LOAD + 1 - now;
+	struct trace_event *last =
+		&trace_events[(trace_head - 1) & (TRACE_SIZE - 1)];
+	if (!trace_paused && (trace_head != trace_tail) &&
+	    (last->id == TRACE_SLEEP)) {
+		last->cycles = cycles_now();
+		last->arg += cycles;
+		return;
+	}
+	trace_mark(TRACE_SLEEP, cycles);
+}
+
+static uint32_t trace_crc(uint32_t crc, const void *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		crc = update_crc_32(crc, ((const uint8_t *)data)[i]);
+	}
+	return crc;
+}
+#endif
+
+void trace_dump(void)
+{
+	write(STDOUT_FILENO, SERIAL_CMD_TRACE_TRANSACTION, SERIAL_CMD_LEN);
+#ifndef TRACE_SIZE
+	write(STDOUT_FILENO, SERIAL_CMD_NACK, strlen(SERIAL_CMD_NACK));
+#else
+	/* Nothing may move while the events go out, the UART would trace
+	 * itself */
+	trace_paused = true;
+	uint32_t total = trace_head - trace_tail;
+	uint32_t num_events = (total < TRACE_SIZE) ? total : TRACE_SIZE;
+	struct trace_header header = {
+		.core_clock = SystemCoreClock,
+		.lost = total - num_events,
+		.num_events = num_events,
+		.event_size = sizeof(struct trace_event),
+	};
+	uint32_t first = trace_head - num_events;
+
+	uint32_t crc = trace_crc(CRC_START_32, &header, sizeof(header));
+	for (uint32_t i = first; i != trace_head; i++) {
+		crc = trace_crc(crc, &trace_events[i & (TRACE_SIZE - 1)],
+				sizeof(struct trace_event));
+	}
+	crc ^= 0xffffffff;
+
+	const uint32_t len =
+		sizeof(header) + num_events * sizeof(struct trace_event);
+	uart_debug_write_raw(SERIAL_CMD_ACK, strlen(SERIAL_CMD_ACK));
+	uart_debug_write_raw(&len, sizeof(len));
+	uart_debug_write_raw(&header, sizeof(header));
+	for (uint32_t i = first; i != trace_head; i++) {
+		uart_debug_write_raw(&trace_events[i & (TRACE_SIZE - 1)],
+				     sizeof(struct trace_event));
+	}
+	uart_debug_write_raw(&crc, sizeof(crc));
+
+	trace_tail = trace_head;
+	trace_paused = false;
+#endif
+}
@@ -0,0 +1,125 @@
+/**
+ * @file uart_source.cc
+ * @brief Pipeline source fed by serial payloads
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cstring>
+
+#include "uart_source.h"
+
+speech::uart_source::uart_source(int16_t (&waveform)[capacity])
+	: waveform(waveform)
+{
+	this->payload_sink = { begin, data, this };
+}
+
+const struct serial_payload_sink *speech::uart_source::sink(uint8_t *features)
+{
+	this->input = features;
+	this->num_samples = 0;
+	return &this->payload_sink;
+}
+
+int speech::uart_source::begin(void *ctx, enum serial_payload_type type,
+			       size_t len)
+{
+	uart_source *src = (uart_source *)ctx;
+	src->type = type;
+	switch (type) {
+	case SERIAL_PAYLOAD_WAVEFORM_U8:
+		src->num_samples = len;
+		break;
+	case SERIAL_PAYLOAD_WAVEFORM_S16:
+		if (len % 2 != 0) {
+			return -1;
+		}
+		src->num_samples = len / 2;
+		break;
+	case SERIAL_PAYLOAD_WAVEFORM_ADPCM:
+		if (len < ADPCM_PREAMBLE_LEN) {
+			return -1;
+		}
+		src->num_samples = 2 * (len - ADPCM_PREAMBLE_LEN);
+		break;
+	case SERIAL_PAYLOAD_FEATURES_U8:
+		src->num_samples = 0;
+#ifdef INT8_IO
+		// Quantized for a uint8 input, not the scale of this one
+		return -1;
+#else
+		return (len == frontend::features_size) ? 0 : -1;
+#endif
+	default:
+		return -1;
+	}
+	// The value range of no samples is undefined
+	if ((src->num_samples == 0) || (src->num_samples > capacity)) {
+		return -1;
+	}
+	return 0;
+}
+
+int speech::uart_source::data(void *ctx, const uint8_t *data, size_t offset,
+			      size_t len)
+{
+	uart_source *src = (uart_source *)ctx;
+	int16_t *waveform = src->waveform;
+	switch (src->type) {
+	case SERIAL_PAYLOAD_WAVEFORM_U8:
+		// Same value range as 16-bit samples
+		for (size_t i = 0; i < len; i++) {
+			waveform[offset + i] = (int16_t)((data[i] - 128) * 256);
+		}
+		break;
+	case SERIAL_PAYLOAD_WAVEFORM_S16:
+		for (size_t i = 0; i + 1 < len; i += 2) {
+			waveform[(offset + i) / 2] =
+				(int16_t)(data[i] | (data[i + 1] << 8));
+		}
+		break;
+	case SERIAL_PAYLOAD_WAVEFORM_ADPCM:
+		// Decoded as the blocks arrive, which are always in order
+		if (offset == 0) {
+			adpcm_init(&src->adpcm, data);
+			data += ADPCM_PREAMBLE_LEN;
+			len -= ADPCM_PREAMBLE_LEN;
+		} else {
+			offset -= ADPCM_PREAMBLE_LEN;
+		}
+		adpcm_decode(&src->adpcm, data, len, waveform + 2 * offset);
+		break;
+	case SERIAL_PAYLOAD_FEATURES_U8:
+		// Straight into the input tensor, no front end needed
+		memcpy(src->input + offset, data, len);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
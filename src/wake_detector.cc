@@ -0,0 +1,168 @@
+/**
+ * @file wake_detector.cc
+ * @brief Small always-on model that decides when to run the classifier
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cassert>
+#include <cstring>
+#include <new>
+
+#include "wake_detector.h"
+
+speech::wake_detector::wake_detector(uint8_t *arena, size_t arena_size,
+				     tflite::MicroProfilerInterface *profiler)
+	: arena(arena)
+	, arena_size(arena_size)
+	, profiler(profiler)
+{
+	if (resolver.AddConv2D() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddMaxPool2D() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddReshape() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddFullyConnected() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddLogistic() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	if (resolver.AddQuantize() != kTfLiteOk) {
+		assert(!"Failed to add op");
+	}
+	this->reset();
+}
+
+speech::wake_detector::~wake_detector()
+{
+	this->unload();
+}
+
+bool speech::wake_detector::validate(const uint8_t *buf, size_t len)
+{
+	const tflite::SubGraph *subgraph = speech::model_subgraph(buf, len);
+	if (subgraph == nullptr) {
+		return false;
+	}
+	if ((subgraph->inputs()->size() != 1) ||
+	    (subgraph->outputs()->size() != 1)) {
+		return false;
+	}
+	const auto *tensors = subgraph->tensors();
+	const tflite::Tensor *input = tensors->Get(subgraph->inputs()->Get(0));
+	const tflite::Tensor *output =
+		tensors->Get(subgraph->outputs()->Get(0));
+	return (input->type() == tflite::TensorType_UINT8) &&
+	       (output->type() == tflite::TensorType_UINT8) &&
+	       (num_elements(input) == num_rows * num_bands) &&
+	       (num_elements(output) == 1);
+}
+
+bool speech::wake_detector::load(const uint8_t *buf)
+{
+	this->unload();
+	this->interp = new (this->storage) tflite::MicroInterpreter(
+		tflite::GetModel(buf), this->resolver, this->arena,
+		this->arena_size, nullptr, this->profiler);
+	if (this->interp->AllocateTensors() != kTfLiteOk) {
+		this->unload();
+		return false;
+	}
+	this->reset();
+	return true;
+}
+
+void speech::wake_detector::unload()
+{
+	if (this->interp != nullptr) {
+		this->interp->~MicroInterpreter();
+		this->interp = nullptr;
+	}
+}
+
+bool speech::wake_detector::loaded() const
+{
+	return this->interp != nullptr;
+}
+
+void speech::wake_detector::reset()
+{
+	memset(this->sums, 0, sizeof(this->sums));
+	this->columns = 0;
+	this->filled = 0;
+}
+
+bool speech::wake_detector::push(const uint8_t *column)
+{
+	for (size_t band = 0; band < num_bands; band++) {
+		const uint8_t *bins = column + band * pool_bins;
+		for (size_t i = 0; i < pool_bins; i++) {
+			this->sums[band] += bins[i];
+		}
+	}
+	if (++this->columns < pool_frames) {
+		return false;
+	}
+
+	memmove(this->rows, this->rows + num_bands,
+		(num_rows - 1) * num_bands);
+	uint8_t *row = this->rows + (num_rows - 1) * num_bands;
+	for (size_t band = 0; band < num_bands; band++) {
+		row[band] = this->sums[band] / (pool_frames * pool_bins);
+		this->sums[band] = 0;
+	}
+	this->columns = 0;
+	if (this->filled < num_rows) {
+		this->filled++;
+	}
+	return true;
+}
+
+bool speech::wake_detector::warm() const
+{
+	return this->filled >= num_rows;
+}
+
+uint8_t speech::wake_detector::invoke()
+{
+	memcpy(this->interp->input(0)->data.uint8, this->rows,
+	       sizeof(this->rows));
+	if (this->interp->Invoke() != kTfLiteOk) {
+		return 0;
+	}
+	return this->interp->output(0)->data.uint8[0];
+}
+
+size_t speech::wake_detector::arena_used() const
+{
+	return (this->interp != nullptr) ? this->interp->arena_used_bytes() : 0;
+}
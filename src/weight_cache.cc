@@ -0,0 +1,146 @@
+/**
+ * @file weight_cache.cc
+ * @brief Copies constant weight tensors from flash into SRAM
+ */
+
+/*
+ * Copyright (C) 2024 Stefan Gloor
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "weight_cache.h"
+
+static uint32_t profiled_invoke(tflite::MicroInterpreter &interpreter,
+				speech::op_profiler &profiler)
+{
+	profiler.clear();
+	if (interpreter.Invoke() != kTfLiteOk) {
+		return 0;
+	}
+	return profiler.total_ticks();
+}
+
+speech::weight_cache::weight_cache(uint8_t *pool, size_t pool_size)
+	: pool(pool)
+	, pool_size(pool_size)
+{
+}
+
+size_t speech::weight_cache::promote(const tflite::Model *model,
+				     tflite::MicroInterpreter &interpreter,
+				     op_profiler &profiler)
+{
+	const tflite::SubGraph *subgraph = model->subgraphs()->Get(0);
+	const size_t num_ops = subgraph->operators()->size();
+
+	uint32_t total = profiled_invoke(interpreter, profiler);
+	if (profiler.events() != num_ops) {
+		// Events cannot be mapped to operators
+		return 0;
+	}
+	this->baseline = total;
+
+	uint32_t op_ticks[op_profiler::max_events];
+	for (size_t i = 0; i < num_ops; i++) {
+		op_ticks[i] = profiler.ticks(i);
+	}
+
+	bool visited[op_profiler::max_events] = {};
+	for (size_t n = 0; n < num_ops; n++) {
+		// Most expensive operator not visited yet
+		size_t op = num_ops;
+		for (size_t i = 0; i < num_ops; i++) {
+			if (!visited[i] &&
+			    (op == num_ops || op_ticks[i] > op_ticks[op])) {
+				op = i;
+			}
+		}
+		visited[op] = true;
+
+		const tflite::Operator *oper = subgraph->operators()->Get(op);
+		for (size_t j = 0; j < oper->inputs()->size(); j++) {
+			int32_t idx = oper->inputs()->Get(j);
+			// Optional inputs are marked with -1
+			if (idx < 0) {
+				continue;
+			}
+			const tflite::Tensor *tensor =
+				subgraph->tensors()->Get(idx);
+			const tflite::Buffer *buffer =
+				model->buffers()->Get(tensor->buffer());
+			if (buffer->data() == nullptr ||
+			    buffer->data()->size() == 0) {
+				// Not a constant tensor
+				continue;
+			}
+
+			// Skip tensors that were already moved
+			TfLiteEvalTensor *eval = interpreter.GetTensor(idx);
+			const uint8_t *flash = buffer->data()->data();
+			if (eval == nullptr || eval->data.data != flash) {
+				continue;
+			}
+
+			size_t bytes = buffer->data()->size();
+			size_t offset = (this->used + 15) & ~((size_t)15);
+			if ((offset + bytes > this->pool_size) ||
+			    (this->count >= max_entries)) {
+				continue;
+			}
+			memcpy(this->pool + offset, flash, bytes);
+			eval->data.data = this->pool + offset;
+			this->used = offset + bytes;
+
+			uint32_t now = profiled_invoke(interpreter, profiler);
+			this->entries[this->count++] = {
+				idx, op, profiler.tag(op), bytes,
+				(int32_t)(total - now)
+			};
+			total = now;
+		}
+	}
+	return this->count;
+}
+
+void speech::weight_cache::report() const
+{
+	printf("[i] Weight cache: %u tensors, %u of %u bytes used\n",
+	       (unsigned)this->count, (unsigned)this->used,
+	       (unsigned)this->pool_size);
+	int32_t saved = 0;
+	for (size_t i = 0; i < this->count; i++) {
+		const entry &e = this->entries[i];
+		printf("[i]     tensor %3li (op %2u %-16s) %6u bytes: "
+		       "%8li cycles saved\n",
+		       (long)e.tensor, (unsigned)e.op, e.tag,
+		       (unsigned)e.bytes, (long)e.saved);
+		saved += e.saved;
+	}
+	printf("[i]     total: %lu -> %lu cycles\n",
+	       (unsigned long)this->baseline,
+	       (unsigned long)(this->baseline - saved));
+}
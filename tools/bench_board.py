@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+
+# Prints the results of bench.elf and writes them in the format of the host
+# speech_bench, so boards and builds can be compared with bench_diff.py.
+# Start it before resetting the board, or at any time after boot.
+
+import json
+import sys
+
+import protocol
+
+ser = protocol.open_port(timeout=10.0)
+core_clock, entries = protocol.bench(ser)
+ser.close()
+
+print(f'Core clock {core_clock / 1e6:.0f} MHz')
+print(f'{"stage":<28} {"median":>10} {"p99":>10} {"cycles/byte":>12}')
+benchmarks = []
+for entry in entries:
+    # Cache state and operators in the name, so every entry is unique
+    name = ('op ' if entry['op'] else '') + entry['name']
+    if not entry['cache']:
+        name += ' (no cache)'
+    per_byte = entry['median_cycles'] / entry['bytes'] if entry['bytes'] \
+        else 0.0
+    print(f'{name:<28} {entry["median_cycles"]:>10} '
+          f'{entry["p99_cycles"]:>10} {per_byte:>12.3f}')
+    benchmarks.append({
+        'name': name,
+        'bytes': entry['bytes'],
+        'iterations': entry['iterations'],
+        'median_ns': 1e9 * entry['median_cycles'] / core_clock,
+        'p99_ns': 1e9 * entry['p99_cycles'] / core_clock,
+        'median_cycles': entry['median_cycles'],
+        'p99_cycles': entry['p99_cycles'],
+        'cycles_per_byte': per_byte,
+    })
+
+if len(sys.argv) > 1:
+    with open(sys.argv[1], 'w') as f:
+        json.dump({'benchmarks': benchmarks}, f, indent=1)
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+
+# Compares two result files of speech_bench, e.g. before and after a change,
+# and prints the change of the median time and cycles of every stage.
+
+import json
+import sys
+
+if len(sys.argv) != 3:
+    print(f'Usage: {sys.argv[0]} before.json after.json')
+    sys.exit(1)
+
+
+def load(path):
+    with open(path) as f:
+        return {b['name']: b for b in json.load(f)['benchmarks']}
+
+
+before = load(sys.argv[1])
+after = load(sys.argv[2])
+
+print(f'{"stage":<20} {"before ns":>12} {"after ns":>12} {"change":>8} '
+      f'{"cycles/byte":>12}')
+for name, b in before.items():
+    if name not in after:
+        print(f'{name:<20} {b["median_ns"]:>12.1f} {"-":>12}')
+        continue
+    a = after[name]
+    change = 100.0 * (a['median_ns'] - b['median_ns']) / b['median_ns']
+    print(f'{name:<20} {b["median_ns"]:>12.1f} {a["median_ns"]:>12.1f} '
+          f'{change:>+7.1f}% {a["cycles_per_byte"]:>12.3f}')
+for name in after.keys() - before.keys():
+    print(f'{name:<20} {"-":>12} {after[name]["median_ns"]:>12.1f}')
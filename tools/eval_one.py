@@ -1,12 +1,9 @@
 #!/usr/bin/env python3
 
-import sys
-import serial
-import time
 import tensorflow as tf
 import numpy as np
-from tqdm import tqdm
-from crc import Calculator, Crc32
+
+import protocol
 
 
 def get_spectrogram(waveform):
@@ -31,96 +28,29 @@ x = get_spectrogram(x)
 input_data = np.array(x)
 preprocessed_input_data = (input_data * 256).astype('uint8')
 
+# With speech_frontend from the host build on PYTHONPATH, send exactly the
+# features the firmware would compute from this waveform
+try:
+    import speech_frontend
+    clip = np.clip(np.round(np.array(waveform) * 32768), -32768, 32767)
+    preprocessed_input_data = np.frombuffer(
+        speech_frontend.features(clip.astype(np.int16)), dtype=np.uint8)
+except ImportError:
+    pass
+
 with open('/tmp/input.bin', 'wb') as f:
     f.write(preprocessed_input_data)
 
 with open('/tmp/input.bin', 'rb') as f:
     data = f.read()
 
-filesize=len(data)
-print(f'filesize={filesize}')
-
-calculator = Calculator(Crc32.CRC32)
-
-ser = serial.Serial(
-    port='/dev/ttyACM0',
-    baudrate=115200,
-    parity=serial.PARITY_NONE,
-    stopbits=serial.STOPBITS_ONE,
-    bytesize=serial.EIGHTBITS
-)
-
-ser.isOpen()
-ser.write(b'START')
-
-c = b'N'
-# Ugly way to detect substring 'START' in response
-while True:
-    c = ser.read(1)
-    if (c == b'S'):
-        c = ser.read(1)
-        if (c == b'T'):
-            c = ser.read(1)
-            if (c == b'A'):
-                c = ser.read(1)
-                if (c == b'R'):
-                    c = ser.read(1)
-                    if (c == b'T'):
-                        break;
-
-blocksize = int(ser.read(4))
-
-print(f'Transaction started, block size is {blocksize} bytes')
-ser.write(str(filesize).zfill(8).encode('utf-8'))
-
-c = b'N'
-while (c != b'A'):
-    c = ser.read(1)
-
-print(f'Sending {filesize} bytes')
-
-
-
-def required_blocks(filesize, blocksize):
-    return (filesize + blocksize - 1) // blocksize
-
-# Pad data with zeroes
-data = data + b'0' * (required_blocks(filesize, blocksize) * blocksize - len(data))
-
-retry = 0
-naks=0
-start_time = time.time()
-for block in tqdm(range(required_blocks(filesize, blocksize))):
-    chunk = data[block * blocksize : (block + 1) * blocksize]
-    checksum = format(calculator.checksum(chunk), 'x').zfill(8).encode('utf-8')
-    ser.write(checksum)
-    ser.write(chunk)
-    c = ser.read(1)
-    if (c == b'N'):
-        while (retry < 5):
-            retry = retry + 1
-            naks = naks + 1
-            print(f'Received NAK, retry {retry}')
-            chunk = data[block * blocksize : (block + 1) * blocksize]
-            ser.write(format(calculator.checksum(chunk), 'x').encode('utf-8'))
-            ser.write(chunk)
-            c = ser.read(1)
-            if (c == b'A'):
-                break
-        if (retry >= 5):
-            print(f'Retries exceeded, giving up.')
-            sys.exit(1)
-        continue
-    elif (c != b'A'):
-        print(f'Unexpected character: {c}')
-        sys.exit(1)
-    retry = 0
-
-total_time = time.time() - start_time
-speed = filesize / total_time / 1024.0
-print(f'Transaction completed successfully ({speed:.2f} kiB/s, {naks} retransmissions)')
+print(f'filesize={len(data)}')
 
-while True:
-    print(ser.read().decode('utf-8'), end='')
+# The spectrogram goes straight into the input tensor, the firmware
+# skips its own front end
+ser = protocol.open_port()
+naks = protocol.send(ser, protocol.payload(data, protocol.PAYLOAD_FEATURES_U8))
+print(f'Transaction completed successfully ({naks} retransmissions)')
 
+protocol.print_until_timeout(ser, timeout=None)
 ser.close()
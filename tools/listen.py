@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+
+# Prints what the device hears while it classifies the microphone
+# continuously. Requires firmware built with a wake detector or a step
+# model, see ml/train.py --wake and --streaming. Stop with Ctrl-C, which
+# prints how often the classifier ran and how long each stage took.
+
+import sys
+
+import protocol
+
+# Output order of the model, see speech::classifier::labels
+LABELS = ['DOWN', 'LEFT', 'NO', 'RIGHT', 'UP', 'YES']
+
+# Minimum score of the best label, out of 255
+THRESHOLD = int(sys.argv[1]) if len(sys.argv) > 1 else 200
+
+ser = protocol.open_port(timeout=2.0)
+results = protocol.listen(ser)
+last = None
+hops = 0
+triggers = 0
+step_us = 0
+classify_us = 0
+try:
+    for result in results:
+        if not result['warm']:
+            continue
+        hops += 1
+        step_us += result['step_us']
+        if not result['scores']:
+            last = None
+            continue
+        triggers += 1
+        classify_us += result['classify_us']
+        score = result['scores'][result['label']]
+        label = LABELS[result['label']] if score >= THRESHOLD else None
+        # One line per word, not per hop
+        if label is not None and label != last:
+            print(f'{result["hop"]:8} {label:6} {score:3} '
+                  f'(wake score {result["wake_score"]})')
+        last = label
+except KeyboardInterrupt:
+    pass
+finally:
+    results.close()
+    ser.close()
+
+if hops:
+    print(f'{hops} hops, classifier ran on {triggers} '
+          f'({100 * triggers / hops:.1f} %)')
+    print(f'first stage {step_us / hops:.0f} us per hop')
+    if triggers:
+        print(f'classifier {classify_us / triggers:.0f} us per trigger')
+    print(f'average {(step_us + classify_us) / hops:.0f} us per hop')
@@ -0,0 +1,16 @@
+#!/usr/bin/env python3
+
+# Prints how much stack, heap, tensor arena and pool memory the device has
+# used since reset
+
+import protocol
+
+ser = protocol.open_port(timeout=2.0)
+stat = protocol.memstat(ser)
+ser.close()
+
+for name in ('stack', 'arena', 'pool'):
+    used = stat[f'{name}_used']
+    size = stat[f'{name}_size']
+    print(f'{name:6} {used:6} / {size:6} bytes ({100 * used / size:.0f} %)')
+print(f'heap   {stat["heap_used"]:6} bytes')
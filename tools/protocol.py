@@ -0,0 +1,350 @@
+#!/usr/bin/env python3
+
+# Host side of the serial protocol implemented in src/serial.c
+
+import os
+import struct
+import sys
+import serial
+from tqdm import tqdm
+from crc import Calculator, Crc32
+
+# Override with e.g. SERIAL_PORT=/dev/pts/3
+PORT = os.environ.get('SERIAL_PORT', '/dev/ttyACM0')
+BAUDRATE = 115200
+RETRIES = 5
+
+# Payload types, see enum serial_payload_type in include/serial.h
+PAYLOAD_WAVEFORM_U8 = 0
+PAYLOAD_WAVEFORM_S16 = 1
+PAYLOAD_FEATURES_U8 = 2
+PAYLOAD_WAVEFORM_ADPCM = 3
+
+# IMA-ADPCM tables, see src/adpcm.c
+ADPCM_INDEX = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+ADPCM_STEP = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+    209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724,
+    796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+    2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132,
+    7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+    22385, 24623, 27086, 29794, 32767,
+]
+
+calculator = Calculator(Crc32.CRC32)
+
+def payload(data, payload_type):
+    """Prepend the header that tells the firmware what data contains"""
+    return struct.pack('<4sB3xI', b'SPLD', payload_type, len(data)) + data
+
+def open_port(port=PORT, timeout=None):
+    return serial.Serial(
+        port=port,
+        baudrate=BAUDRATE,
+        parity=serial.PARITY_NONE,
+        stopbits=serial.STOPBITS_ONE,
+        bytesize=serial.EIGHTBITS,
+        timeout=timeout
+    )
+
+def wait_for(ser, token):
+    window = b''
+    while not window.endswith(token):
+        c = ser.read(1)
+        if c == b'':
+            raise TimeoutError(f'No {token} received')
+        window = (window + c)[-len(token):]
+
+def required_blocks(filesize, blocksize):
+    return (filesize + blocksize - 1) // blocksize
+
+def send_block(ser, chunk):
+    checksum = format(calculator.checksum(chunk), 'x').zfill(8).encode('utf-8')
+    ser.write(checksum)
+    ser.write(chunk)
+    return ser.read(1)
+
+def send(ser, data, command=b'START', progress=True):
+    """
+    Run one transaction and return the number of retransmissions.
+    Raises RuntimeError if the device rejects the transfer.
+    """
+    ser.write(command)
+    wait_for(ser, command)
+    blocksize = int(ser.read(4))
+    filesize = len(data)
+    ser.write(str(filesize).zfill(8).encode('utf-8'))
+
+    if ser.read(1) != b'A':
+        raise RuntimeError(f'Device rejected {filesize} bytes')
+
+    # Pad data with zeroes
+    data = data + b'0' * (required_blocks(filesize, blocksize) * blocksize - filesize)
+
+    naks = 0
+    blocks = range(required_blocks(filesize, blocksize))
+    for block in tqdm(blocks, leave=False, disable=not progress):
+        chunk = data[block * blocksize : (block + 1) * blocksize]
+        for retry in range(RETRIES + 1):
+            c = send_block(ser, chunk)
+            if c == b'A':
+                break
+            if c == b'X':
+                raise RuntimeError('Device aborted the transfer')
+            if c != b'N':
+                raise RuntimeError(f'Unexpected character: {c}')
+            naks = naks + 1
+        else:
+            raise RuntimeError('Retries exceeded, giving up.')
+    return naks
+
+# Result record of a batch clip, see struct clip_result in src/main.cc
+RESULT_FORMAT = '<IBBBBII'
+
+def adpcm_encode(samples):
+    """
+    Encode 16-bit samples for PAYLOAD_WAVEFORM_ADPCM, a quarter of the size
+    of the raw samples. An odd sample count is padded with silence.
+    """
+    samples = [int(x) for x in samples]
+    if len(samples) % 2:
+        samples.append(0)
+    predictor = samples[0]
+    index = 0
+    out = bytearray(struct.pack('<hBx', predictor, index))
+    nibbles = []
+    for sample in samples:
+        step = ADPCM_STEP[index]
+        diff = sample - predictor
+        nibble = 0
+        if diff < 0:
+            nibble = 8
+            diff = -diff
+        # Same rounding as the decoder so both sides track the same predictor
+        delta = step >> 3
+        if diff >= step:
+            nibble |= 4
+            diff -= step
+            delta += step
+        if diff >= step >> 1:
+            nibble |= 2
+            diff -= step >> 1
+            delta += step >> 1
+        if diff >= step >> 2:
+            nibble |= 1
+            delta += step >> 2
+        predictor = predictor - delta if nibble & 8 else predictor + delta
+        predictor = max(-32768, min(32767, predictor))
+        index = max(0, min(88, index + ADPCM_INDEX[nibble]))
+        nibbles.append(nibble)
+    for i in range(0, len(nibbles), 2):
+        out.append(nibbles[i] | (nibbles[i + 1] << 4))
+    return bytes(out)
+
+def read_result(ser):
+    """Read the record following an 'R' and return it as a dict"""
+    length = ser.read(1)[0]
+    record = ser.read(length)
+    index, status, label, num_scores, _, frontend_us, inference_us = \
+        struct.unpack_from(RESULT_FORMAT, record)
+    offset = struct.calcsize(RESULT_FORMAT)
+    return {
+        'index': index,
+        'status': status,
+        'label': label,
+        'scores': list(record[offset : offset + num_scores]),
+        'frontend_us': frontend_us,
+        'inference_us': inference_us,
+    }
+
+# High-water marks, see struct memstat in include/memstat.h
+MEMSTAT_FIELDS = ('stack_size', 'stack_used', 'heap_used', 'arena_size',
+                  'arena_used', 'pool_size', 'pool_used')
+MEMSTAT_FORMAT = '<7I'
+
+def parse_memstat(record):
+    return dict(zip(MEMSTAT_FIELDS, struct.unpack_from(MEMSTAT_FORMAT, record)))
+
+def memstat(ser):
+    """Ask the device how much stack, heap, arena and pool it has used"""
+    ser.write(b'WMARK')
+    wait_for(ser, b'WMARKR')
+    length = ser.read(1)[0]
+    return parse_memstat(ser.read(length))
+
+# Results of bench.elf, see include/bench.h
+BENCH_HEADER_FORMAT = '<IIHH'
+BENCH_ENTRY_FORMAT = '<20sIHBxII'
+BENCH_FLAG_CACHE = 1 << 0
+BENCH_FLAG_OP = 1 << 1
+
+def bench(ser):
+    """
+    Read the results bench.elf sends after boot, asking for them again in
+    case it booted earlier. Returns the core clock and a dict per entry.
+    """
+    ser.write(b'\n')
+    wait_for(ser, b'BENCH')
+    length = struct.unpack('<I', ser.read(4))[0]
+    record = ser.read(length)
+    crc = struct.unpack('<I', ser.read(4))[0]
+    if len(record) != length or calculator.checksum(record) != crc:
+        raise RuntimeError('Corrupt benchmark record')
+    core_clock, _, num_entries, entry_size = \
+        struct.unpack_from(BENCH_HEADER_FORMAT, record)
+    offset = struct.calcsize(BENCH_HEADER_FORMAT)
+    entries = []
+    for i in range(num_entries):
+        name, nbytes, iterations, flags, median, p99 = struct.unpack_from(
+            BENCH_ENTRY_FORMAT, record, offset + i * entry_size)
+        entries.append({
+            'name': name.rstrip(b'\0').decode(),
+            'bytes': nbytes,
+            'iterations': iterations,
+            'cache': bool(flags & BENCH_FLAG_CACHE),
+            'op': bool(flags & BENCH_FLAG_OP),
+            'median_cycles': median,
+            'p99_cycles': p99,
+        })
+    return core_clock, entries
+
+# Event trace of firmware built with -DTRACE_SIZE, see include/trace.h
+TRACE_HEADER_FORMAT = '<IIHH'
+TRACE_EVENT_FORMAT = '<IIBB2x'
+
+def trace(ser):
+    """
+    Fetch the events the device traced since the last call. Returns the core
+    clock after the last event, the number of events that were overwritten
+    and a dict per event, oldest first.
+    """
+    ser.write(b'TRACE')
+    wait_for(ser, b'TRACE')
+    if ser.read(1) != b'A':
+        raise RuntimeError('Firmware built without -DTRACE_SIZE')
+    length = struct.unpack('<I', ser.read(4))[0]
+    record = ser.read(length)
+    crc = struct.unpack('<I', ser.read(4))[0]
+    if len(record) != length or calculator.checksum(record) != crc:
+        raise RuntimeError('Corrupt trace record')
+    core_clock, lost, num_events, event_size = \
+        struct.unpack_from(TRACE_HEADER_FORMAT, record)
+    offset = struct.calcsize(TRACE_HEADER_FORMAT)
+    events = []
+    for i in range(num_events):
+        cycles, arg, event_id, phase = struct.unpack_from(
+            TRACE_EVENT_FORMAT, record, offset + i * event_size)
+        events.append({
+            'cycles': cycles,
+            'arg': arg,
+            'id': event_id,
+            'phase': phase,
+        })
+    return core_clock, lost, events
+
+# Result record of a hop while listening, see struct listen_result in
+# src/main.cc
+LISTEN_FORMAT = '<IBBBBII'
+
+def listen(ser):
+    """
+    Start continuous classification and yield a dict per hop. 'scores' is
+    empty unless the classifier ran, which depends on the wake detector if
+    the device has one. The device stops listening when the host sends
+    anything, e.g. after closing the generator.
+    """
+    ser.write(b'LISTN')
+    wait_for(ser, b'LISTN')
+    if ser.read(1) != b'A':
+        raise RuntimeError('Device has neither a wake detector nor a step '
+                           'model, see ml/train.py')
+    try:
+        while True:
+            if ser.read(1) != b'R':
+                continue
+            length = ser.read(1)[0]
+            record = ser.read(length)
+            hop, warm, label, num_scores, wake_score, step_us, classify_us = \
+                struct.unpack_from(LISTEN_FORMAT, record)
+            offset = struct.calcsize(LISTEN_FORMAT)
+            yield {
+                'hop': hop,
+                'warm': bool(warm),
+                'label': label,
+                'scores': list(record[offset : offset + num_scores]),
+                'wake_score': wake_score,
+                'step_us': step_us,
+                'classify_us': classify_us,
+            }
+    finally:
+        ser.write(b'\n')
+
+def batch(ser, clips, progress=True, timeout=5.0):
+    """
+    Send all clips in one batch transaction and return their results,
+    ordered like the clips. Every clip should carry a payload() header,
+    they are padded to the same size.
+    """
+    ser.write(b'BATCH')
+    wait_for(ser, b'BATCH')
+    blocksize = int(ser.read(4))
+    window = int(ser.read(2))
+
+    clipsize = max(len(clip) for clip in clips)
+    clip_blocks = required_blocks(clipsize, blocksize)
+    ser.write(str(len(clips)).zfill(8).encode('utf-8'))
+    ser.write(str(clipsize).zfill(8).encode('utf-8'))
+    if ser.read(1) != b'A':
+        raise RuntimeError(f'Device rejected {len(clips)} clips of {clipsize} bytes')
+
+    frames = []
+    for clip in clips:
+        clip = clip + b'0' * (clip_blocks * blocksize - len(clip))
+        for block in range(clip_blocks):
+            chunk = clip[block * blocksize : (block + 1) * blocksize]
+            seq = format(len(frames) & 0xffff, '04x').encode('utf-8')
+            checksum = format(calculator.checksum(chunk), 'x').zfill(8).encode('utf-8')
+            frames.append(seq + checksum + chunk)
+
+    # Go-back-N: the device drops blocks that are not the next one, so
+    # after a NAK or a timeout continue with the oldest unacknowledged one
+    ser.timeout = timeout
+    results = [None] * len(clips)
+    received = 0
+    base = 0
+    sent = 0
+    naks = 0
+    bar = tqdm(total=len(clips), leave=False, disable=not progress)
+    while (base < len(frames)) or (received < len(clips)):
+        while (sent < len(frames)) and (sent - base < window):
+            ser.write(frames[sent])
+            sent = sent + 1
+        c = ser.read(1)
+        if c == b'A':
+            base = base + 1
+        elif c == b'R':
+            result = read_result(ser)
+            results[result['index']] = result
+            received = received + 1
+            bar.update(1)
+        elif c in (b'N', b''):
+            if c == b'' and base == len(frames):
+                raise TimeoutError('Results missing')
+            naks = naks + 1
+            if naks > RETRIES * len(clips):
+                raise RuntimeError('Retries exceeded, giving up.')
+            sent = base
+        else:
+            raise RuntimeError(f'Unexpected character: {c}')
+    bar.close()
+    return results
+
+def print_until_timeout(ser, timeout=1.0):
+    ser.timeout = timeout
+    while True:
+        c = ser.read(1)
+        if c == b'':
+            break
+        sys.stdout.write(c.decode('utf-8', errors='replace'))
+    sys.stdout.flush()
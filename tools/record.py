@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+
+# Record the microphone of the board to a WAV file, using the binary
+# stream of src/stream.cc
+
+import struct
+import sys
+import wave
+
+import protocol
+
+STREAM_SYNC = b'\x5a\xa5'
+HEADER_FORMAT = '<HBBHHI'
+HEADER_LEN = struct.calcsize(HEADER_FORMAT)
+TYPE_INFO = 0
+TYPE_AUDIO = 1
+TYPE_TELEMETRY = 2
+
+def read_frame(ser):
+    """Return (type, seq, drops, payload) of the next frame"""
+    protocol.wait_for(ser, STREAM_SYNC)
+    header = STREAM_SYNC + ser.read(HEADER_LEN - len(STREAM_SYNC))
+    _, frame_type, _, seq, length, drops = struct.unpack(HEADER_FORMAT, header)
+    return frame_type, seq, drops, ser.read(length)
+
+def record(ser, seconds):
+    ser.write(b'AUDIO')
+    protocol.wait_for(ser, b'AUDIO')
+    baudrate = int(ser.read(8))
+    ser.baudrate = baudrate
+    ser.write(b'A')
+
+    sample_rate = None
+    samples = bytearray()
+    expected_seq = None
+    lost = 0
+    drops = 0
+    telemetry = None
+    while sample_rate is None or len(samples) < seconds * sample_rate * 2:
+        frame_type, seq, drops, payload = read_frame(ser)
+        if expected_seq is not None and seq != expected_seq:
+            lost = lost + ((seq - expected_seq) & 0xffff)
+        expected_seq = (seq + 1) & 0xffff
+        if frame_type == TYPE_INFO:
+            sample_rate, bits, channels = struct.unpack_from('<IBB', payload)
+        elif frame_type == TYPE_AUDIO and sample_rate is not None:
+            samples += payload
+        elif frame_type == TYPE_TELEMETRY:
+            telemetry = protocol.parse_memstat(payload)
+
+    # Any character ends the stream
+    ser.write(b'S')
+    ser.baudrate = protocol.BAUDRATE
+    return sample_rate, bytes(samples), lost, drops, telemetry
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print(f'Usage: python {sys.argv[0]} SECONDS FILE')
+        sys.exit(1)
+
+    ser = protocol.open_port(timeout=2.0)
+    sample_rate, samples, lost, drops, telemetry = record(ser, float(sys.argv[1]))
+    ser.close()
+
+    with wave.open(sys.argv[2], mode='wb') as wav_file:
+        wav_file.setnchannels(1)
+        wav_file.setsampwidth(2)
+        wav_file.setframerate(sample_rate)
+        wav_file.writeframes(samples)
+    print(f'{len(samples) // 2} samples at {sample_rate} Hz, '
+          f'{lost} frames missing ({drops} dropped on the device)')
+    if telemetry is not None:
+        print(f'Stack {telemetry["stack_used"]}/{telemetry["stack_size"]}, '
+              f'arena {telemetry["arena_used"]}/{telemetry["arena_size"]}, '
+              f'pool {telemetry["pool_used"]}/{telemetry["pool_size"]}, '
+              f'heap {telemetry["heap_used"]} bytes')
@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import os
 import sys
 import serial
 import time
@@ -19,7 +20,7 @@ filesize=len(data)
 calculator = Calculator(Crc32.CRC32)
 
 ser = serial.Serial(
-    port='/dev/ttyACM0',
+    port=os.environ.get('SERIAL_PORT', '/dev/ttyACM0'),
     baudrate=115200,
     parity=serial.PARITY_NONE,
     stopbits=serial.STOPBITS_ONE,
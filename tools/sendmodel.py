@@ -0,0 +1,29 @@
+#!/usr/bin/env python3
+
+# Replaces the model running on the microcontroller without reflashing
+
+import sys
+import time
+import protocol
+
+if len(sys.argv) != 2:
+    print(f'Usage: python {sys.argv[0]} MODEL.tflite')
+    sys.exit(1)
+
+filename = sys.argv[1]
+with open(filename, 'rb') as file:
+    data = file.read()
+
+ser = protocol.open_port()
+print(f'Sending model \'{filename}\' ({len(data)} bytes)')
+start_time = time.time()
+try:
+    naks = protocol.send(ser, data, command=b'MODEL')
+except RuntimeError as e:
+    print(e)
+    sys.exit(1)
+print(f'Transaction completed in {time.time() - start_time:.1f} s ({naks} retransmissions)')
+
+# The device validates the model and rebuilds the interpreter
+protocol.print_until_timeout(ser, timeout=2.0)
+ser.close()
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+
+# Sends the same batch to speech_device over a clean line and over one that
+# corrupts and loses bytes, and checks that the second one still delivers
+# every result, identical to the first. Run by ctest in the host build:
+#   test_batch_resync.py speech_device model.tflite
+
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+import protocol
+
+CLIPS = 3
+SAMPLES = 16000
+
+def clips():
+    """Deterministic 8-bit waveforms that differ from clip to clip"""
+    return [protocol.payload(bytes(((i * (c + 3)) >> 2) & 0xff
+                                   for i in range(SAMPLES)),
+                             protocol.PAYLOAD_WAVEFORM_U8)
+            for c in range(CLIPS)]
+
+def run(device, model, args):
+    link = os.path.join(tempfile.mkdtemp(), 'device')
+    proc = subprocess.Popen([device, '-l', link] + args + [model],
+                            stdout=subprocess.DEVNULL)
+    try:
+        for _ in range(50):
+            if os.path.exists(link):
+                break
+            time.sleep(0.1)
+        ser = protocol.open_port(link, timeout=5.0)
+        # Longer than the 500 ms after which the device gives up on a frame
+        results = protocol.batch(ser, clips(), progress=False, timeout=1.0)
+        ser.close()
+        return results
+    finally:
+        proc.terminate()
+        proc.wait()
+
+if len(sys.argv) != 3:
+    print(f'usage: {sys.argv[0]} speech_device model.tflite', file=sys.stderr)
+    sys.exit(1)
+
+# Every garbled frame costs a NACK
+protocol.RETRIES = 50
+
+expected = run(sys.argv[1], sys.argv[2], [])
+results = run(sys.argv[1], sys.argv[2], ['-e', '0.0002', '-d', '0.0002',
+                                         '-s', '7'])
+failed = 0
+for clip, (want, got) in enumerate(zip(expected, results)):
+    if (got is None) or (got['status'] != 0) or \
+       (got['label'] != want['label']) or (got['scores'] != want['scores']):
+        print(f'clip {clip}: expected {want}, got {got}')
+        failed = failed + 1
+sys.exit(1 if failed else 0)
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+
+# Fetches the event trace of firmware built with -DTRACE_SIZE (see
+# include/trace.h) and writes it as Chrome trace JSON, which opens in
+# chrome://tracing or https://ui.perfetto.dev. Every run shows what happened
+# since the previous one.
+
+import json
+import sys
+
+import protocol
+
+# enum trace_id in include/trace.h: name and the track it is drawn on
+EVENTS = [
+    ('clock switch', 'main'),
+    ('sleep', 'main'),
+    ('command', 'serial'),
+    ('block', 'serial'),
+    ('frame', 'serial'),
+    ('NACK', 'serial'),
+    ('skipped frame', 'serial'),
+    ('stream frame', 'stream'),
+    ('stream drop', 'stream'),
+    ('clip', 'main'),
+    ('features', 'main'),
+    ('invoke', 'main'),
+    ('op', 'main'),
+    ('task', 'tasks'),
+    ('mic DMA', 'interrupts'),
+    ('UART TX DMA', 'interrupts'),
+    ('UART', 'interrupts'),
+]
+TRACKS = ['main', 'tasks', 'serial', 'stream', 'interrupts']
+TRACE_CLOCK = 0
+TRACE_SLEEP = 1
+TRACE_SERIAL_CMD = 2
+TRACE_SERIAL_NACK = 5
+TRACE_OP = 12
+TRACE_TASK = 13
+BEGIN, END, MARK = 0, 1, 2
+
+# enum serial_cmd in include/serial.h and enum task in include/scheduler.h
+COMMANDS = ['NONE', 'START', 'MODEL', 'BATCH', 'AUDIO', 'WMARK', 'LISTN',
+            'TRACE']
+TASKS = ['capture', 'features', 'telemetry', 'inference']
+
+def timestamps(core_clock, events):
+    """
+    Microseconds since the first event and the core clock before each event.
+    The clock is only known at the end, so the switches are followed
+    backwards; each one starts with the clock it switches from.
+    """
+    clocks = [core_clock] * len(events)
+    clock = core_clock
+    for i in reversed(range(len(events))):
+        e = events[i]
+        if e['id'] == TRACE_CLOCK and e['phase'] == BEGIN:
+            clock = e['arg']
+        clocks[i] = clock
+
+    times = [0.0] * len(events)
+    for i in range(1, len(events)):
+        cycles = (events[i]['cycles'] - events[i - 1]['cycles']) & 0xffffffff
+        # The cycle counter stands still while the core sleeps
+        if events[i]['id'] == TRACE_SLEEP:
+            cycles += events[i]['arg']
+        times[i] = times[i - 1] + cycles * 1e6 / clocks[i]
+    return times, clocks
+
+def chrome_trace(core_clock, events):
+    times, clocks = timestamps(core_clock, events)
+    out = [{'ph': 'M', 'name': 'thread_name', 'pid': 0, 'tid': tid,
+            'args': {'name': track}} for tid, track in enumerate(TRACKS)]
+    # Open spans per track; a span begun before the trace has no begin
+    spans = {tid: [] for tid in range(len(TRACKS))}
+    if events:
+        out.append({'ph': 'C', 'name': 'core clock', 'pid': 0, 'ts': 0.0,
+                    'args': {'MHz': clocks[0] / 1e6}})
+    for e, ts, clock in zip(events, times, clocks):
+        name, track = EVENTS[e['id']] if e['id'] < len(EVENTS) else \
+            (f'event {e["id"]}', 'main')
+        tid = TRACKS.index(track)
+        args = {'arg': e['arg']}
+        if e['id'] == TRACE_TASK and e['arg'] < len(TASKS):
+            name = TASKS[e['arg']]
+        elif e['id'] == TRACE_OP:
+            name = f'op {e["arg"]}'
+        elif e['id'] == TRACE_SERIAL_CMD and e['arg'] < len(COMMANDS):
+            args = {'command': COMMANDS[e['arg']]}
+        elif e['id'] == TRACE_CLOCK:
+            args = {'hz': e['arg']}
+
+        if e['id'] == TRACE_SLEEP:
+            dur = e['arg'] * 1e6 / clock
+            out.append({'ph': 'X', 'name': name, 'pid': 0, 'tid': tid,
+                        'ts': ts - dur, 'dur': dur})
+            continue
+        event = {'name': name, 'pid': 0, 'tid': tid, 'ts': ts, 'args': args}
+        if e['phase'] == BEGIN:
+            spans[tid].append(name)
+            out.append(dict(event, ph='B'))
+        elif e['phase'] == END:
+            if name not in spans[tid]:
+                continue
+            # Close what was left open in between, e.g. by lost events
+            while True:
+                top = spans[tid].pop()
+                out.append(dict(event, name=top, ph='E'))
+                if top == name:
+                    break
+        else:
+            out.append(dict(event, ph='i', s='t'))
+        if e['id'] == TRACE_CLOCK and e['phase'] == END:
+            out.append({'ph': 'C', 'name': 'core clock', 'pid': 0,
+                        'ts': ts, 'args': {'MHz': e['arg'] / 1e6}})
+
+    end = times[-1] if times else 0.0
+    for tid, names in spans.items():
+        for name in reversed(names):
+            out.append({'ph': 'E', 'name': name, 'pid': 0, 'tid': tid,
+                        'ts': end})
+    return {'traceEvents': out, 'displayTimeUnit': 'ns'}
+
+if len(sys.argv) < 2:
+    print(f'usage: {sys.argv[0]} trace.json', file=sys.stderr)
+    sys.exit(1)
+
+ser = protocol.open_port(timeout=10.0)
+core_clock, lost, events = protocol.trace(ser)
+ser.close()
+
+with open(sys.argv[1], 'w') as f:
+    json.dump(chrome_trace(core_clock, events), f)
+
+nacks = sum(1 for e in events if e['id'] == TRACE_SERIAL_NACK)
+print(f'{len(events)} events, {lost} lost, {nacks} NACKs')